@@ -0,0 +1,85 @@
+//atomic.c
+#include <pthread.h>
+#include "atomic.h"
+#include "hart.h"
+
+bool amo_shared;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static amo_reservation_t reservations[MAX_HARTS];
+
+void amo_share(void)
+{
+  amo_shared = true;
+}
+
+amo_reservation_t* amo_hart_reservation(void)
+{
+  return &reservations[hart_id];
+}
+
+/**
+ * the other harts lose their reservations on the block of `address`,
+ * called with the lock held
+ **/
+static void break_reservations(Address address)
+{
+  Address block = address >> AMO_RESERVATION_BITS;
+  for (int i = 0; i < MAX_HARTS; i++) {
+    if ((Word)i != hart_id && reservations[i].block == block)
+      reservations[i].valid = false;
+  }
+}
+
+void amo_shared_store(memory_t* mem, Address address, Alignment alignment, Word value)
+{
+  pthread_mutex_lock(&lock);
+  store(mem, address, alignment, value);
+  break_reservations(address);
+  pthread_mutex_unlock(&lock);
+}
+
+Word amo_execute(Instruction instruction, Address address, Word rs2_value,
+                 memory_t* mem, amo_reservation_t* resv, bool* wrote_p)
+{
+  unsigned op = instruction.rtype.funct7 >> 2;
+  Address block = address >> AMO_RESERVATION_BITS;
+  Word rd = 0, new = 0;
+  *wrote_p = false;
+
+  if (amo_shared)
+    pthread_mutex_lock(&lock);
+  if (op == AMO_LR) {
+    rd = load(mem, address, LENGTH_WORD);
+    resv->valid = true;
+    resv->block = block;
+  } else if (op == AMO_SC) {
+    *wrote_p = resv->valid && resv->block == block;
+    resv->valid = false;
+    rd = !*wrote_p;
+    new = rs2_value;
+  } else {
+    Word old = load(mem, address, LENGTH_WORD);
+    switch (op) {
+    case AMO_ADD:  new = old + rs2_value; break;
+    case AMO_SWAP: new = rs2_value; break;
+    case AMO_XOR:  new = old ^ rs2_value; break;
+    case AMO_OR:   new = old | rs2_value; break;
+    case AMO_AND:  new = old & rs2_value; break;
+    case AMO_MIN:  new = ((sWord)old < (sWord)rs2_value) ? old : rs2_value; break;
+    case AMO_MAX:  new = ((sWord)old > (sWord)rs2_value) ? old : rs2_value; break;
+    case AMO_MINU: new = (old < rs2_value) ? old : rs2_value; break;
+    case AMO_MAXU: new = (old > rs2_value) ? old : rs2_value; break;
+    }
+    rd = old;
+    *wrote_p = true;
+  }
+  if (*wrote_p) {
+    store(mem, address, LENGTH_WORD, new);
+    if (amo_shared)
+      break_reservations(address);
+  }
+  if (amo_shared)
+    pthread_mutex_unlock(&lock);
+  return rd;
+}
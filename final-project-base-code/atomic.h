@@ -0,0 +1,105 @@
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+#include <stdbool.h>
+#include "types.h"
+#include "guest_mem.h"
+
+/**
+ * RV32A (opcode 0x2F): lr.w, sc.w and the amo*.w instructions, executed
+ * the same way by the emulator and the pipeline (in MEM, see stage_mem).
+ *
+ * lr.w reserves the AMO_RESERVATION_BITS-aligned block holding its
+ * address; sc.w stores and writes 0 to rd only when the same hart still
+ * holds a reservation on its block, and writes 1 otherwise. Either way the
+ * reservation is gone. A store of another hart to the block takes it away;
+ * the hart's own stores keep it. Every hart of the pipeline has its own
+ * reservation (amo_hart_reservation), the emulator has one of its own.
+ *
+ * With --harts, stores and atomics to the shared memory take a lock, so
+ * an amo*.w is not split by a store or atomic of another hart, and an
+ * sc.w checks its reservation and stores in one step.
+ *
+ * In the pipeline an atomic drains the store buffer first, then accesses
+ * the L1 as a load, or as a store when it writes, so it takes the line
+ * Modified between harts (coherence.h). amo*.w and sc.w hold MEM
+ * --amo-latency cycles more for the read-modify-write.
+ *
+ * The aq and rl bits need nothing in a pipeline that does one memory
+ * access at a time in order. A misaligned address is handled like a
+ * misaligned load (--misaligned).
+ **/
+
+#define AMO_RESERVATION_BITS 6   // reservation set, a cache block
+#define AMO_DEFAULT_LATENCY  2   // --amo-latency
+
+// funct5, the top bits of funct7
+#define AMO_ADD   0x00
+#define AMO_SWAP  0x01
+#define AMO_LR    0x02
+#define AMO_SC    0x03
+#define AMO_XOR   0x04
+#define AMO_OR    0x08
+#define AMO_AND   0x0C
+#define AMO_MIN   0x10
+#define AMO_MAX   0x14
+#define AMO_MINU  0x18
+#define AMO_MAXU  0x1C
+
+typedef struct {
+  bool    valid;
+  Address block;
+} amo_reservation_t;
+
+extern bool amo_shared;   // the memory is shared with other harts
+
+/**
+ * the pipeline harts share the memory from now on
+ **/
+void amo_share(void);
+
+/**
+ * reservation of the calling thread's pipeline hart
+ **/
+amo_reservation_t* amo_hart_reservation(void);
+
+/**
+ * whether `instruction` is an RV32A instruction we know
+ **/
+static inline bool amo_valid(Instruction instruction)
+{
+  if (instruction.rtype.funct3 != 0x2)
+    return false;
+  switch (instruction.rtype.funct7 >> 2) {
+  case AMO_LR:
+    return instruction.rtype.rs2 == 0;
+  case AMO_ADD: case AMO_SWAP: case AMO_SC: case AMO_XOR: case AMO_OR:
+  case AMO_AND: case AMO_MIN: case AMO_MAX: case AMO_MINU: case AMO_MAXU:
+    return true;
+  }
+  return false;
+}
+
+/**
+ * execute `instruction` on the word at `address`, with `rs2_value` the
+ * store or operand value. Returns the value for rd; *wrote_p tells
+ * whether memory was written (every AMO, a successful sc.w).
+ **/
+Word amo_execute(Instruction instruction, Address address, Word rs2_value,
+                 memory_t* mem, amo_reservation_t* resv, bool* wrote_p);
+
+void amo_shared_store(memory_t* mem, Address address, Alignment alignment, Word value);
+
+/**
+ * a plain store of the pipeline: between harts it takes the other harts'
+ * reservations on the block away
+ **/
+static inline void amo_store(memory_t* mem, Address address, Alignment alignment, Word value)
+{
+  if (amo_shared)
+    amo_shared_store(mem, address, alignment, value);
+  else
+    store(mem, address, alignment, value);
+}
+
+#endif // ATOMIC_H
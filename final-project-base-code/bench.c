@@ -0,0 +1,409 @@
+//bench.c
+// riscv-bench: microbenchmarks of the simulator's hot kernels, built with
+// the simulator's own CFLAGS so they time the code that ships
+//
+//   riscv-bench [-r reps] [-b baseline.json] [-t percent] [-u] [-o out.json] [name...]
+//
+// Every benchmark runs `reps` times (9 by default) with as many operations
+// as fill BENCH_REP_NS each, and reports the median ns/op with the fastest
+// repetition and the spread. With -b the fastest repetitions are checked
+// against the baseline file, being the least disturbed by the rest of the
+// host: a benchmark more than `percent` (25 by default) slower fails the
+// run. A missing baseline, or -u, writes the baseline instead.
+// Exits with 0 when nothing regressed, 1 on a regression and 2 on errors.
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "utils.h"
+#include "riscv.h"
+#include "pipeline.h"
+#include "cache.h"
+#include "guest_mem.h"
+
+#define BENCH_REP_NS    20000000     // time each repetition runs for
+#define BENCH_MAX_REPS  64
+#define BENCH_OPS       4096         // inputs per benchmark, a power of two
+
+// the pipeline's stage helpers, defined in pipeline.c by stage_helpers.h
+uint32_t   execute_alu(uint32_t alu_inp1, uint32_t alu_inp2, uint32_t alu_control);
+uint32_t   gen_imm(Instruction instruction);
+idex_reg_t gen_control(Instruction instruction);
+
+// riscv.c is not linked in
+memory_t* memory;
+
+typedef struct {
+  const char* name;
+  const char* desc;
+  void (*setup)(void);
+  uint32_t (*run)(uint64_t ops);     // returns something to keep the work alive
+} bench_t;
+
+typedef struct {
+  double median;
+  double min;
+  double stddev;
+} bench_result_t;
+
+static volatile uint32_t sink;
+
+static uint32_t bench_rand_state = 0x9E3779B9;
+
+static uint32_t bench_rand(void)
+{
+  bench_rand_state ^= bench_rand_state << 13;
+  bench_rand_state ^= bench_rand_state >> 17;
+  bench_rand_state ^= bench_rand_state << 5;
+  return bench_rand_state;
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// inputs
+
+static uint32_t    instr_bits[BENCH_OPS];
+static Instruction instrs[BENCH_OPS];
+static uint32_t    operand1[BENCH_OPS];
+static uint32_t    operand2[BENCH_OPS];
+static uint32_t    alu_ctrl[BENCH_OPS];
+static uint32_t    addrs[BENCH_OPS];
+
+/**
+ * a mix of the instruction formats the pipeline decodes: R, I, loads,
+ * stores, branches, jal, jalr, lui, auipc
+ **/
+static void setup_instructions(void)
+{
+  static const uint32_t opcodes[] = {
+    0x33, 0x33, 0x13, 0x13, 0x13, 0x03, 0x23, 0x63, 0x6F, 0x67, 0x37, 0x17
+  };
+  for (int i = 0; i < BENCH_OPS; i++) {
+    uint32_t r = bench_rand();
+    uint32_t opcode = opcodes[r % (sizeof(opcodes) / sizeof(opcodes[0]))];
+    static const uint32_t branch_funct3[] = {0, 1, 4, 5, 6, 7};
+    uint32_t funct3 = (opcode == 0x03 || opcode == 0x23) ? (r >> 8) % 3 :
+                      (opcode == 0x63) ? branch_funct3[(r >> 8) % 6] :
+                      (opcode == 0x67) ? 0 : (r >> 8) & 0x7;
+    uint32_t funct7 = (opcode == 0x33 && (r & 0x100000)) ? 0x20 : 0;
+    instr_bits[i] = (funct7 << 25) | (bench_rand() & 0x01FFF000 & ~0x7000)
+                  | (funct3 << 12) | (((r >> 16) & 0x1F) << 7) | opcode;
+    instrs[i] = parse_instruction(instr_bits[i]);
+  }
+}
+
+static void setup_alu(void)
+{
+  for (int i = 0; i < BENCH_OPS; i++) {
+    operand1[i] = bench_rand();
+    operand2[i] = bench_rand();
+    alu_ctrl[i] = bench_rand() % 0x12;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// decode and execute
+
+static uint32_t run_parse_instruction(uint64_t ops)
+{
+  uint32_t acc = 0;
+  for (uint64_t i = 0; i < ops; i++)
+    acc += parse_instruction(instr_bits[i & (BENCH_OPS - 1)]).bits;
+  return acc;
+}
+
+static uint32_t run_gen_control(uint64_t ops)
+{
+  uint32_t acc = 0;
+  for (uint64_t i = 0; i < ops; i++) {
+    Instruction in = instrs[i & (BENCH_OPS - 1)];
+    idex_reg_t idex = gen_control(in);
+    acc += idex.EX_ALUOp + gen_imm(in);
+  }
+  return acc;
+}
+
+static uint32_t run_execute_alu(uint64_t ops)
+{
+  uint32_t acc = 0;
+  for (uint64_t i = 0; i < ops; i++) {
+    uint32_t n = i & (BENCH_OPS - 1);
+    acc += execute_alu(operand1[n], operand2[n], alu_ctrl[n]);
+  }
+  return acc;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// operateCache, with the simulator's L1 configuration
+
+static Cache cache = {.setBits = CACHE_SET_BITS, .linesPerSet = CACHE_LINES_PER_SET,
+                      .blockBits = CACHE_BLOCK_BITS, .lfu = CACHE_LFU,
+                      .displayTrace = CACHE_DISPLAY_TRACE};
+
+static void setup_cache(void)
+{
+  if (cache.sets)
+    deallocate(&cache);
+  cacheSetUp(&cache, "bench");
+}
+
+// anywhere in 16 MiB: nearly every access misses
+static void setup_cache_random(void)
+{
+  setup_cache();
+  for (int i = 0; i < BENCH_OPS; i++)
+    addrs[i] = bench_rand() & 0xFFFFFC;
+}
+
+// one word per block through 4x the cache size: every access misses in
+// LRU order
+static void setup_cache_strided(void)
+{
+  setup_cache();
+  uint32_t size = (4u * CACHE_LINES_PER_SET) << (CACHE_SET_BITS + CACHE_BLOCK_BITS);
+  for (int i = 0; i < BENCH_OPS; i++)
+    addrs[i] = ((uint32_t)i << CACHE_BLOCK_BITS) % size;
+}
+
+// random words of half the cache: nearly every access hits
+static void setup_cache_hotset(void)
+{
+  setup_cache();
+  uint32_t size = (CACHE_LINES_PER_SET / 2) << (CACHE_SET_BITS + CACHE_BLOCK_BITS);
+  for (int i = 0; i < BENCH_OPS; i++)
+    addrs[i] = bench_rand() % size & ~3u;
+}
+
+static uint32_t run_cache(uint64_t ops)
+{
+  uint32_t acc = 0;
+  for (uint64_t i = 0; i < ops; i++)
+    acc += operateCache(addrs[i & (BENCH_OPS - 1)], &cache).status;
+  return acc;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// guest memory load/store
+
+static memory_t* mem;
+
+static void setup_mem(uint32_t span)
+{
+  if (mem == NULL)
+    mem = mem_create(MEMORY_SPACE);
+  for (int i = 0; i < BENCH_OPS; i++)
+    addrs[i] = bench_rand() % span & ~3u;
+  // touch every page so the loads find them allocated
+  for (int i = 0; i < BENCH_OPS; i++)
+    store(mem, addrs[i], LENGTH_WORD, i);
+}
+
+// one page: the hot page path
+static void setup_mem_hot(void)
+{
+  setup_mem(MEM_PAGE_SIZE);
+}
+
+// 1 MiB: a table walk on nearly every access
+static void setup_mem_random(void)
+{
+  setup_mem(1u << 20);
+}
+
+static uint32_t run_load_store(uint64_t ops)
+{
+  uint32_t acc = 0;
+  for (uint64_t i = 0; i < ops; i++) {
+    uint32_t a = addrs[i & (BENCH_OPS - 1)];
+    if (i & 1)
+      store(mem, a, LENGTH_WORD, acc);
+    else
+      acc += load(mem, a, LENGTH_WORD);
+  }
+  return acc;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static const bench_t benches[] = {
+  {"parse_instruction", "instruction word to Instruction",         setup_instructions,  run_parse_instruction},
+  {"gen_control",       "gen_control and gen_imm of one instruction", setup_instructions, run_gen_control},
+  {"execute_alu",       "one ALU operation, random control",        setup_alu,           run_execute_alu},
+  {"cache_random",      "operateCache, random addresses",          setup_cache_random,  run_cache},
+  {"cache_strided",     "operateCache, block stride over 4x the cache", setup_cache_strided, run_cache},
+  {"cache_hotset",      "operateCache, random in half the cache",  setup_cache_hotset,  run_cache},
+  {"mem_hot",           "load/store word, one page",               setup_mem_hot,       run_load_store},
+  {"mem_random",        "load/store word, random in 1 MiB",        setup_mem_random,    run_load_store},
+};
+#define NUM_BENCHES (int)(sizeof(benches) / sizeof(benches[0]))
+
+static int cmp_double(const void* a, const void* b)
+{
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+static bench_result_t bench_run(const bench_t* b, int reps)
+{
+  b->setup();
+  // warm up, and find how many operations fill a repetition
+  uint64_t ops = 1024;
+  for (;;) {
+    uint64_t t0 = now_ns();
+    sink += b->run(ops);
+    uint64_t t = now_ns() - t0;
+    if (t >= BENCH_REP_NS / 4)
+      break;
+    ops *= 2;
+  }
+  ops *= 4;
+
+  double ns[BENCH_MAX_REPS];
+  double sum = 0, sq = 0;
+  for (int r = 0; r < reps; r++) {
+    uint64_t t0 = now_ns();
+    sink += b->run(ops);
+    ns[r] = (double)(now_ns() - t0) / ops;
+    sum += ns[r];
+    sq += ns[r] * ns[r];
+  }
+  qsort(ns, reps, sizeof(ns[0]), cmp_double);
+  double mean = sum / reps;
+  return (bench_result_t){
+    .median = (reps & 1) ? ns[reps / 2] : (ns[reps / 2 - 1] + ns[reps / 2]) / 2,
+    .min = ns[0],
+    .stddev = sqrt(fmax(sq / reps - mean * mean, 0.0)),
+  };
+}
+
+/**
+ * baseline fastest repetition of `name`, 0 when the file does not have it. The file is
+ * the one write_json() writes, one benchmark per line.
+ **/
+static double baseline_of(FILE* file, const char* name)
+{
+  char line[256], key[64];
+  snprintf(key, sizeof(key), "\"%s\":", name);
+  rewind(file);
+  while (fgets(line, sizeof(line), file)) {
+    char* p = strstr(line, key);
+    if (p && (p = strstr(p, "\"min\":")))
+      return strtod(p + strlen("\"min\":"), NULL);
+  }
+  return 0;
+}
+
+static int write_json(const char* path, const bench_result_t* results, const bool* ran)
+{
+  FILE* file = fopen(path, "w");
+  if (file == NULL)
+    return -1;
+  fprintf(file, "{\n");
+  bool first = true;
+  for (int i = 0; i < NUM_BENCHES; i++) {
+    if (!ran[i])
+      continue;
+    fprintf(file, "%s  \"%s\": {\"ns_per_op\": %.3f, \"min\": %.3f, \"stddev\": %.3f}",
+            (first) ? "" : ",\n", benches[i].name,
+            results[i].median, results[i].min, results[i].stddev);
+    first = false;
+  }
+  fprintf(file, "\n}\n");
+  return fclose(file);
+}
+
+static void usage(void)
+{
+  fprintf(stderr, "usage: riscv-bench [-r reps] [-b baseline.json] [-t percent] [-u] "
+                  "[-o out.json] [name...]\n");
+  for (int i = 0; i < NUM_BENCHES; i++)
+    fprintf(stderr, "  %-18s %s\n", benches[i].name, benches[i].desc);
+}
+
+int main(int argc, char** argv)
+{
+  int reps = 9;
+  double threshold = 25;
+  const char* baseline = NULL;
+  const char* out = NULL;
+  bool update = false;
+
+  int c;
+  while ((c = getopt(argc, argv, "r:b:t:uo:h")) != -1) {
+    switch (c) {
+    case 'r': reps = atoi(optarg); break;
+    case 'b': baseline = optarg; break;
+    case 't': threshold = atof(optarg); break;
+    case 'u': update = true; break;
+    case 'o': out = optarg; break;
+    default:
+      usage();
+      return 2;
+    }
+  }
+  if (reps < 1 || reps > BENCH_MAX_REPS || threshold <= 0) {
+    fprintf(stderr, "riscv-bench: -r expects 1 to %d repetitions, -t a percentage above 0\n",
+            BENCH_MAX_REPS);
+    return 2;
+  }
+
+  bool ran[NUM_BENCHES] = {0};
+  for (int i = 0; i < NUM_BENCHES; i++) {
+    ran[i] = (optind == argc);
+    for (int a = optind; a < argc; a++)
+      if (strcmp(argv[a], benches[i].name) == 0)
+        ran[i] = true;
+  }
+
+  FILE* base = NULL;
+  if (baseline && !update) {
+    base = fopen(baseline, "r");
+    if (base == NULL)
+      printf("no baseline %s yet, writing it\n", baseline);
+  }
+
+  bench_result_t results[NUM_BENCHES];
+  int regressed = 0;
+  printf("%-18s %10s %10s %10s %10s\n", "benchmark", "ns/op", "min", "stddev", "baseline");
+  for (int i = 0; i < NUM_BENCHES; i++) {
+    if (!ran[i])
+      continue;
+    results[i] = bench_run(&benches[i], reps);
+    printf("%-18s %10.2f %10.2f %10.2f", benches[i].name,
+           results[i].median, results[i].min, results[i].stddev);
+    double ref = (base) ? baseline_of(base, benches[i].name) : 0;
+    if (ref > 0) {
+      double change = 100.0 * (results[i].min - ref) / ref;
+      bool bad = change > threshold;
+      printf(" %10.2f %+6.1f%%%s", ref, change, (bad) ? "  REGRESSION" : "");
+      regressed += bad;
+    }
+    printf("\n");
+    fflush(stdout);
+  }
+
+  if (base)
+    fclose(base);
+  if (baseline && (update || base == NULL) && write_json(baseline, results, ran) != 0) {
+    fprintf(stderr, "riscv-bench: cannot write %s\n", baseline);
+    return 2;
+  }
+  if (out && write_json(out, results, ran) != 0) {
+    fprintf(stderr, "riscv-bench: cannot write %s\n", out);
+    return 2;
+  }
+  if (regressed) {
+    printf("%d benchmark(s) more than %.0f%% slower than %s\n", regressed, threshold, baseline);
+    return 1;
+  }
+  return 0;
+}
@@ -1,5 +1,6 @@
 #include "cache.h"
 #include "dogfault.h"
+#include "host_stats.h"
 #include <assert.h>
 #include <ctype.h>
 #include <getopt.h>
@@ -8,6 +9,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include "stats.h"
+
+int mem_latency = MEM_LATENCY;
 
 // DO NOT MODIFY THIS FILE. INVOKE AFTER EACH ACCESS FROM runTrace
 void print_result(result r) {
@@ -20,7 +24,16 @@ void print_result(result r) {
     printf(" [status: miss, insert_block: 0x%llx]", r.insert_block_addr);
 }
 
+static result operate_cache(const unsigned long long address, Cache *cache);
+
 result operateCache(const unsigned long long address, Cache *cache) {
+  int hs_prev = HS_ENTER(HS_CACHE);
+  result r = operate_cache(address, cache);
+  HS_LEAVE(hs_prev);
+  return r;
+}
+
+static result operate_cache(const unsigned long long address, Cache *cache) {
   result r;
   unsigned long long target_set = cache_set(address, cache);
   Set *current_set = &cache->sets[target_set];
@@ -204,6 +217,9 @@ void cacheSetUp(Cache *cache, char *name) {
       line->block_addr = 0;
       line->lru_clock = 0;
       line->access_counter = 0;
+      line->mesi = MESI_I;
+      line->invalidated = false;
+      line->invalidated_offset = 0;
       j++;
     }
     i++;
@@ -213,6 +229,22 @@ void cacheSetUp(Cache *cache, char *name) {
   cache->miss_count = 0;
   cache->eviction_count = 0;
   cache->name = name;
+  cache->coherent = false;
+  cache->coherence_misses = 0;
+  cache->false_sharing_misses = 0;
+  cache->invalidations = 0;
+  cache->upgrades = 0;
+  cache->c2c_transfers = 0;
+  cache->writebacks = 0;
+  cache->coherence_cycles = 0;
+
+  char stat[64];
+  snprintf(stat, sizeof(stat), "%s.hits", name);
+  stats_add_int(stat, "cache hits", &cache->hit_count);
+  snprintf(stat, sizeof(stat), "%s.misses", name);
+  stats_add_int(stat, "cache misses", &cache->miss_count);
+  snprintf(stat, sizeof(stat), "%s.evictions", name);
+  stats_add_int(stat, "cache misses that evicted a valid line", &cache->eviction_count);
 }
 
 void deallocate(Cache *cache) {
@@ -19,14 +19,25 @@ enum status_enum {
 };
 
 #define CACHE_HIT_LATENCY 2    // hit latency
-#define CACHE_MISS_LATENCY MEM_LATENCY+CACHE_HIT_LATENCY  // miss latency
-#define CACHE_OTHER_LATENCY MEM_LATENCY+CACHE_HIT_LATENCY // eviction latency
+#define CACHE_MISS_LATENCY mem_latency+CACHE_HIT_LATENCY  // miss latency
+#define CACHE_OTHER_LATENCY mem_latency+CACHE_HIT_LATENCY // eviction latency
 #define CACHE_SET_BITS 4 // number of sets (2^CACHE_SET_BITS)
 #define CACHE_LINES_PER_SET 4 // Number of lines per set (associativity)
 #define CACHE_BLOCK_BITS 6 // number of blocks (2^CACHE_BLOCK_BITS)
 #define CACHE_DISPLAY_TRACE false
 #define CACHE_LFU 1 // LRU
 
+// memory access latency in cycles, MEM_LATENCY unless set with --mem-latency
+extern int mem_latency;
+
+// MESI state of a line in a cache on the coherence bus (coherence.h)
+enum mesi_enum {
+  MESI_I = 0,
+  MESI_S,
+  MESI_E,
+  MESI_M
+};
+
 // Struct definitions
 typedef struct {
     bool valid;
@@ -34,6 +45,9 @@ typedef struct {
     unsigned long long block_addr;
     int lru_clock;
     int access_counter;
+    int mesi;                // MESI state, only kept on the coherence bus
+    bool invalidated;        // invalid since a write of another hart
+    int invalidated_offset;  // byte of the block that write went to
 } Line;
 
 typedef struct {
@@ -52,6 +66,16 @@ typedef struct {
     int linesPerSet;
     int blockBits;
     char *name;
+    // coherence (coherence.h), counted while the cache is on the bus
+    bool coherent;
+    int hart;
+    int coherence_misses;      // misses on lines other harts' writes invalidated
+    int false_sharing_misses;  // of those, to another word than the one written
+    int invalidations;         // lines invalidated by other harts' writes
+    int upgrades;              // writes to a Shared line (BusUpgr)
+    int c2c_transfers;         // misses supplied by another cache
+    int writebacks;            // Modified lines evicted or flushed
+    unsigned long coherence_cycles; // cycles charged for coherence
 } Cache;
 
 typedef struct {
@@ -0,0 +1,37 @@
+#!/bin/bash
+# Assemble the guest benchmark kernels (input/*.S) into the simulator's
+# .input format, one 0x-prefixed instruction word per line. Uses LLVM
+# (llvm-mc, llvm-objcopy) or a GNU RISC-V toolchain, whichever is found;
+# the generated .input files are checked in, so this is only needed after
+# changing a kernel.
+#
+#   ./gen_hex.sh [kernel.S...]
+set -e
+cd "$(dirname "$0")"
+
+if command -v llvm-mc >/dev/null && command -v llvm-objcopy >/dev/null; then
+    assemble() { llvm-mc -triple=riscv32 -mattr=-relax -filetype=obj "$1" -o "$2"; }
+    OBJCOPY=llvm-objcopy
+else
+    for prefix in riscv64-unknown-elf riscv32-unknown-elf riscv64-linux-gnu; do
+        if command -v $prefix-as >/dev/null; then
+            assemble() { $prefix-as -march=rv32i -mabi=ilp32 -mno-relax "$1" -o "$2"; }
+            OBJCOPY=$prefix-objcopy
+            break
+        fi
+    done
+fi
+if [ -z "$OBJCOPY" ]; then
+    echo "gen_hex.sh: needs llvm-mc and llvm-objcopy, or a RISC-V binutils" >&2
+    exit 2
+fi
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+for src in ${@:-input/*.S}; do
+    name=$(basename "$src" .S)
+    assemble "$src" "$tmp/$name.o"
+    $OBJCOPY -O binary -j .text "$tmp/$name.o" "$tmp/$name.bin"
+    od -An -v -tx4 -w4 "$tmp/$name.bin" | awk '{ print "0x" toupper($1) }' > "input/$name.input"
+    echo "$src -> input/$name.input ($(wc -l < "input/$name.input") words)"
+done
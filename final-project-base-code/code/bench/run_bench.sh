@@ -0,0 +1,102 @@
+#!/bin/bash
+# Run the guest benchmark kernels (input/*.input) on the pipeline and check
+# their cycles, CPI stack and cache stats against the baseline of the
+# configuration in ref/<config>.csv. Every run is also checked against the
+# emulator (--cosim), a kernel that computes the wrong result fails.
+#
+#   ./run_bench.sh [-u] [-c config] [-- simulator flags]
+#
+#   -c config  baseline name and its simulator flags, one of the CONFIGS
+#              below (default base); flags after -- replace those of the
+#              config, for trying a design change against its baseline
+#   -u         write the results as the new baseline
+#
+# Exits with 0 when every kernel matches its baseline, 1 when one differs
+# or fails and 2 on errors.
+cd "$(dirname "$0")"
+RISCV=../../riscv
+
+declare -A CONFIGS=(
+    [base]="-f"
+    [deep]="-f --depth 9 --split-mem --store-fwd"
+    [cache]="-f -c --mem-latency 100 --store-buffer 4"
+    [long]="-f --stages 2,3,3 --store-fwd"
+)
+# the CPI stack columns add up to the cycles, the MEM stalls are counted apart
+STATS=(cycles cpi.base cpi.load_use cpi.control cpi.dcache cpi.ifetch cpi.structural
+       mem_stalls L1.hits L1.misses L1.evictions)
+HEADER="kernel,cycles,instructions,load_use,control,dcache,ifetch,structural,mem_stalls,l1_hits,l1_misses,l1_evictions"
+
+config=base
+update=0
+while getopts "uc:" opt; do
+    case $opt in
+    u) update=1 ;;
+    c) config=$OPTARG ;;
+    *) exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ "$1" = "--" ] && shift
+flags=${CONFIGS[$config]}
+[ $# -gt 0 ] && flags="$*"
+if [ -z "$flags" ]; then
+    echo "run_bench.sh: no config $config, pass its flags after --" >&2
+    exit 2
+fi
+if [ ! -x $RISCV ]; then
+    echo "run_bench.sh: build the simulator first (make riscv)" >&2
+    exit 2
+fi
+
+baseline=ref/$config.csv
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+echo "$HEADER" > "$tmp/results.csv"
+
+status=0
+printf "%-14s %10s %10s %7s %8s %8s %8s %8s  %s\n" kernel cycles instrs CPI load-use control \
+       l1-hits l1-miss "vs $baseline"
+for input in input/*.input; do
+    kernel=$(basename "$input" .input)
+    if ! timeout 300 $RISCV -s -e $flags --cosim --trace none --stats none \
+            --stats-out "$tmp/$kernel.csv" "$input" > "$tmp/$kernel.out" 2>&1 ||
+       grep -q "COSIM\]: mismatch" "$tmp/$kernel.out"; then
+        printf "%-14s FAILED, see %s\n" "$kernel" "$RISCV -s -e $flags --cosim $input"
+        status=1
+        continue
+    fi
+    # the total row of the stats file, in the order of STATS (0 when a
+    # stat is not registered in this configuration)
+    row=$(awk -F, -v want="${STATS[*]}" '
+        NR == 1 { for (i = 1; i <= NF; i++) col[$i] = i }
+        $1 == "total" {
+            n = split(want, w, " ")
+            for (i = 1; i <= n; i++)
+                printf "%s%s", (i > 1) ? "," : "", (w[i] in col) ? $col[w[i]] : 0
+        }' "$tmp/$kernel.csv")
+    echo "$kernel,$row" >> "$tmp/results.csv"
+
+    IFS=, read -r cycles instrs load_use control dcache ifetch structural hits misses evictions <<< "$row"
+    ref=$(grep "^$kernel," "$baseline" 2>/dev/null)
+    if [ -z "$ref" ]; then
+        change="no baseline"
+    elif [ "$ref" = "$kernel,$row" ]; then
+        change="same"
+    else
+        ref_cycles=$(echo "$ref" | cut -d, -f2)
+        change=$(awk -v a="$cycles" -v b="$ref_cycles" 'BEGIN { printf "%+.2f%% cycles (was %d)", 100 * (a - b) / b, b }')
+        [ $update = 0 ] && status=1
+    fi
+    printf "%-14s %10d %10d %7.3f %8d %8d %8d %8d  %s\n" "$kernel" "$cycles" "$instrs" \
+           "$(awk -v c="$cycles" -v i="$instrs" 'BEGIN { print (i) ? c / i : 0 }')" \
+           "$load_use" "$control" "$hits" "$misses" "$change"
+done
+
+if [ $update = 1 ]; then
+    cp "$tmp/results.csv" "$baseline"
+    echo "wrote $baseline"
+elif [ $status != 0 ]; then
+    echo "results differ from $baseline; if that is intended, rerun with -u"
+fi
+exit $status
@@ -0,0 +1,163 @@
+//coherence.c
+#include <pthread.h>
+#include <stdio.h>
+#include "coherence.h"
+#include "hart.h"
+
+static struct {
+  pthread_mutex_t lock;
+  Cache*   caches[MAX_HARTS];
+  int      num_caches;
+  uint64_t transactions;
+  uint64_t busy_cycles;
+  uint64_t free_at;     // the cycle the last transaction is done
+} bus = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+void coh_attach(Cache* cache)
+{
+  pthread_mutex_lock(&bus.lock);
+  cache->coherent = true;
+  cache->hart = hart_id;
+  bus.caches[bus.num_caches++] = cache;
+  pthread_mutex_unlock(&bus.lock);
+}
+
+/**
+ * the line holding `address`, NULL when the cache has none, or with
+ * `stale` an invalid line that last held it
+ **/
+static Line* find_line(const Cache* cache, unsigned long address, bool stale)
+{
+  unsigned long long tag = cache_tag(address, cache);
+  Set* set = &cache->sets[cache_set(address, cache)];
+  for (int i = 0; i < cache->linesPerSet; i++) {
+    Line* line = &set->lines[i];
+    if (line->tag == tag && line->valid != stale)
+      return line;
+  }
+  return NULL;
+}
+
+/**
+ * every other cache snoops a transaction for `address`. Copies go Shared,
+ * or Invalid when `invalidate`. Returns whether one was Modified and
+ * supplied the block; `*shared` tells whether any copy was left.
+ **/
+static bool snoop(const Cache* requester, unsigned long address, bool invalidate,
+                  bool* shared)
+{
+  bool supplied = false;
+  *shared = false;
+  bus.transactions++;
+  for (int i = 0; i < bus.num_caches; i++) {
+    Cache* other = bus.caches[i];
+    Line* line = (other != requester) ? find_line(other, address, false) : NULL;
+    if (line == NULL)
+      continue;
+    if (line->mesi == MESI_M) {
+      // flushed to memory and to the requester
+      other->writebacks++;
+      supplied = true;
+    }
+    if (invalidate) {
+      line->valid = false;
+      line->mesi = MESI_I;
+      line->invalidated = true;
+      line->invalidated_offset = address & ((1UL << other->blockBits) - 1);
+      other->invalidations++;
+    } else {
+      line->mesi = MESI_S;
+    }
+    *shared = true;
+  }
+  return supplied;
+}
+
+/**
+ * a transaction reaching the bus at `now` holds it for `occupancy` cycles,
+ * once the ones before it are done. Returns the cycles it waited.
+ **/
+static int bus_occupy(uint64_t now, int occupancy)
+{
+  uint64_t start = (now > bus.free_at) ? now : bus.free_at;
+  bus.free_at = start + occupancy;
+  bus.busy_cycles += occupancy;
+  return start - now;
+}
+
+int coh_access(Cache* cache, unsigned long address, bool write, result* r, uint64_t now)
+{
+  if (!cache->coherent) {
+    *r = operateCache(address, cache);
+    return 0;
+  }
+
+  pthread_mutex_lock(&bus.lock);
+  int cycles = 0;
+  Line* line = find_line(cache, address, false);
+  if (line) {
+    // a hit, only a write to a Shared line needs the bus
+    *r = operateCache(address, cache);
+    if (write && line->mesi == MESI_S) {
+      bool shared;
+      snoop(cache, address, true, &shared);
+      cache->upgrades++;
+      cycles = bus_occupy(now, COH_BUS_LATENCY) + COH_BUS_LATENCY + COH_INVAL_LATENCY;
+    }
+    if (write)
+      line->mesi = MESI_M;
+  } else {
+    Line* stale = find_line(cache, address, true);
+    if (stale && stale->invalidated) {
+      int word = (address & ((1UL << cache->blockBits) - 1)) >> 2;
+      cache->coherence_misses++;
+      if (word != stale->invalidated_offset >> 2)
+        cache->false_sharing_misses++;
+    }
+    *r = operateCache(address, cache);
+    // a Modified victim is written back; the replaced line keeps its
+    // state until it is set below
+    line = find_line(cache, address, false);
+    int occupancy = COH_BUS_LATENCY;
+    if (r->status == CACHE_EVICT && line->mesi == MESI_M) {
+      cache->writebacks++;
+      bus.transactions++;
+      occupancy += COH_BUS_LATENCY;
+    }
+
+    bool shared;
+    bool supplied = snoop(cache, address, write, &shared);
+    if (supplied) {
+      cache->c2c_transfers++;
+      occupancy += COH_C2C_LATENCY;
+    }
+    cycles = bus_occupy(now, occupancy) + occupancy;
+    if (!supplied && write && shared)
+      cycles += COH_INVAL_LATENCY;
+    line->mesi = (write) ? MESI_M : (shared) ? MESI_S : MESI_E;
+  }
+  line->invalidated = false;
+  cache->coherence_cycles += cycles;
+  pthread_mutex_unlock(&bus.lock);
+  return cycles;
+}
+
+void coh_print_stats(uint64_t cycles)
+{
+  // the last transaction may end after every hart did
+  if (bus.free_at > cycles)
+    cycles = bus.free_at;
+  for (int h = 0; h < MAX_HARTS; h++) {
+    for (int i = 0; i < bus.num_caches; i++) {
+      const Cache* c = bus.caches[i];
+      if (c->hart != h)
+        continue;
+      printf("#Hart %-2d coherence  = %5d misses (%d false sharing), %d invalidations, "
+             "%d upgrades, %d cache-to-cache, %d writebacks, %lu cycles\n",
+             h, c->coherence_misses, c->false_sharing_misses, c->invalidations,
+             c->upgrades, c->c2c_transfers, c->writebacks, c->coherence_cycles);
+    }
+  }
+  printf("#Bus transactions   = %5lu, busy %lu cycles (%.1f%% of the cycles)\n", bus.transactions,
+         bus.busy_cycles, (cycles) ? 100.0 * bus.busy_cycles / cycles : 0.0);
+}
@@ -0,0 +1,65 @@
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "cache.h"
+
+/**
+ * MESI snooping coherence between the L1 caches of the harts (--harts N
+ * with -c). The caches sit on one shared bus, and a miss or a write to a
+ * line other caches may hold is a bus transaction all of them snoop:
+ *
+ *   BusRd    read miss. A Modified copy is flushed and supplied cache to
+ *            cache, every copy ends up Shared; with no other copy the line
+ *            comes from memory Exclusive.
+ *   BusRdX   write miss. The other copies are invalidated, a Modified one
+ *            supplied first; the line is Modified.
+ *   BusUpgr  write hit on a Shared line. The other copies are invalidated.
+ *
+ * A write hit on an Exclusive line goes Modified without the bus, and a
+ * Modified victim is written back. The cache model holds no data, memory
+ * does, so the protocol decides the states and what the accesses cost on
+ * top of the hit or miss: COH_BUS_LATENCY for a transaction, and
+ * COH_INVAL_LATENCY more when it invalidated copies or COH_C2C_LATENCY
+ * more for a cache-to-cache transfer. The bus is occupied COH_BUS_LATENCY
+ * cycles per transaction plus COH_C2C_LATENCY per transfer.
+ *
+ * The bus is one resource: a transaction holds it from the cycle it is
+ * free, and the requesting hart's MEM is held for the wait and the
+ * occupancy, its victim's writeback included (structural). A hart's time
+ * on the bus is its hart_clock().
+ *
+ * A miss on a line this cache lost to another hart's write is a coherence
+ * miss, and a false sharing miss when it is to another word of the block
+ * than the one written.
+ *
+ * The transactions are ordered as they reach the bus, under its lock; the
+ * harts run up to a quantum apart (hart.h), so only with --quantum 1 is
+ * that the order of their times.
+ **/
+
+#define COH_BUS_LATENCY    1
+#define COH_INVAL_LATENCY  4
+#define COH_C2C_LATENCY    8
+
+/**
+ * put `cache`, the L1 of the calling thread's hart, on the bus
+ **/
+void coh_attach(Cache* cache);
+
+/**
+ * access `address` in `cache` for a load, or for a store when `write`, at
+ * cycle `now` of the hart, with *r the hit, miss or eviction as
+ * operateCache() has it. Returns the coherence cycles the access costs on
+ * top, the wait for the bus included, 0 off the bus.
+ **/
+int coh_access(Cache* cache, unsigned long address, bool write, result* r, uint64_t now);
+
+/**
+ * the coherence counters of every cache on the bus and the bus occupancy
+ * over `cycles`, the time of the hart that ran longest
+ **/
+void coh_print_stats(uint64_t cycles);
+
+#endif // COHERENCE_H
@@ -2,6 +2,12 @@
 #define __CONFIG_H__
 
 // For each test, uncomment all its macros, and disable all other macros.
+// The macros only set the defaults: the same binary runs any of the tests
+// with the runtime options
+//   --trace cycle,regs,cache|none   DEBUG_CYCLE, DEBUG_REG_TRACE, PRINT_CACHE_TRACES
+//   --stats pipeline,cache|none     PRINT_STATS, PRINT_CACHE_STATS
+//   --mem-latency N                 MEM_LATENCY
+//   -c                              cache simulation
 
 // required for MS1 (test_simulator_ms1.sh)
 // #define DEBUG_REG_TRACE	// prints the register trace
@@ -24,8 +30,11 @@
 #define DEBUG_CYCLE
 #define PRINT_STATS
 #define MEM_LATENCY 100
-#define CACHE_ENABLE 		// enable cache simulation
 #define PRINT_CACHE_TRACES      // prints cache trace for each memory access 
 #define PRINT_CACHE_STATS	// prints the cache stats at the end of program
 
+#ifndef MEM_LATENCY
+#define MEM_LATENCY 0
+#endif
+
 #endif // __CONFIG_H__
@@ -0,0 +1,112 @@
+//cosim.c
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "riscv.h"
+#include "utils.h"
+#include "cosim.h"
+#include "trace.h"
+#include "stats.h"
+
+#define COSIM_NOP 0x00000013
+
+static regfile_t shadow;        // architectural state of the emulator
+static memory_t* shadow_mem;
+static uint64_t  retired;       // instructions checked so far
+
+void cosim_init(const regfile_t* regfile_p, const memory_t* memory_p)
+{
+  shadow = *regfile_p;
+  shadow_mem = mem_clone(memory_p);
+  retired = 0;
+  stats_add_u64("cosim.retired", "instructions checked against the emulator", &retired);
+}
+
+/**
+ * halt on a mismatch: print why, then the pipeline and emulator registers
+ * side by side with the differing ones marked
+ **/
+static void cosim_fail(const memwb_reg_t* memwb_p, const regfile_t* regfile_p,
+                       uint64_t cycle, const char* fmt, ...)
+{
+  va_list args;
+
+  // the trace up to this cycle comes out first
+  trace_close();
+  fflush(stdout);
+
+  fprintf(stderr, "\n[COSIM]: mismatch in cycle %lu after %lu retired instructions\n",
+          cycle, retired);
+  fprintf(stderr, "[COSIM]: ");
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+  fprintf(stderr, "\n[COSIM]: retiring [%08x]@[%08x], emulator PC %08x\n",
+          memwb_p->instr.bits, memwb_p->instr_addr, shadow.PC);
+  fprintf(stderr, "          pipeline  emulator\n");
+  for (int i = 0; i < 32; i++) {
+    fprintf(stderr, "[COSIM]: %c x%-2d %08x  %08x\n",
+            (regfile_p->R[i] != shadow.R[i]) ? '*' : ' ', i, regfile_p->R[i],
+            shadow.R[i]);
+  }
+  exit(1);
+}
+
+void cosim_retire(const memwb_reg_t* memwb_p, const regfile_t* regfile_p, uint64_t cycle)
+{
+  uint32_t bits = memwb_p->instr.bits;
+  uint32_t addr = memwb_p->instr_addr;
+
+  if (bits == 0)
+    return;       // nothing fetched into this slot
+  if (addr != shadow.PC) {
+    if (bits == COSIM_NOP)
+      return;     // stall bubble or squashed wrong-path instruction
+    cosim_fail(memwb_p, regfile_p, cycle, "retired out of program order");
+  }
+
+  // the pipeline fetches unloaded (zero) words as NOPs
+  uint32_t expected = mem_fetch(shadow_mem, shadow.PC);
+  if (expected == 0)
+    expected = COSIM_NOP;
+  if (bits != expected) {
+    if (bits == COSIM_NOP)
+      return;     // squashed copy, the real one retires later
+    cosim_fail(memwb_p, regfile_p, cycle, "expected instruction [%08x]", expected);
+  }
+
+  Instruction instr = parse_instruction(bits);
+
+  // a store is checked by what it wrote, memory itself may already hold
+  // the data of younger stores
+  if (instr.opcode == 0x23) {
+    Address address = shadow.R[instr.stype.rs1] + get_store_offset(instr);
+    Word mask = (instr.stype.funct3 == 0x0) ? 0xFF :
+                (instr.stype.funct3 == 0x1) ? 0xFFFF : 0xFFFFFFFF;
+    Word data = shadow.R[instr.stype.rs2] & mask;
+    if (memwb_p->ALU_result != address || (memwb_p->Write_Data & mask) != data)
+      cosim_fail(memwb_p, regfile_p, cycle,
+                 "store wrote %08x to %08x, expected %08x to %08x",
+                 memwb_p->Write_Data & mask, memwb_p->ALU_result, data, address);
+  }
+
+  // the pipeline has no system calls, it only stops on an ecall with a0 == 10;
+  // counters read through a CSR depend on the timing, take the pipeline's
+  if (instr.opcode == 0x73) {
+    if (instr.itype.funct3 != 0)
+      shadow.R[instr.itype.rd] = regfile_p->R[instr.itype.rd];
+    shadow.PC += 4;
+  } else
+    execute_instruction(bits, &shadow, shadow_mem);
+  shadow.R[0] = 0;
+  retired++;
+
+  if (memcmp(shadow.R, regfile_p->R, sizeof(shadow.R)) != 0)
+    cosim_fail(memwb_p, regfile_p, cycle, "register file differs");
+}
+
+void cosim_print_stats(void)
+{
+  printf("#Cosim retired     = %5ld\n", retired);
+}
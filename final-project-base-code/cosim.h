@@ -0,0 +1,18 @@
+#ifndef COSIM_H
+#define COSIM_H
+
+#include <stdint.h>
+#include "types.h"
+#include "pipeline.h"
+
+/**
+ * Lockstep co-simulation (--cosim). Every instruction that retires in WB is
+ * replayed by the functional emulator (execute_instruction) on a shadow
+ * register file and memory, and the architectural state is compared right
+ * away. The first difference halts the simulator with a dump of both.
+ **/
+void cosim_init(const regfile_t* regfile_p, const memory_t* memory_p);
+void cosim_retire(const memwb_reg_t* memwb_p, const regfile_t* regfile_p, uint64_t cycle);
+void cosim_print_stats(void);
+
+#endif // COSIM_H
@@ -0,0 +1,74 @@
+//cpi_stack.c
+#include <stdio.h>
+#include "cpi_stack.h"
+#include "stats.h"
+
+HART_LOCAL uint64_t cpi_cycles[CPI_NUM_CAUSES];
+
+static const char* const cpi_names[CPI_NUM_CAUSES] = {
+  [CPI_BASE]       = "base",
+  [CPI_LOAD_USE]   = "load-use",
+  [CPI_CONTROL]    = "control",
+  [CPI_DCACHE]     = "dcache",
+  [CPI_IFETCH]     = "ifetch",
+  [CPI_STRUCTURAL] = "structural",
+};
+
+static uint64_t cpi_total(void)
+{
+  uint64_t total = 0;
+  for (int i = 0; i < CPI_NUM_CAUSES; i++)
+    total += cpi_cycles[i];
+  return total;
+}
+
+/**
+ * cycles per retired instruction spent on `cycles`
+ **/
+static double cpi_of(uint64_t cycles)
+{
+  return (cpi_cycles[CPI_BASE]) ? (double)cycles / cpi_cycles[CPI_BASE] : 0.0;
+}
+
+void cpi_print_stack(void)
+{
+  uint64_t total = cpi_total();
+  printf("#CPI               = %8.3f (%lu cycles, %lu instructions)\n",
+         cpi_of(total), total, cpi_cycles[CPI_BASE]);
+  for (int i = 0; i < CPI_NUM_CAUSES; i++) {
+    printf("#CPI %-13s = %8.3f (%lu cycles, %.1f%%)\n", cpi_names[i],
+           cpi_of(cpi_cycles[i]), cpi_cycles[i],
+           (total) ? 100.0 * cpi_cycles[i] / total : 0.0);
+  }
+  printf("#CPI %-13s = %8.3f (%lu cycles, not in #Cycles)\n", "+ MEM stalls",
+         cpi_of(mem_stall_cycles()), mem_stall_cycles());
+}
+
+int cpi_write_csv(const char* path)
+{
+  FILE* file = fopen(path, "w");
+  if (file == NULL)
+    return -1;
+  uint64_t total = cpi_total();
+  fprintf(file, "category,cycles,cpi,fraction\n");
+  for (int i = 0; i < CPI_NUM_CAUSES; i++) {
+    fprintf(file, "%s,%lu,%.6f,%.6f\n", cpi_names[i], cpi_cycles[i],
+            cpi_of(cpi_cycles[i]), (total) ? (double)cpi_cycles[i] / total : 0.0);
+  }
+  fprintf(file, "total,%lu,%.6f,1\n", total, cpi_of(total));
+  // counted apart, not a share of the total
+  fprintf(file, "mem_stalls,%lu,%.6f,\n", mem_stall_cycles(), cpi_of(mem_stall_cycles()));
+  return fclose(file);
+}
+
+void cpi_register_stats(void)
+{
+  for (int i = 0; i < CPI_NUM_CAUSES; i++) {
+    char stat[32];
+    snprintf(stat, sizeof(stat), "cpi.%s", cpi_names[i]);
+    for (char* p = stat; *p; p++)
+      if (*p == '-')
+        *p = '_';
+    stats_add_u64(stat, "cycles charged to this CPI stack category", &cpi_cycles[i]);
+  }
+}
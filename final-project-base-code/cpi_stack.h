@@ -0,0 +1,31 @@
+#ifndef CPI_STACK_H
+#define CPI_STACK_H
+
+#include <stdint.h>
+#include "riscv.h"
+#include "pipeline.h"
+
+/**
+ * CPI stack: every simulated cycle is charged to exactly one cpi_cause_t,
+ * decided by what reaches WB. An instruction retiring is a base cycle,
+ * a bubble counts for the reason it was inserted, and a slot that never
+ * held an instruction is fetch time.
+ *
+ * MEM holds the pipeline for misaligned penalties and atomics, bubbles
+ * charged to dcache, and for the store buffer and the coherence bus,
+ * charged to structural. The categories add up to #Cycles. The latency of
+ * the cache or memory beyond one cycle is only counted ("#MEM stalls"),
+ * MEM does not wait for it, and is printed apart from the stack.
+ **/
+extern HART_LOCAL uint64_t cpi_cycles[CPI_NUM_CAUSES];
+
+static inline void cpi_cycle(const memwb_reg_t* wb)
+{
+  cpi_cycles[(wb->instr.bits == 0) ? CPI_IFETCH : wb->bubble]++;
+}
+
+void cpi_print_stack(void);
+int  cpi_write_csv(const char* path);
+void cpi_register_stats(void);
+
+#endif // CPI_STACK_H
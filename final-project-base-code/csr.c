@@ -0,0 +1,120 @@
+//csr.c
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "riscv.h"
+#include "utils.h"
+#include "csr.h"
+
+// counter index within a block of counter CSRs: cycle, time, instret, hpm3..
+#define CNT_CYCLE    0
+#define CNT_TIME     1
+#define CNT_INSTRET  2
+#define CNT_HPM3     3
+#define CNT_LAST     (CNT_HPM3 + CSR_NUM_HPM - 1)
+
+// writing mcycle, minstret or an mhpmcounter moves it by an offset from
+// the simulator counter it follows. Every hart has its own.
+static HART_LOCAL uint64_t cycle_offset;
+static HART_LOCAL uint64_t instret_offset;
+static HART_LOCAL uint64_t hpm_offset[CSR_NUM_HPM];
+static HART_LOCAL uint8_t  hpm_event[CSR_NUM_HPM] = {
+  HPM_CACHE_MISSES, HPM_LOAD_USE_STALLS, HPM_BRANCHES_TAKEN, HPM_FORWARDS
+};
+
+static uint64_t* counter_offset(unsigned cnt)
+{
+  switch (cnt) {
+  case CNT_CYCLE:   return &cycle_offset;
+  case CNT_INSTRET: return &instret_offset;
+  default:          return &hpm_offset[cnt - CNT_HPM3];
+  }
+}
+
+/**
+ * the simulator counter behind counter `cnt`, before its offset
+ **/
+static uint64_t counter_raw(unsigned cnt, const csr_counters_t* now)
+{
+  switch (cnt) {
+  case CNT_CYCLE:
+  case CNT_TIME:    return now->cycle;
+  case CNT_INSTRET: return now->instret;
+  default:          return now->events[hpm_event[cnt - CNT_HPM3]];
+  }
+}
+
+static uint64_t counter_read(unsigned cnt, const csr_counters_t* now)
+{
+  if (cnt == CNT_TIME)
+    return now->cycle;
+  return counter_raw(cnt, now) + *counter_offset(cnt);
+}
+
+static void counter_write(unsigned cnt, bool high, Word value, const csr_counters_t* now)
+{
+  uint64_t old = counter_read(cnt, now);
+  uint64_t new = (high) ? ((uint64_t)value << 32) | (old & 0xFFFFFFFFULL)
+                        : (old & ~0xFFFFFFFFULL) | value;
+  *counter_offset(cnt) = new - counter_raw(cnt, now);
+}
+
+static void csr_invalid(Instruction instruction)
+{
+  handle_invalid_instruction(instruction);
+  exit(-1);
+}
+
+Word csr_execute(Instruction instruction, Word rs1_value, const csr_counters_t* now)
+{
+  unsigned csr    = instruction.itype.imm;
+  unsigned funct3 = instruction.itype.funct3;
+  // the immediate forms take the rs1 field as a 5-bit zero-extended value
+  Word src = (funct3 & 0x4) ? instruction.itype.rs1 : rs1_value;
+  // csrrs/csrrc with x0 (or a zero immediate) only read
+  bool write = ((funct3 & 0x3) == 0x1) || instruction.itype.rs1 != 0;
+
+  unsigned cnt = csr & 0x1F;
+  bool high = csr & CSR_HIGH;
+  Word old;
+
+  if (csr == CSR_MHARTID) {
+    if (write)
+      csr_invalid(instruction);
+    return now->hartid;
+  } else if ((csr & ~(CSR_HIGH | 0x1F)) == CSR_CYCLE && cnt <= CNT_LAST) {
+    // user counters are read-only
+    if (write)
+      csr_invalid(instruction);
+    uint64_t v = counter_read(cnt, now);
+    return (high) ? (Word)(v >> 32) : (Word)v;
+  } else if ((csr & ~(CSR_HIGH | 0x1F)) == CSR_MCYCLE && cnt <= CNT_LAST && cnt != CNT_TIME) {
+    uint64_t v = counter_read(cnt, now);
+    old = (high) ? (Word)(v >> 32) : (Word)v;
+  } else if (csr >= CSR_MHPMEVENT3 && csr < CSR_MHPMEVENT3 + CSR_NUM_HPM) {
+    old = hpm_event[csr - CSR_MHPMEVENT3];
+  } else {
+    csr_invalid(instruction);
+    return 0;
+  }
+
+  if (!write)
+    return old;
+  Word new;
+  switch (funct3 & 0x3) {
+  case 0x1: new = src; break;           // csrrw
+  case 0x2: new = old | src; break;     // csrrs
+  default:  new = old & ~src; break;    // csrrc
+  }
+
+  if (csr >= CSR_MHPMEVENT3 && csr < CSR_MHPMEVENT3 + CSR_NUM_HPM) {
+    // switching events keeps the counter value, it counts on from there
+    unsigned hpm = csr - CSR_MHPMEVENT3;
+    uint64_t v = counter_read(CNT_HPM3 + hpm, now);
+    hpm_event[hpm] = (new < HPM_NUM_EVENTS) ? new : HPM_NONE;
+    hpm_offset[hpm] = v - counter_raw(CNT_HPM3 + hpm, now);
+  } else {
+    counter_write(cnt, high, new, now);
+  }
+  return old;
+}
@@ -0,0 +1,54 @@
+#ifndef CSR_H
+#define CSR_H
+
+#include <stdint.h>
+#include "types.h"
+
+// counter CSRs (Zicsr, Zicntr, Zihpm); on RV32 the upper halves are 0x80 up
+#define CSR_CYCLE         0xC00
+#define CSR_TIME          0xC01
+#define CSR_INSTRET       0xC02
+#define CSR_HPMCOUNTER3   0xC03
+#define CSR_MCYCLE        0xB00
+#define CSR_MINSTRET      0xB02
+#define CSR_MHPMCOUNTER3  0xB03
+#define CSR_MHPMEVENT3    0x323
+#define CSR_MHARTID       0xF14
+#define CSR_HIGH          0x80
+
+#define CSR_NUM_HPM       4     // hpmcounter3..hpmcounter6
+
+/**
+ * simulator events an hpmcounter counts, selected by writing the event
+ * number to its mhpmevent. Counters 3..6 start out counting events 1..4.
+ **/
+typedef enum {
+  HPM_NONE,
+  HPM_CACHE_MISSES,
+  HPM_LOAD_USE_STALLS,
+  HPM_BRANCHES_TAKEN,
+  HPM_FORWARDS,
+  HPM_NUM_EVENTS
+} hpm_event_t;
+
+/**
+ * the counters as the machine running the program sees them right now. The
+ * emulator counts one cycle per instruction and no events; time ticks once
+ * per cycle. mhartid reads `hartid`, 0 in the emulator.
+ **/
+typedef struct {
+  uint64_t cycle;
+  uint64_t instret;
+  uint64_t events[HPM_NUM_EVENTS];
+  Word     hartid;
+} csr_counters_t;
+
+/**
+ * csrrw, csrrs, csrrc and their immediate forms: read the CSR, write it
+ * from `rs1_value` (or the zimm field), return the old value for rd.
+ * An unknown CSR, or a write to a read-only one, is an invalid instruction.
+ * Every hart keeps its own counter offsets and event selection.
+ **/
+Word csr_execute(Instruction instruction, Word rs1_value, const csr_counters_t* now);
+
+#endif // CSR_H
@@ -2,6 +2,7 @@
 #include <stdlib.h> // for exit()
 #include "types.h"
 #include "utils.h"
+#include "atomic.h"
 
 void print_rtype(char *, Instruction);
 void print_itype_except_load(char *, Instruction, int);
@@ -10,12 +11,21 @@ void print_store(char *, Instruction);
 void print_branch(char *, Instruction);
 void print_lui(Instruction);
 void print_jal(Instruction);
+void print_jalr(Instruction);
+void print_auipc(Instruction);
 void print_ecall(Instruction);
+void print_csr(Instruction);
+void print_amo(Instruction);
 void write_rtype(Instruction);
 void write_itype_except_load(Instruction); 
 void write_load(Instruction);
 void write_store(Instruction);
 void write_branch(Instruction);
+void invalid_instruction(Instruction);
+
+// where the disassembly goes, stdout unless disasm_string() redirects it
+static FILE* disasm_out = NULL;
+#define DISASM_OUT (disasm_out ? disasm_out : stdout)
 
 
 void decode_instruction(uint32_t instruction_bits) {
@@ -24,7 +34,7 @@ void decode_instruction(uint32_t instruction_bits) {
     // `parse_instruction` will fail.
     if(instruction_bits == 0)
     {
-        printf("\n");
+        fprintf(DISASM_OUT, "\n");
         return;
     }
     Instruction instruction = parse_instruction(instruction_bits);
@@ -50,11 +60,23 @@ void decode_instruction(uint32_t instruction_bits) {
         case 0x6F:
             print_jal(instruction);
             break;
+        case 0x67:
+            print_jalr(instruction);
+            break;
+        case 0x17:
+            print_auipc(instruction);
+            break;
         case 0x73:
-            print_ecall(instruction);
+            if (instruction.itype.funct3 == 0)
+                print_ecall(instruction);
+            else
+                print_csr(instruction);
+            break;
+        case 0x2F:
+            print_amo(instruction);
             break;
         default: // undefined opcode
-            handle_invalid_instruction(instruction);
+            invalid_instruction(instruction);
             break;
     }
 }
@@ -75,7 +97,7 @@ void write_rtype(Instruction instruction) {
                     print_rtype("sub", instruction);
                     break;
                 default:
-                    handle_invalid_instruction(instruction);
+                    invalid_instruction(instruction);
                 break;      
             }
             break;
@@ -89,7 +111,7 @@ void write_rtype(Instruction instruction) {
                     print_rtype("mulh", instruction);
                 break;
                 default:
-                    handle_invalid_instruction(instruction);
+                    invalid_instruction(instruction);
                 break; 
              }
              break; 
@@ -98,7 +120,7 @@ void write_rtype(Instruction instruction) {
             if (instruction.rtype.funct7 == 0x00)
                 print_rtype("slt", instruction);
             else   
-                handle_invalid_instruction(instruction); 
+                invalid_instruction(instruction); 
             break; 
 
         case 0x4: 
@@ -110,7 +132,7 @@ void write_rtype(Instruction instruction) {
                     print_rtype("div", instruction);
                 break;
                 default:
-                    handle_invalid_instruction(instruction);
+                    invalid_instruction(instruction);
                 break; 
              }
              break; 
@@ -124,7 +146,7 @@ void write_rtype(Instruction instruction) {
                     print_rtype("sra", instruction);
                 break;
                 default:
-                    handle_invalid_instruction(instruction);
+                    invalid_instruction(instruction);
                 break; 
             }
             break; 
@@ -138,7 +160,7 @@ void write_rtype(Instruction instruction) {
                     print_rtype("rem", instruction);
                 break;
                 default:
-                    handle_invalid_instruction(instruction);
+                    invalid_instruction(instruction);
                 break; }
                 break; 
         
@@ -146,10 +168,10 @@ void write_rtype(Instruction instruction) {
          if (instruction.rtype.funct7 == 0x00)
                 print_rtype("and", instruction);
             else   
-                handle_invalid_instruction(instruction); 
+                invalid_instruction(instruction); 
         /* call print_rtype */
         default:
-            handle_invalid_instruction(instruction);
+            invalid_instruction(instruction);
         break;
     }
 }
@@ -165,7 +187,7 @@ void write_itype_except_load(Instruction instruction) {
             if ((instruction.itype.imm >> 5 )== 0x00)
                 print_itype_except_load("slli", instruction, instruction.itype.imm & 0x1F);
             else   
-                handle_invalid_instruction(instruction); 
+                invalid_instruction(instruction); 
         break;
 
         case 0x2:
@@ -182,7 +204,7 @@ void write_itype_except_load(Instruction instruction) {
             else if ((instruction.itype.imm >> 5) == 0x20)
                 print_itype_except_load("srai", instruction, instruction.itype.imm & 0x1F);
             else
-                handle_invalid_instruction(instruction);
+                invalid_instruction(instruction);
             break; 
 
         case 0x6:
@@ -194,7 +216,7 @@ void write_itype_except_load(Instruction instruction) {
         break;
 
         default:
-            handle_invalid_instruction(instruction);
+            invalid_instruction(instruction);
             break;  
     }
 }
@@ -211,9 +233,10 @@ void write_load(Instruction instruction) {
 
         case 0x2:
             print_load("lw", instruction);
+        break;
 
         default:
-            handle_invalid_instruction(instruction);
+            invalid_instruction(instruction);
             break;
     }
 }
@@ -233,7 +256,7 @@ void write_store(Instruction instruction) {
         break;
 
         default:
-            handle_invalid_instruction(instruction);
+            invalid_instruction(instruction);
             break;
     }
 }
@@ -248,46 +271,133 @@ void write_branch(Instruction instruction) {
              print_branch("bne", instruction);
         break;
 
+        case 0x4:
+             print_branch("blt", instruction);
+        break;
+
+        case 0x5:
+             print_branch("bge", instruction);
+        break;
+
+        case 0x6:
+             print_branch("bltu", instruction);
+        break;
+
+        case 0x7:
+             print_branch("bgeu", instruction);
+        break;
+
         default:
-            handle_invalid_instruction(instruction);
+            invalid_instruction(instruction);
             break;
     }
 }
 
+/**
+ * disassembly of `instruction_bits` as one line of text in `buf`, with
+ * spaces for tabs and no newline; an unknown encoding gives ".word"
+ **/
+void disasm_string(uint32_t instruction_bits, char* buf, size_t size) {
+    buf[0] = '\0';
+    FILE* out = fmemopen(buf, size, "w");
+    if (out == NULL)
+        return;
+    disasm_out = out;
+    decode_instruction(instruction_bits);
+    disasm_out = NULL;
+    fclose(out);
+    buf[size - 1] = '\0';
+    for (char* p = buf; *p; p++) {
+        if (*p == '\t')
+            *p = ' ';
+        else if (*p == '\n')
+            *p = '\0';
+    }
+}
+
+void invalid_instruction(Instruction instruction) {
+    if (disasm_out)
+        fprintf(disasm_out, ".word\t0x%08x\n", instruction.bits);
+    else
+        handle_invalid_instruction(instruction);
+}
+
 void print_rtype(char *name, Instruction instruction) {
-  printf(RTYPE_FORMAT, name, instruction.rtype.rd, instruction.rtype.rs1,
+  fprintf(DISASM_OUT, RTYPE_FORMAT, name, instruction.rtype.rd, instruction.rtype.rs1,
          instruction.rtype.rs2);
 }
 
 void print_itype_except_load(char *name, Instruction instruction, int imm) {
-    printf(ITYPE_FORMAT, name, instruction.itype.rd, instruction.itype.rs1, imm); 
+    fprintf(DISASM_OUT, ITYPE_FORMAT, name, instruction.itype.rd, instruction.itype.rs1, imm); 
 }
 
 void print_load(char *name, Instruction instruction) {
     int imm = sign_extend_number(instruction.itype.imm, 12);
-    printf(MEM_FORMAT, name, instruction.itype.rd, imm, instruction.itype.rs1);
+    fprintf(DISASM_OUT, MEM_FORMAT, name, instruction.itype.rd, imm, instruction.itype.rs1);
 }
 
 void print_store(char *name, Instruction instruction) {
     int imm = get_store_offset(instruction);
-    printf(MEM_FORMAT, name, instruction.stype.rs2, imm, instruction.stype.rs1);
+    fprintf(DISASM_OUT, MEM_FORMAT, name, instruction.stype.rs2, imm, instruction.stype.rs1);
 }
 
 void print_branch(char *name, Instruction instruction) {
     int offset = get_branch_offset(instruction);
-    printf(BRANCH_FORMAT, name, instruction.sbtype.rs1, instruction.sbtype.rs2, offset);
+    fprintf(DISASM_OUT, BRANCH_FORMAT, name, instruction.sbtype.rs1, instruction.sbtype.rs2, offset);
 }
 
 void print_lui(Instruction instruction) {
     int imm = sign_extend_number(instruction.utype.imm, 20) << 12; 
-    printf(LUI_FORMAT, instruction.utype.rd, imm);
+    fprintf(DISASM_OUT, LUI_FORMAT, instruction.utype.rd, imm);
 }
 
 void print_jal(Instruction instruction) {
     int offset = get_jump_offset(instruction);
-    printf(JAL_FORMAT, instruction.ujtype.rd, offset);
+    fprintf(DISASM_OUT, JAL_FORMAT, instruction.ujtype.rd, offset);
+}
+
+void print_jalr(Instruction instruction) {
+    int imm = sign_extend_number(instruction.itype.imm, 12);
+    fprintf(DISASM_OUT, JALR_FORMAT, instruction.itype.rd, instruction.itype.rs1, imm);
+}
+
+void print_auipc(Instruction instruction) {
+    int imm = sign_extend_number(instruction.utype.imm, 20) << 12;
+    fprintf(DISASM_OUT, AUIPC_FORMAT, instruction.utype.rd, imm);
 }
 
 void print_ecall(Instruction instruction) {
-    printf(ECALL_FORMAT);
-}
\ No newline at end of file
+    fprintf(DISASM_OUT, ECALL_FORMAT);
+}
+
+void print_csr(Instruction instruction) {
+    static char *names[8] = {NULL, "csrrw", "csrrs", "csrrc", NULL, "csrrwi", "csrrsi", "csrrci"};
+    char *name = names[instruction.itype.funct3];
+    if (name == NULL)
+        invalid_instruction(instruction);
+    else if (instruction.itype.funct3 & 0x4)
+        fprintf(DISASM_OUT, CSRI_FORMAT, name, instruction.itype.rd, instruction.itype.imm, instruction.itype.rs1);
+    else
+        fprintf(DISASM_OUT, CSR_FORMAT, name, instruction.itype.rd, instruction.itype.imm, instruction.itype.rs1);
+}
+
+void print_amo(Instruction instruction) {
+    static char *names[32] = {
+        [AMO_ADD] = "amoadd.w", [AMO_SWAP] = "amoswap.w", [AMO_LR] = "lr.w",
+        [AMO_SC] = "sc.w", [AMO_XOR] = "amoxor.w", [AMO_OR] = "amoor.w",
+        [AMO_AND] = "amoand.w", [AMO_MIN] = "amomin.w", [AMO_MAX] = "amomax.w",
+        [AMO_MINU] = "amominu.w", [AMO_MAXU] = "amomaxu.w"};
+    static char *order[4] = {"", ".rl", ".aq", ".aqrl"};
+    char name[16];
+    if (!amo_valid(instruction)) {
+        invalid_instruction(instruction);
+        return;
+    }
+    snprintf(name, sizeof(name), "%s%s", names[instruction.rtype.funct7 >> 2],
+             order[instruction.rtype.funct7 & 0x3]);
+    if ((instruction.rtype.funct7 >> 2) == AMO_LR)
+        fprintf(DISASM_OUT, LR_FORMAT, name, instruction.rtype.rd, instruction.rtype.rs1);
+    else
+        fprintf(DISASM_OUT, AMO_FORMAT, name, instruction.rtype.rd, instruction.rtype.rs2,
+                instruction.rtype.rs1);
+}
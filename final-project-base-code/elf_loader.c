@@ -0,0 +1,214 @@
+//elf_loader.c
+#include <elf.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "riscv.h"
+#include "elf_loader.h"
+
+static elf_symbol_t* symbols;
+static size_t        num_symbols;
+
+bool is_elf_file(const char* filename)
+{
+  unsigned char magic[SELFMAG];
+  FILE* file = fopen(filename, "rb");
+  if (file == NULL)
+    return false;
+  bool elf = fread(magic, 1, SELFMAG, file) == SELFMAG &&
+             memcmp(magic, ELFMAG, SELFMAG) == 0;
+  fclose(file);
+  return elf;
+}
+
+static int bad_elf(const char* filename, const char* why)
+{
+  fprintf(stderr, "%s: %s\n", filename, why);
+  return -1;
+}
+
+/**
+ * true when `len` bytes at `off` lie inside an image of `size` bytes
+ **/
+static bool in_image(uint64_t off, uint64_t len, uint64_t size)
+{
+  return off <= size && len <= size - off;
+}
+
+static int cmp_symbol(const void* a, const void* b)
+{
+  const elf_symbol_t* x = a;
+  const elf_symbol_t* y = b;
+  return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+/**
+ * keep the function, object and label symbols of SHT_SYMTAB sorted by address
+ **/
+static void read_symbols(const uint8_t* image, size_t size, const Elf32_Ehdr* eh)
+{
+  if (eh->e_shentsize != sizeof(Elf32_Shdr) ||
+      !in_image(eh->e_shoff, (uint64_t)eh->e_shnum * sizeof(Elf32_Shdr), size))
+    return;
+
+  for (int i = 0; i < eh->e_shnum; i++) {
+    Elf32_Shdr sh, strtab;
+    memcpy(&sh, image + eh->e_shoff + i * sizeof(sh), sizeof(sh));
+    if (sh.sh_type != SHT_SYMTAB || sh.sh_entsize != sizeof(Elf32_Sym) ||
+        sh.sh_link >= eh->e_shnum || !in_image(sh.sh_offset, sh.sh_size, size))
+      continue;
+    memcpy(&strtab, image + eh->e_shoff + sh.sh_link * sizeof(strtab), sizeof(strtab));
+    if (!in_image(strtab.sh_offset, strtab.sh_size, size))
+      continue;
+
+    size_t count = sh.sh_size / sizeof(Elf32_Sym);
+    symbols = realloc(symbols, (num_symbols + count) * sizeof(elf_symbol_t));
+    for (size_t s = 0; s < count; s++) {
+      Elf32_Sym sym;
+      memcpy(&sym, image + sh.sh_offset + s * sizeof(sym), sizeof(sym));
+      int type = ELF32_ST_TYPE(sym.st_info);
+      if (sym.st_name == 0 || sym.st_name >= strtab.sh_size ||
+          sym.st_shndx == SHN_UNDEF ||
+          (type != STT_FUNC && type != STT_OBJECT && type != STT_NOTYPE))
+        continue;
+      const char* name = (const char*)image + strtab.sh_offset + sym.st_name;
+      size_t len = strnlen(name, strtab.sh_size - sym.st_name);
+      // skip the assembler's local labels and absolute constants, but the
+      // linker may define the global pointer as absolute
+      if (len == 0 || name[0] == '.' || name[0] == '$' ||
+          (sym.st_shndx == SHN_ABS && strcmp(name, "__global_pointer$") != 0))
+        continue;
+      symbols[num_symbols].addr = sym.st_value;
+      symbols[num_symbols].size = sym.st_size;
+      symbols[num_symbols].name = strndup(name, len);
+      num_symbols++;
+    }
+  }
+  if (num_symbols)
+    qsort(symbols, num_symbols, sizeof(elf_symbol_t), cmp_symbol);
+}
+
+/**
+ * copy the PT_LOAD segments of an ELF32 RISC-V executable into guest
+ * memory, returns the number of instruction words in executable segments
+ * (or -1 if the file cannot be loaded) and sets the entry point
+ **/
+int load_elf(memory_t* mem, const char* filename, Address* entry_p, int disasm)
+{
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror(filename);
+    return -1;
+  }
+  size_t size = st.st_size;
+  if (size < sizeof(Elf32_Ehdr)) {
+    close(fd);
+    return bad_elf(filename, "truncated ELF header");
+  }
+  const uint8_t* image = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    perror(filename);
+    return -1;
+  }
+
+  Elf32_Ehdr eh;
+  memcpy(&eh, image, sizeof(eh));
+  int ret = -1;
+  if (eh.e_ident[EI_CLASS] != ELFCLASS32 || eh.e_ident[EI_DATA] != ELFDATA2LSB)
+    ret = bad_elf(filename, "not a little-endian ELF32 file");
+  else if (eh.e_machine != EM_RISCV)
+    ret = bad_elf(filename, "not a RISC-V executable");
+  else if (eh.e_type != ET_EXEC)
+    ret = bad_elf(filename, "not a statically linked executable");
+  else if (eh.e_phentsize != sizeof(Elf32_Phdr) ||
+           !in_image(eh.e_phoff, (uint64_t)eh.e_phnum * sizeof(Elf32_Phdr), size))
+    ret = bad_elf(filename, "bad program header table");
+  else
+    ret = 0;
+  if (ret != 0) {
+    munmap((void*)image, size);
+    return -1;
+  }
+
+  read_symbols(image, size, &eh);
+
+  int numins = 0;
+  for (int i = 0; i < eh.e_phnum; i++) {
+    Elf32_Phdr ph;
+    memcpy(&ph, image + eh.e_phoff + i * sizeof(ph), sizeof(ph));
+    if (ph.p_type != PT_LOAD || ph.p_memsz == 0)
+      continue;
+    if (ph.p_filesz > ph.p_memsz || !in_image(ph.p_offset, ph.p_filesz, size)) {
+      munmap((void*)image, size);
+      return bad_elf(filename, "bad PT_LOAD segment");
+    }
+    if (!mem_in_range(mem, ph.p_vaddr, ph.p_memsz)) {
+      fprintf(stderr, "%s: segment at 0x%08x-0x%08x is outside guest memory\n",
+              filename, ph.p_vaddr, ph.p_vaddr + ph.p_memsz);
+      munmap((void*)image, size);
+      return -1;
+    }
+    // file contents; the rest (.bss) is left to guest memory, which reads
+    // as zero until written, so it takes no pages
+    mem_write(mem, ph.p_vaddr, image + ph.p_offset, ph.p_filesz);
+
+    if (!(ph.p_flags & PF_X))
+      continue;
+    numins += ph.p_filesz / 4;
+    if (disasm) {
+      for (Address addr = ph.p_vaddr; addr + 4 <= ph.p_vaddr + ph.p_filesz; addr += 4) {
+        uint32_t offset;
+        const char* name = elf_symbol_at(addr, &offset);
+        if (name && offset == 0)
+          printf("\n%08x <%s>:\n", addr, name);
+        printf("%08x: ", addr);
+        decode_instruction(load(mem, addr, LENGTH_WORD));
+      }
+    }
+  }
+  munmap((void*)image, size);
+
+  *entry_p = eh.e_entry;
+  return numins;
+}
+
+/**
+ * name of the symbol `addr` lies in and the offset from its start, NULL
+ * when no symbol covers it
+ **/
+const char* elf_symbol_at(Address addr, uint32_t* offset_p)
+{
+  size_t lo = 0, hi = num_symbols;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (symbols[mid].addr <= addr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0)
+    return NULL;
+  const elf_symbol_t* sym = &symbols[lo - 1];
+  if (sym->size && addr - sym->addr >= sym->size)
+    return NULL;
+  if (offset_p)
+    *offset_p = addr - sym->addr;
+  return sym->name;
+}
+
+bool elf_symbol_addr(const char* name, Address* addr_p)
+{
+  for (size_t i = 0; i < num_symbols; i++) {
+    if (strcmp(symbols[i].name, name) == 0) {
+      *addr_p = symbols[i].addr;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,30 @@
+#ifndef ELF_LOADER_H
+#define ELF_LOADER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"
+#include "guest_mem.h"
+
+/**
+ * symbol of the loaded program, kept for reports (disassembly, profiles)
+ **/
+typedef struct {
+  Address  addr;
+  uint32_t size;
+  char*    name;
+} elf_symbol_t;
+
+/**
+ * ELF32 RISC-V loader. Every PT_LOAD segment is copied to its virtual
+ * address in guest memory and the part beyond the file data (.bss) is
+ * zeroed. The symbol table stays available after loading.
+ **/
+bool is_elf_file(const char* filename);
+int  load_elf(memory_t* mem, const char* filename, Address* entry_p, int disasm);
+
+const char* elf_symbol_at(Address addr, uint32_t* offset_p);
+bool        elf_symbol_addr(const char* name, Address* addr_p);
+
+#endif // ELF_LOADER_H
@@ -3,17 +3,26 @@
 #include "types.h"
 #include "utils.h"
 #include "riscv.h"
+#include "csr.h"
+#include "atomic.h"
 
 void execute_rtype(Instruction, Processor *);
 void execute_itype_except_load(Instruction, Processor *);
 void execute_branch(Instruction, Processor *);
 void execute_jal(Instruction, Processor *);
-void execute_load(Instruction, Processor *, Byte *);
-void execute_store(Instruction, Processor *, Byte *);
-void execute_ecall(Processor *, Byte *);
+void execute_load(Instruction, Processor *, memory_t *);
+void execute_store(Instruction, Processor *, memory_t *);
+void execute_ecall(Processor *, memory_t *);
+void execute_csr(Instruction, Processor *);
 void execute_lui(Instruction, Processor *);
+void execute_jalr(Instruction, Processor *);
+void execute_auipc(Instruction, Processor *);
+void execute_amo(Instruction, Processor *, memory_t *);
 
-void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *memory) {    
+uint64_t emu_instret = 0;   // instructions executed, the emulator's cycle and instret
+bool     emu_exited = false; // the program made the exit ecall
+
+void execute_instruction(uint32_t instruction_bits, Processor *processor,memory_t *memory) {    
     Instruction instruction = parse_instruction(instruction_bits);
     switch(instruction.opcode) {
         case 0x33:
@@ -23,7 +32,10 @@ void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *m
             execute_itype_except_load(instruction, processor);
             break;
         case 0x73:
-            execute_ecall(processor, memory);
+            if (instruction.itype.funct3 == 0)
+                execute_ecall(processor, memory);
+            else
+                execute_csr(instruction, processor);
             break;
         case 0x63:
             execute_branch(instruction, processor);
@@ -40,270 +52,202 @@ void execute_instruction(uint32_t instruction_bits, Processor *processor,Byte *m
         case 0x37:
             execute_lui(instruction, processor);
             break;
+        case 0x67:
+            execute_jalr(instruction, processor);
+            break;
+        case 0x17:
+            execute_auipc(instruction, processor);
+            break;
+        case 0x2F:
+            execute_amo(instruction, processor, memory);
+            break;
         default: // undefined opcode
             handle_invalid_instruction(instruction);
             exit(-1);
             break;
     }
+    emu_instret++;
 }
 
 void execute_rtype(Instruction instruction, Processor *processor) {
-    switch (instruction.rtype.funct3){
+    Word rs1 = processor->R[instruction.rtype.rs1];
+    Word rs2 = processor->R[instruction.rtype.rs2];
+    Word result;
+
+    switch (instruction.rtype.funct7) {
         case 0x0:
-            switch (instruction.rtype.funct7) {
+        case 0x20:
+            switch (instruction.rtype.funct3) {
                 case 0x0:
-                    // Add
-                    processor->R[instruction.rtype.rd] =
-                        ((sWord)processor->R[instruction.rtype.rs1]) +
-                        ((sWord)processor->R[instruction.rtype.rs2]);
+                    // Add / Sub
+                    result = (instruction.rtype.funct7 == 0x20) ? rs1 - rs2
+                                                                 : rs1 + rs2;
                     break;
                 case 0x1:
-                    // Mul
-                    processor->R[instruction.rtype.rd] =
-                        ((sWord)processor->R[instruction.rtype.rs1]) *
-                        ((sWord)processor->R[instruction.rtype.rs2]);
+                    // Sll
+                    result = rs1 << (rs2 & 0x1F);
                     break;
-                case 0x20:
-                    // Sub
-                    processor->R[instruction.rtype.rd] =
-                        ((sWord)processor->R[instruction.rtype.rs1]) -
-                        ((sWord)processor->R[instruction.rtype.rs2]);
+                case 0x2:
+                    // Slt
+                    result = ((sWord)rs1 < (sWord)rs2) ? 1 : 0;
                     break;
-                default:
-                    handle_invalid_instruction(instruction);
-                    exit(-1);
+                case 0x3:
+                    // Sltu
+                    result = (rs1 < rs2) ? 1 : 0;
                     break;
-            }
-            break;
-        /* YOUR CODE HERE */
-
-        case 0x1:
-            switch (instruction.rtype.funct7){
-                case 0x0:
-                    processor->R[instruction.rtype.rd]=
-                        ((sWord)processor->R[instruction.rtype.rs1])<<
-                        ((sWord)processor->R[instruction.rtype.rs2]);
+                case 0x4:
+                    // Xor
+                    result = rs1 ^ rs2;
                     break;
-                case 0x01:
-                    processor->R[instruction.rtype.rd]=
-                        (sWord)(((sDouble)processor->R[instruction.rtype.rs1])*
-                        ((sDouble)processor->R[instruction.rtype.rs2]))>>32;
+                case 0x5:
+                    // Srl / Sra
+                    result = (instruction.rtype.funct7 == 0x20)
+                                 ? (Word)((sWord)rs1 >> (rs2 & 0x1F))
+                                 : rs1 >> (rs2 & 0x1F);
                     break;
-                default:
-                    handle_invalid_instruction(instruction);
-                    exit(-1);
+                case 0x6:
+                    // Or
+                    result = rs1 | rs2;
                     break;
-            }
-            break;
-
-
-        case 0x2:
-            switch (instruction.rtype.funct7){
-                case 0x0:
-                    processor->R[instruction.rtype.rd]=
-                        (((sWord)processor->R[instruction.rtype.rs1])<
-                        ((sWord)processor->R[instruction.rtype.rs2]))?1:0;
-                    break;
-                case 0x01:
-                    processor->R[instruction.rtype.rd]=
-                        (((sWord)processor->R[instruction.rtype.rs1])*
-                        ((sWord)processor->R[instruction.rtype.rs2]))>>32;
+                case 0x7:
+                    // And
+                    result = rs1 & rs2;
                     break;
                 default:
                     handle_invalid_instruction(instruction);
                     exit(-1);
                     break;
             }
-            
-
-        case 0x3:
-            switch (instruction.rtype.funct7){
-                case 0x0:
-                    processor->R[instruction.rtype.rd]=zero_extend_number(
-                        (((sWord)processor->R[instruction.rtype.rs1])<
-                        ((sWord)processor->R[instruction.rtype.rs2]))?1:0,2);
-                    break;
-                case 0x01:
-                    processor->R[instruction.rtype.rd]=
-                        (((sWord)processor->R[instruction.rtype.rs1])*
-                        ((sWord)processor->R[instruction.rtype.rs2]))>>32;
-                    break;
-                default:
-                    handle_invalid_instruction(instruction);
-                    exit(-1);
-                    break;
+            // only add, srl and their funct7 = 0x20 twins exist
+            if (instruction.rtype.funct7 == 0x20 &&
+                instruction.rtype.funct3 != 0x0 && instruction.rtype.funct3 != 0x5) {
+                handle_invalid_instruction(instruction);
+                exit(-1);
             }
-        
-        case 0x4:
-            switch (instruction.rtype.funct7){
+            break;
+
+        case 0x1:
+            // RV32M
+            switch (instruction.rtype.funct3) {
                 case 0x0:
-                    processor->R[instruction.rtype.rd]=
-                    (((sWord)processor->R[instruction.rtype.rs1])^
-                    ((sWord)processor->R[instruction.rtype.rs2]));
-                break;
-
-                case 0x01:
-                    processor->R[instruction.rtype.rd]=
-                        (((sWord)processor->R[instruction.rtype.rs1])/
-                        ((sWord)processor->R[instruction.rtype.rs2]));
+                    // Mul
+                    result = rs1 * rs2;
                     break;
-                default:
-                    handle_invalid_instruction(instruction);
-                    exit(-1);
+                case 0x1:
+                    // Mulh
+                    result = (Word)(((sDouble)(sWord)rs1 * (sDouble)(sWord)rs2) >> 32);
                     break;
-            }
-        
-        case 0x5:
-            switch (instruction.rtype.funct7){
-                case 0x0:
-                    processor->R[instruction.rtype.rd]=
-                        (((sWord)processor->R[instruction.rtype.rs1])>>
-                        ((sWord)processor->R[instruction.rtype.rs2]));
-                break;
-
                 case 0x2:
-                    processor->R[instruction.rtype.rd]= sign_extend_number(
-                        (((sWord)processor->R[instruction.rtype.rs1])>>
-                        ((sWord)processor->R[instruction.rtype.rs2])),32);
-                break;
-
-                case 0x01:
-                    processor->R[instruction.rtype.rd]=
-                        (((sWord)processor->R[instruction.rtype.rs1])/
-                        ((sWord)processor->R[instruction.rtype.rs2]));
+                    // Mulhsu
+                    result = (Word)(((sDouble)(sWord)rs1 * (sDouble)rs2) >> 32);
                     break;
-                default:
-                    handle_invalid_instruction(instruction);
-                    exit(-1);
+                case 0x3:
+                    // Mulhu
+                    result = (Word)(((Double)rs1 * (Double)rs2) >> 32);
                     break;
-            }
-
-
-
-        case 0x6:
-            switch (instruction.rtype.funct7){
-                case 0x0:
-                    processor->R[instruction.rtype.rd]=
-                        (((sWord)processor->R[instruction.rtype.rs1])|
-                        ((sWord)processor->R[instruction.rtype.rs2]));
+                case 0x4:
+                    // Div: by zero gives -1, the overflow case gives rs1
+                    if (rs2 == 0)
+                        result = 0xFFFFFFFF;
+                    else if (rs1 == 0x80000000 && rs2 == 0xFFFFFFFF)
+                        result = rs1;
+                    else
+                        result = (Word)((sWord)rs1 / (sWord)rs2);
                     break;
-
-                case 0x01:
-                    processor->R[instruction.rtype.rd]=
-                        (((sWord)processor->R[instruction.rtype.rs1])%
-                        ((sWord)processor->R[instruction.rtype.rs2]));
+                case 0x5:
+                    // Divu
+                    result = (rs2 == 0) ? 0xFFFFFFFF : rs1 / rs2;
                     break;
-
-                default:
-                    handle_invalid_instruction(instruction);
-                    exit(-1);
+                case 0x6:
+                    // Rem: by zero gives rs1, the overflow case gives 0
+                    if (rs2 == 0)
+                        result = rs1;
+                    else if (rs1 == 0x80000000 && rs2 == 0xFFFFFFFF)
+                        result = 0;
+                    else
+                        result = (Word)((sWord)rs1 % (sWord)rs2);
                     break;
-            }
-
-
-            
-        case 0x7:
-            switch (instruction.rtype.funct7){
-                case 0x0:
-                    processor->R[instruction.rtype.rd]=
-                        (((sWord)processor->R[instruction.rtype.rs1])&
-                        ((sWord)processor->R[instruction.rtype.rs2]));
-                    break;
-
-                case 0x01:
-                    processor->R[instruction.rtype.rd]=
-                        (((sWord)processor->R[instruction.rtype.rs1])%
-                        ((sWord)processor->R[instruction.rtype.rs2]));
+                case 0x7:
+                    // Remu
+                    result = (rs2 == 0) ? rs1 : rs1 % rs2;
                     break;
-
                 default:
                     handle_invalid_instruction(instruction);
                     exit(-1);
                     break;
             }
+            break;
 
-
-	/* deal with other cases */
         default:
             handle_invalid_instruction(instruction);
             exit(-1);
             break;
     }
+    processor->R[instruction.rtype.rd] = result;
     // update PC
     processor->PC += 4;
 }
 
 void execute_itype_except_load(Instruction instruction, Processor *processor) {
+    Word rs1 = processor->R[instruction.itype.rs1];
+    Word imm = sign_extend_number(instruction.itype.imm, 12);
+    Word shamt = instruction.itype.imm & 0x1F;
+    Word result;
+
     switch (instruction.itype.funct3) {
-        /* YOUR CODE HERE */
         case 0x0:
-            processor->R[instruction.itype.rd]=
-                (((sWord)processor->R[instruction.itype.rs1])+
-                ((sWord)processor->R[instruction.itype.imm]));
-                break;
+            // Addi
+            result = rs1 + imm;
+            break;
 
         case 0x1:
-            processor->R[instruction.itype.rd]=
-                (((sWord)processor->R[instruction.itype.rs1])<<
-                ((sWord)processor->R[instruction.itype.imm]));
-                break;
-                
+            // Slli
+            result = rs1 << shamt;
+            break;
+
         case 0x2:
-            processor->R[instruction.itype.rd]=
-                (((sWord)processor->R[instruction.itype.rs1])<
-                ((sWord)processor->R[instruction.itype.rs1]))?1:0;
-                break;
-            
+            // Slti
+            result = ((sWord)rs1 < (sWord)imm) ? 1 : 0;
+            break;
+
         case 0x3:
-            processor->R[instruction.itype.rd]=zero_extend_number(
-                (((sWord)processor->R[instruction.itype.rs1])<
-                ((sWord)processor->R[instruction.itype.rs1]))?1:0,2);
-                break;
+            // Sltiu: the immediate is sign-extended, then compared unsigned
+            result = (rs1 < imm) ? 1 : 0;
+            break;
 
-        case 0x4: 
-            processor->R[instruction.itype.rd]=
-                (((sWord)processor->R[instruction.itype.rs1])^
-                ((sWord)processor->R[instruction.itype.imm]));
-                break;
+        case 0x4:
+            // Xori
+            result = rs1 ^ imm;
+            break;
 
         case 0x5:
+            // Srli / Srai, told apart by the upper bits of the immediate
+            if ((instruction.itype.imm >> 5) == 0x20)
+                result = (Word)((sWord)rs1 >> shamt);
+            else
+                result = rs1 >> shamt;
+            break;
 
-            if (instruction.itype.imm == 0x0)
-            {
-                processor->R[instruction.itype.rd]=
-                (((sWord)processor->R[instruction.itype.rs1])>>
-                ((sWord)processor->R[instruction.itype.imm]));
-                break;
-            }
-
-            else if (instruction.itype.imm == 0x2)
-            {
-                processor->R[instruction.itype.rd]= sign_extend_number(
-                (((sWord)processor->R[instruction.itype.rs1])>>
-                ((sWord)processor->R[instruction.itype.imm])),5);
-                break;
-            }
-        
         case 0x6:
-            processor->R[instruction.itype.rd]=
-            (((sWord)processor->R[instruction.itype.rs1])|
-            ((sWord)processor->R[instruction.itype.imm]));
+            // Ori
+            result = rs1 | imm;
             break;
-        
+
         case 0x7:
-            processor->R[instruction.itype.rd]=
-            (((sWord)processor->R[instruction.itype.rs1])&
-            ((sWord)processor->R[instruction.itype.imm]));
+            // Andi
+            result = rs1 & imm;
             break;
-        
-            
+
         default:
             handle_invalid_instruction(instruction);
+            exit(-1);
             break;
     }
+    processor->R[instruction.itype.rd] = result;
+    processor->PC += 4;
 }
 
-void execute_ecall(Processor *p, Byte *memory) {
+void execute_ecall(Processor *p, memory_t *memory) {
     Register i;
     
     // syscall number is given by a0 (x10)
@@ -314,14 +258,14 @@ void execute_ecall(Processor *p, Byte *memory) {
             p->PC += 4;
             break;
         case 4: // print a string
-            for(i=p->R[11];i<MEMORY_SPACE && load(memory,i,LENGTH_BYTE);i++) {
+            for(i=p->R[11];mem_in_range(memory,i,1) && load(memory,i,LENGTH_BYTE);i++) {
                 printf("%c",load(memory,i,LENGTH_BYTE));
             }
             p->PC += 4;
             break;
-        case 10: // exit
+        case 10: // exit, the caller stops executing
             printf("exiting the simulator\n");
-            exit(0);
+            emu_exited = true;
             break;
         case 11: // print a character
             printf("%c",p->R[11]);
@@ -334,43 +278,61 @@ void execute_ecall(Processor *p, Byte *memory) {
     }
 }
 
+/**
+ * Zicsr counters as the emulator sees them: one cycle per instruction and
+ * none of the pipeline events
+ **/
+void execute_csr(Instruction instruction, Processor *processor) {
+    csr_counters_t now = {.cycle = emu_instret, .instret = emu_instret};
+    Word old = csr_execute(instruction, processor->R[instruction.itype.rs1], &now);
+    processor->R[instruction.itype.rd] = old;
+    processor->PC += 4;
+}
+
+/**
+ * RV32A with the emulator's own reservation, the emulator is one hart
+ **/
+void execute_amo(Instruction instruction, Processor *processor, memory_t *memory) {
+    static amo_reservation_t reservation;
+    bool wrote;
+    if (!amo_valid(instruction)) {
+        handle_invalid_instruction(instruction);
+        exit(-1);
+    }
+    Word rd = amo_execute(instruction, processor->R[instruction.rtype.rs1],
+                          processor->R[instruction.rtype.rs2], memory, &reservation, &wrote);
+    processor->R[instruction.rtype.rd] = rd;
+    processor->PC += 4;
+}
+
 void execute_branch(Instruction instruction, Processor *processor) {
+    sWord rs1 = (sWord)processor->R[instruction.sbtype.rs1];
+    sWord rs2 = (sWord)processor->R[instruction.sbtype.rs2];
+    bool taken = false;
     switch (instruction.sbtype.funct3) {
         /* YOUR CODE HERE */
         case 0x0:
-            if (processor->R[instruction.sbtype.rs1] == processor->R[instruction.sbtype.rs2]){
-                processor->PC += get_branch_offset(instruction);
-            }
+            taken = (rs1 == rs2);
         break;
 
         case 0x1:
-            if (processor->R[instruction.sbtype.rs1] != processor->R[instruction.sbtype.rs2]){
-                processor->PC += get_branch_offset(instruction);
-            }
+            taken = (rs1 != rs2);
         break;
 
         case 0x4:
-            if (processor->R[instruction.sbtype.rs1] < processor->R[instruction.sbtype.rs2]){
-                processor->PC += get_branch_offset(instruction);
-            }
+            taken = (rs1 < rs2);
         break;
 
         case 0x5:
-            if (processor->R[instruction.sbtype.rs1] >= processor->R[instruction.sbtype.rs2]){
-                processor->PC += get_branch_offset(instruction);
-            }
+            taken = (rs1 >= rs2);
         break;
 
         case 0x6:
-            if (processor->R[instruction.sbtype.rs1] < processor->R[instruction.sbtype.rs2]){
-                processor->PC += get_branch_offset(instruction);
-            }
+            taken = ((Word)rs1 < (Word)rs2);
         break;
 
         case 0x7:
-            if (processor->R[instruction.sbtype.rs1] >= processor->R[instruction.sbtype.rs2]){
-                processor->PC += get_branch_offset(instruction);
-            }
+            taken = ((Word)rs1 >= (Word)rs2);
         break;
 
 
@@ -379,9 +341,11 @@ void execute_branch(Instruction instruction, Processor *processor) {
             exit(-1);
             break;
     }
+    // not-taken branches fall through to the next instruction
+    processor->PC += (taken) ? get_branch_offset(instruction) : 4;
 }
 
-void execute_load(Instruction instruction, Processor *processor, Byte *memory) {
+void execute_load(Instruction instruction, Processor *processor, memory_t *memory) {
     Address address = processor->R[instruction.itype.rs1] + sign_extend_number(instruction.itype.imm, 12); 
      /* YOUR CODE HERE */
     switch (instruction.itype.funct3) {
@@ -403,6 +367,16 @@ void execute_load(Instruction instruction, Processor *processor, Byte *memory) {
             load(memory, address, LENGTH_WORD);
          break; 
 
+        // lbu
+        case 0x4:
+        processor->R[instruction.itype.rd] = load(memory, address, LENGTH_BYTE);
+        break;
+
+        // lhu
+        case 0x5:
+        processor->R[instruction.itype.rd] = load(memory, address, LENGTH_HALF_WORD);
+        break;
+
         default:
             handle_invalid_instruction(instruction);
             break;
@@ -412,8 +386,8 @@ void execute_load(Instruction instruction, Processor *processor, Byte *memory) {
 }
 
 
-void execute_store(Instruction instruction, Processor *processor, Byte *memory) {
-    Address address = processor->R[instruction.stype.rs1] + sign_extend_number(instruction.stype.imm5, 12);
+void execute_store(Instruction instruction, Processor *processor, memory_t *memory) {
+    Address address = processor->R[instruction.stype.rs1] + get_store_offset(instruction);
     switch (instruction.stype.funct3) {
         /* YOUR CODE HERE */
         // sb
@@ -443,7 +417,20 @@ void execute_jal(Instruction instruction, Processor *processor) {
     /* YOUR CODE HERE */
     processor->R[instruction.ujtype.rd] = processor->PC +4; 
     
-    processor->PC = processor->PC + sign_extend_number(instruction.ujtype.imm, 21);
+    processor->PC = processor->PC + get_jump_offset(instruction);
+}
+
+void execute_jalr(Instruction instruction, Processor *processor) {
+    // read rs1 before writing rd, they may be the same register
+    Address target = (processor->R[instruction.itype.rs1] +
+                      sign_extend_number(instruction.itype.imm, 12)) & ~1U;
+    processor->R[instruction.itype.rd] = processor->PC + 4;
+    processor->PC = target;
+}
+
+void execute_auipc(Instruction instruction, Processor *processor) {
+    processor->R[instruction.utype.rd] = processor->PC + (instruction.utype.imm << 12);
+    processor->PC += 4;
 }
 
 void execute_lui(Instruction instruction, Processor *processor) {
@@ -451,35 +438,3 @@ void execute_lui(Instruction instruction, Processor *processor) {
     processor->R[instruction.utype.rd] = instruction.utype.imm << 12;
     processor->PC +=4;
 }
-
-void store(Byte *memory, Address address, Alignment alignment, Word value) {
-    /* YOUR CODE HERE */
-    if (alignment == LENGTH_BYTE) {
-        memory[address] = (Byte)(value & 0xFF); // stores the lowest byte
-    } else if (alignment == LENGTH_HALF_WORD) {
-        memory[address] = (Byte)(value & 0xFF); // low byte 
-        memory[address + 1 ] = (Byte)((value >> 8)& 0xFF); //high byte 
-    } else if (alignment == LENGTH_WORD) { 
-         memory[address] = (Byte)(value & 0xFF); // LSB byte0
-         memory[address + 1 ] = (Byte)((value >> 8)& 0xFF); // byte 1
-         memory[address + 2 ] = (Byte)((value >> 16)& 0xFF); // byte 2 
-         memory[address + 3 ] = (Byte)((value >> 24)& 0xFF); // MSB byte 3
-    } else {
-        printf("Error: Unrecognized alignment %d\n", alignment);
-        exit(-1);
-    }
-}
-
-Word load(Byte *memory, Address address, Alignment alignment) {
-    if(alignment == LENGTH_BYTE) {
-        return memory[address];
-    } else if(alignment == LENGTH_HALF_WORD) {
-        return (memory[address+1] << 8) + memory[address];
-    } else if(alignment == LENGTH_WORD) {
-        return (memory[address+3] << 24) + (memory[address+2] << 16)
-               + (memory[address+1] << 8) + memory[address];
-    } else {
-        printf("Error: Unrecognized alignment %d\n", alignment);
-        exit(-1);
-    }
-}
\ No newline at end of file
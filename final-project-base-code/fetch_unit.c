@@ -0,0 +1,131 @@
+//fetch_unit.c
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "riscv.h"
+#include "fetch_unit.h"
+#include "stats.h"
+
+void fq_init(fetch_unit_t* fq, uint8_t size, uint8_t lb_size, uint32_t pc)
+{
+  memset(fq, 0, sizeof(*fq));
+  fq->size = (size > FQ_MAX_ENTRIES) ? FQ_MAX_ENTRIES : size;
+  fq->lb_size = (lb_size > LB_MAX_WORDS) ? LB_MAX_WORDS : lb_size;
+  fq->fetch_pc = pc;
+  if (fq->size == 0)
+    return;
+
+  stats_add_u64("fq.block_fetches", "blocks fetched into the fetch queue", &fq->block_fetches);
+  stats_add_u64("fq.starved_cycles", "cycles IF found the fetch queue empty", &fq->starved_cycles);
+  if (fq->lb_size) {
+    stats_add_u64("lb.captures", "loops captured by the loop buffer", &fq->lb_captures);
+    stats_add_u64("lb.instructions", "instructions supplied by the loop buffer", &fq->lb_instructions);
+  }
+}
+
+static void fq_push(fetch_unit_t* fq, uint32_t pc, uint32_t bits)
+{
+  uint8_t tail = (fq->head + fq->count) % FQ_MAX_ENTRIES;
+  fq->pc[tail] = pc;
+  fq->bits[tail] = bits;
+  fq->count++;
+}
+
+/**
+ * a taken branch or jump: everything queued is on the wrong path. A backward
+ * branch that closes the same short loop twice in a row has its loop body
+ * captured by the loop buffer.
+ **/
+void fq_redirect(fetch_unit_t* fq, uint32_t target, uint32_t branch_addr, memory_t* memory_p)
+{
+  fq->count = 0;
+  fq->busy = 0;
+  fq->fetch_pc = target;
+
+  if (fq->lb_size == 0 || target > branch_addr ||
+      (branch_addr - target) / 4 + 1 > fq->lb_size)
+    return;
+
+  if (branch_addr == fq->last_branch && target == fq->last_target) {
+    if (!fq->lb_valid || fq->lb_start != target || fq->lb_end != branch_addr) {
+      for (uint32_t i = 0; i <= (branch_addr - target) / 4; i++)
+        fq->lb_bits[i] = mem_fetch(memory_p, target + 4 * i);
+      fq->lb_valid = true;
+      fq->lb_start = target;
+      fq->lb_end = branch_addr;
+      fq->lb_captures++;
+    }
+  }
+  fq->last_branch = branch_addr;
+  fq->last_target = target;
+}
+
+/**
+ * one cycle of the fetch unit: replay from the loop buffer, or issue and
+ * complete block fetches into the free queue entries
+ **/
+void fq_fill(fetch_unit_t* fq, memory_t* memory_p)
+{
+  if (fq->busy == 0 && fq->lb_valid &&
+      fq->fetch_pc >= fq->lb_start && fq->fetch_pc <= fq->lb_end) {
+    while (fq->count < fq->size && fq->fetch_pc <= fq->lb_end) {
+      fq_push(fq, fq->fetch_pc, fq->lb_bits[(fq->fetch_pc - fq->lb_start) / 4]);
+      fq->fetch_pc += 4;
+      fq->lb_instructions++;
+    }
+    return;
+  }
+
+  if (fq->busy == 0) {
+    if (fq->count == fq->size)
+      return;
+    fq->busy = (mem_latency < 1) ? 1 : mem_latency;
+    fq->block_fetches++;
+  }
+
+  if (--fq->busy > 0)
+    return;
+
+  // the block arrived: queue the words from fetch_pc up to its end that fit,
+  // the rest is fetched again by the next access
+  uint32_t block_end = (fq->fetch_pc & ~(uint32_t)(FQ_BLOCK_SIZE - 1)) + FQ_BLOCK_SIZE;
+  while (fq->count < fq->size && fq->fetch_pc < block_end) {
+    fq_push(fq, fq->fetch_pc, mem_fetch(memory_p, fq->fetch_pc));
+    fq->fetch_pc += 4;
+  }
+}
+
+/**
+ * instruction at `pc` for IF, false when the fetch unit has not delivered
+ * it yet
+ **/
+bool fq_pop(fetch_unit_t* fq, uint32_t pc, uint32_t* bits_p)
+{
+  if (fq->count == 0) {
+    fq->starved_cycles++;
+    return false;
+  }
+  if (fq->pc[fq->head] != pc) {
+    // IF moved on without a redirect through the fetch unit, start over
+    fq->count = 0;
+    fq->busy = 0;
+    fq->fetch_pc = pc;
+    fq->starved_cycles++;
+    return false;
+  }
+  *bits_p = fq->bits[fq->head];
+  fq->head = (fq->head + 1) % FQ_MAX_ENTRIES;
+  fq->count--;
+  return true;
+}
+
+void fq_print_stats(const fetch_unit_t* fq)
+{
+  printf("#FQ entries        = %5d\n", fq->size);
+  printf("#FQ block fetches  = %5ld\n", fq->block_fetches);
+  printf("#FQ starved cycles = %5ld\n", fq->starved_cycles);
+  if (fq->lb_size) {
+  printf("#LB captures       = %5ld\n", fq->lb_captures);
+  printf("#LB instructions   = %5ld\n", fq->lb_instructions);
+  }
+}
@@ -0,0 +1,51 @@
+#ifndef FETCH_UNIT_H
+#define FETCH_UNIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "types.h"
+#include "guest_mem.h"
+#include "cache.h"
+
+#define FQ_MAX_ENTRIES  32                            // deepest configurable fetch queue
+#define FQ_BLOCK_SIZE   (1 << CACHE_BLOCK_BITS)       // bytes fetched per access
+#define LB_MAX_WORDS    32                            // largest loop body the loop buffer holds
+
+/**
+ * decoupled fetch unit in front of IF: whole blocks are fetched from memory
+ * into a queue that IF takes one instruction a cycle from. A small loop
+ * buffer captures a tight backward loop once it has been taken twice in a
+ * row and supplies its body again without memory accesses.
+ **/
+typedef struct {
+  uint8_t  size;                       // queue entries, 0 = IF reads memory directly
+  uint32_t pc[FQ_MAX_ENTRIES];
+  uint32_t bits[FQ_MAX_ENTRIES];
+  uint8_t  head;
+  uint8_t  count;
+  uint32_t fetch_pc;                   // next address requested from memory
+  int      busy;                       // cycles until the block in flight arrives
+
+  // loop buffer
+  uint8_t  lb_size;                    // words, 0 = no loop buffer
+  bool     lb_valid;
+  uint32_t lb_start;                   // loop target
+  uint32_t lb_end;                     // backward branch closing the loop
+  uint32_t lb_bits[LB_MAX_WORDS];
+  uint32_t last_branch;                // last taken backward branch and target,
+  uint32_t last_target;                // to detect a loop taken twice in a row
+
+  // stats
+  uint64_t block_fetches;
+  uint64_t starved_cycles;             // IF found the queue empty
+  uint64_t lb_captures;
+  uint64_t lb_instructions;            // instructions supplied by the loop buffer
+} fetch_unit_t;
+
+void fq_init(fetch_unit_t* fq, uint8_t size, uint8_t lb_size, uint32_t pc);
+void fq_redirect(fetch_unit_t* fq, uint32_t target, uint32_t branch_addr, memory_t* memory_p);
+void fq_fill(fetch_unit_t* fq, memory_t* memory_p);
+bool fq_pop(fetch_unit_t* fq, uint32_t pc, uint32_t* bits_p);
+void fq_print_stats(const fetch_unit_t* fq);
+
+#endif // FETCH_UNIT_H
@@ -0,0 +1,260 @@
+//guest_mem.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "riscv.h"
+#include "utils.h"
+#include "guest_mem.h"
+
+#define MEM_TABLE_SIZE  (1U << MEM_TABLE_BITS)
+#define MEM_NO_PAGE     0xFFFFFFFFU   // page numbers have 20 bits
+
+// what a page never written reads as
+static const Byte zero_page[MEM_PAGE_SIZE];
+
+static void out_of_memory(void)
+{
+  fprintf(stderr, "Cannot allocate guest memory\n");
+  exit(-1);
+}
+
+static void forget_hot_pages(memory_t* mem)
+{
+  mem->hot_fetch_page = MEM_NO_PAGE;
+  mem->hot_read_page  = MEM_NO_PAGE;
+  mem->hot_write_page = MEM_NO_PAGE;
+}
+
+memory_t* mem_create(uint64_t limit)
+{
+  memory_t* mem = calloc(1, sizeof(memory_t));
+  if (mem == NULL)
+    out_of_memory();
+  mem->dir = calloc(1U << MEM_DIR_BITS, sizeof(Byte**));
+  if (mem->dir == NULL)
+    out_of_memory();
+  mem->limit = limit;
+  forget_hot_pages(mem);
+  return mem;
+}
+
+memory_t* mem_clone(const memory_t* mem)
+{
+  memory_t* copy = mem_create(mem->limit);
+  copy->misaligned = mem->misaligned;
+  for (uint32_t d = 0; d < (1U << MEM_DIR_BITS); d++) {
+    if (mem->dir[d] == NULL)
+      continue;
+    copy->dir[d] = calloc(MEM_TABLE_SIZE, sizeof(Byte*));
+    if (copy->dir[d] == NULL)
+      out_of_memory();
+    for (uint32_t t = 0; t < MEM_TABLE_SIZE; t++) {
+      if (mem->dir[d][t] == NULL)
+        continue;
+      copy->dir[d][t] = malloc(MEM_PAGE_SIZE);
+      if (copy->dir[d][t] == NULL)
+        out_of_memory();
+      memcpy(copy->dir[d][t], mem->dir[d][t], MEM_PAGE_SIZE);
+      copy->pages++;
+    }
+  }
+  return copy;
+}
+
+/**
+ * another memory_t for the same pages, for a hart on another host thread
+ **/
+memory_t* mem_view(memory_t* mem)
+{
+  memory_t* view = malloc(sizeof(memory_t));
+  if (view == NULL)
+    out_of_memory();
+  // what `mem` remembers may be the zero page of a page another hart is
+  // about to write
+  forget_hot_pages(mem);
+  mem->shared = true;
+  *view = *mem;
+  view->pages = 0;
+  view->view = true;
+  return view;
+}
+
+void mem_destroy(memory_t* mem)
+{
+  if (mem->view) {
+    free(mem);
+    return;
+  }
+  for (uint32_t d = 0; d < (1U << MEM_DIR_BITS); d++) {
+    if (mem->dir[d] == NULL)
+      continue;
+    for (uint32_t t = 0; t < MEM_TABLE_SIZE; t++)
+      free(mem->dir[d][t]);
+    free(mem->dir[d]);
+  }
+  free(mem->dir);
+  free(mem);
+}
+
+bool mem_in_range(const memory_t* mem, Address address, uint64_t len)
+{
+  return (uint64_t)address + len <= mem->limit;
+}
+
+/**
+ * page holding `address` for reading, the shared zero page when it was never
+ * written; `hot_page`/`hot` is the lookup cache of the access kind
+ **/
+static const Byte* read_page(memory_t* mem, Address address, Address* hot_page,
+                             const Byte** hot)
+{
+  Address page = address >> MEM_PAGE_BITS;
+  if (page != *hot_page) {
+    // the limit is page aligned, so checking one byte covers the page
+    if (address >= mem->limit)
+      handle_invalid_read(address);
+    Byte** table = __atomic_load_n(&mem->dir[page >> MEM_TABLE_BITS], __ATOMIC_ACQUIRE);
+    const Byte* p = (table) ? __atomic_load_n(&table[page & (MEM_TABLE_SIZE - 1)], __ATOMIC_ACQUIRE)
+                            : NULL;
+    if (p == NULL && mem->shared)
+      return zero_page;   // not remembered, another hart may write it
+    *hot = (p) ? p : zero_page;
+    *hot_page = page;
+  }
+  return *hot;
+}
+
+/**
+ * set the NULL pointer at `slot` to the zeroed `fresh`; when another hart
+ * got there first, `fresh` is freed and theirs is kept. Returns the one
+ * in `slot`.
+ **/
+static void* publish(void** slot, void* fresh)
+{
+  void* expected = NULL;
+  if (fresh == NULL)
+    out_of_memory();
+  if (__atomic_compare_exchange_n(slot, &expected, fresh, false,
+                                  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    return fresh;
+  free(fresh);
+  return expected;
+}
+
+/**
+ * page holding `address` for writing, allocated on first touch
+ **/
+static Byte* write_page(memory_t* mem, Address address)
+{
+  Address page = address >> MEM_PAGE_BITS;
+  if (page == mem->hot_write_page)
+    return mem->hot_write;
+  if (address >= mem->limit)
+    handle_invalid_write(address);
+
+  Byte*** dir_slot = &mem->dir[page >> MEM_TABLE_BITS];
+  Byte** table = __atomic_load_n(dir_slot, __ATOMIC_ACQUIRE);
+  if (table == NULL)
+    table = publish((void**)dir_slot, calloc(MEM_TABLE_SIZE, sizeof(Byte*)));
+  Byte** slot = &table[page & (MEM_TABLE_SIZE - 1)];
+  Byte* p = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+  if (p == NULL) {
+    Byte* fresh = calloc(MEM_PAGE_SIZE, 1);
+    p = publish((void**)slot, fresh);
+    if (p == fresh)
+      mem->pages++;
+    // the page was read as the zero page until now
+    if (mem->hot_read_page == page)
+      mem->hot_read = p;
+    if (mem->hot_fetch_page == page)
+      mem->hot_fetch = p;
+  }
+  mem->hot_write_page = page;
+  mem->hot_write = p;
+  return p;
+}
+
+void mem_read(memory_t* mem, Address address, void* buf, size_t len)
+{
+  Byte* out = buf;
+  while (len) {
+    uint32_t offset = address & MEM_PAGE_MASK;
+    size_t n = MEM_PAGE_SIZE - offset;
+    if (n > len)
+      n = len;
+    memcpy(out, read_page(mem, address, &mem->hot_read_page, &mem->hot_read) + offset, n);
+    out += n;
+    address += n;
+    len -= n;
+  }
+}
+
+void mem_write(memory_t* mem, Address address, const void* buf, size_t len)
+{
+  const Byte* in = buf;
+  while (len) {
+    uint32_t offset = address & MEM_PAGE_MASK;
+    size_t n = MEM_PAGE_SIZE - offset;
+    if (n > len)
+      n = len;
+    memcpy(write_page(mem, address) + offset, in, n);
+    in += n;
+    address += n;
+    len -= n;
+  }
+}
+
+Word mem_fetch_slow(memory_t* mem, Address pc)
+{
+  uint32_t offset = pc & MEM_PAGE_MASK;
+  if (offset > MEM_PAGE_SIZE - 4) {
+    // straddles two pages
+    Word value = 0;
+    for (int i = 3; i >= 0; i--)
+      value = (value << 8) | mem_load8(mem, pc + i);
+    return value;
+  }
+  return mem_get32(read_page(mem, pc, &mem->hot_fetch_page, &mem->hot_fetch) + offset);
+}
+
+Word mem_load_slow(memory_t* mem, Address address, Alignment alignment)
+{
+  uint32_t offset = address & MEM_PAGE_MASK;
+  if (mem_misaligned(address, alignment)) {
+    if (mem->misaligned == MEM_MISALIGNED_TRAP)
+      handle_misaligned_read(address);
+    if (offset > MEM_PAGE_SIZE - alignment) {
+      // straddles two pages
+      Word value = 0;
+      for (int i = alignment - 1; i >= 0; i--)
+        value = (value << 8) | mem_load8(mem, address + i);
+      return value;
+    }
+  }
+  const Byte* p = read_page(mem, address, &mem->hot_read_page, &mem->hot_read) + offset;
+  if (alignment == LENGTH_BYTE)
+    return p[0];
+  return (alignment == LENGTH_HALF_WORD) ? mem_get16(p) : mem_get32(p);
+}
+
+void mem_store_slow(memory_t* mem, Address address, Alignment alignment, Word value)
+{
+  uint32_t offset = address & MEM_PAGE_MASK;
+  if (mem_misaligned(address, alignment)) {
+    if (mem->misaligned == MEM_MISALIGNED_TRAP)
+      handle_misaligned_write(address);
+    if (offset > MEM_PAGE_SIZE - alignment) {
+      // straddles two pages
+      for (int i = 0; i < alignment; i++)
+        mem_store8(mem, address + i, value >> (8 * i));
+      return;
+    }
+  }
+  Byte* p = write_page(mem, address) + offset;
+  if (alignment == LENGTH_BYTE)
+    p[0] = (Byte)value;
+  else if (alignment == LENGTH_HALF_WORD)
+    mem_put16(p, (Half)value);
+  else
+    mem_put32(p, value);
+}
@@ -0,0 +1,199 @@
+#ifndef GUEST_MEM_H
+#define GUEST_MEM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+
+#define MEM_PAGE_BITS   12                              // 4 KiB pages
+#define MEM_PAGE_SIZE   (1U << MEM_PAGE_BITS)
+#define MEM_PAGE_MASK   (MEM_PAGE_SIZE - 1)
+#define MEM_TABLE_BITS  10                              // pages per second-level table
+#define MEM_DIR_BITS    (32 - MEM_TABLE_BITS - MEM_PAGE_BITS)
+
+/**
+ * what a load or store that is not aligned to its width does (--misaligned)
+ **/
+typedef enum {
+  MEM_MISALIGNED_SPLIT,     // done as separate byte accesses
+  MEM_MISALIGNED_TRAP,      // handle_misaligned_read / handle_misaligned_write
+  MEM_MISALIGNED_PENALTY,   // split, and the pipeline charges extra cycles
+} mem_misaligned_t;
+
+/**
+ * Sparse guest memory. The 32-bit address space is split into 4 KiB pages
+ * found through a two-level table; a page is allocated the first time it is
+ * written, and reading a page never written returns zeroes without
+ * allocating it. Accesses at or above `limit` go to handle_invalid_read /
+ * handle_invalid_write.
+ *
+ * The last page fetched, read and written is remembered, so most accesses
+ * skip the table walk.
+ *
+ * Harts running on their own host threads each access the memory through a
+ * view (mem_view): the pages are shared, the remembered pages are not.
+ * Pages and tables are then published atomically, and a page never written
+ * is not remembered, so a page another hart allocates is seen at once.
+ **/
+typedef struct {
+  Byte***     dir;                      // second-level tables, NULL until used
+  uint64_t    limit;                    // guest memory size in bytes
+  uint64_t    pages;                    // pages allocated through this view
+  mem_misaligned_t misaligned;          // misaligned access policy
+  bool        shared;                   // there are views, other harts write it
+  bool        view;                     // the tables belong to another memory_t
+  Address     hot_fetch_page;
+  const Byte* hot_fetch;
+  Address     hot_read_page;
+  const Byte* hot_read;
+  Address     hot_write_page;
+  Byte*       hot_write;
+} memory_t;
+
+memory_t* mem_create(uint64_t limit);
+memory_t* mem_clone(const memory_t* mem);
+memory_t* mem_view(memory_t* mem);
+void      mem_destroy(memory_t* mem);
+
+bool mem_in_range(const memory_t* mem, Address address, uint64_t len);
+void mem_read(memory_t* mem, Address address, void* buf, size_t len);
+void mem_write(memory_t* mem, Address address, const void* buf, size_t len);
+
+// everything but an aligned access to a hot page, see guest_mem.c
+Word mem_load_slow(memory_t* mem, Address address, Alignment alignment);
+void mem_store_slow(memory_t* mem, Address address, Alignment alignment, Word value);
+Word mem_fetch_slow(memory_t* mem, Address pc);
+
+/**
+ * little-endian guest data at a host pointer, whatever its alignment
+ **/
+static inline Half mem_get16(const Byte* p)
+{
+  Half v;
+  memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap16(v);
+#endif
+  return v;
+}
+
+static inline Word mem_get32(const Byte* p)
+{
+  Word v;
+  memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap32(v);
+#endif
+  return v;
+}
+
+static inline void mem_put16(Byte* p, Half v)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap16(v);
+#endif
+  memcpy(p, &v, sizeof(v));
+}
+
+static inline void mem_put32(Byte* p, Word v)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap32(v);
+#endif
+  memcpy(p, &v, sizeof(v));
+}
+
+/**
+ * width-specialized accesses: an aligned access never crosses a page, so
+ * when its page is the hot one it is a single host load or store
+ **/
+static inline Word mem_load8(memory_t* mem, Address address)
+{
+  if ((address >> MEM_PAGE_BITS) == mem->hot_read_page)
+    return mem->hot_read[address & MEM_PAGE_MASK];
+  return mem_load_slow(mem, address, LENGTH_BYTE);
+}
+
+static inline Word mem_load16(memory_t* mem, Address address)
+{
+  if ((address & 1) == 0 && (address >> MEM_PAGE_BITS) == mem->hot_read_page)
+    return mem_get16(mem->hot_read + (address & MEM_PAGE_MASK));
+  return mem_load_slow(mem, address, LENGTH_HALF_WORD);
+}
+
+static inline Word mem_load32(memory_t* mem, Address address)
+{
+  if ((address & 3) == 0 && (address >> MEM_PAGE_BITS) == mem->hot_read_page)
+    return mem_get32(mem->hot_read + (address & MEM_PAGE_MASK));
+  return mem_load_slow(mem, address, LENGTH_WORD);
+}
+
+static inline void mem_store8(memory_t* mem, Address address, Word value)
+{
+  if ((address >> MEM_PAGE_BITS) == mem->hot_write_page)
+    mem->hot_write[address & MEM_PAGE_MASK] = (Byte)value;
+  else
+    mem_store_slow(mem, address, LENGTH_BYTE, value);
+}
+
+static inline void mem_store16(memory_t* mem, Address address, Word value)
+{
+  if ((address & 1) == 0 && (address >> MEM_PAGE_BITS) == mem->hot_write_page)
+    mem_put16(mem->hot_write + (address & MEM_PAGE_MASK), (Half)value);
+  else
+    mem_store_slow(mem, address, LENGTH_HALF_WORD, value);
+}
+
+static inline void mem_store32(memory_t* mem, Address address, Word value)
+{
+  if ((address & 3) == 0 && (address >> MEM_PAGE_BITS) == mem->hot_write_page)
+    mem_put32(mem->hot_write + (address & MEM_PAGE_MASK), value);
+  else
+    mem_store_slow(mem, address, LENGTH_WORD, value);
+}
+
+/**
+ * instruction word at `pc`, with its own hot page so fetches and data
+ * accesses do not evict each other. Fetches are not data accesses, the
+ * misaligned policy does not apply to them.
+ **/
+static inline Word mem_fetch(memory_t* mem, Address pc)
+{
+  if ((pc & 3) == 0 && (pc >> MEM_PAGE_BITS) == mem->hot_fetch_page)
+    return mem_get32(mem->hot_fetch + (pc & MEM_PAGE_MASK));
+  return mem_fetch_slow(mem, pc);
+}
+
+static inline bool mem_misaligned(Address address, Alignment alignment)
+{
+  return (address & (alignment - 1)) != 0;
+}
+
+/**
+ * load and store of a width known only at run time
+ **/
+static inline Word load(memory_t *memory, Address address, Alignment alignment) {
+    switch (alignment) {
+    case LENGTH_BYTE:      return mem_load8(memory, address);
+    case LENGTH_HALF_WORD: return mem_load16(memory, address);
+    case LENGTH_WORD:      return mem_load32(memory, address);
+    }
+    printf("Error: Unrecognized alignment %d\n", alignment);
+    exit(-1);
+}
+
+static inline void store(memory_t *memory, Address address, Alignment alignment, Word value) {
+    switch (alignment) {
+    case LENGTH_BYTE:      mem_store8(memory, address, value); return;
+    case LENGTH_HALF_WORD: mem_store16(memory, address, value); return;
+    case LENGTH_WORD:      mem_store32(memory, address, value); return;
+    }
+    printf("Error: Unrecognized alignment %d\n", alignment);
+    exit(-1);
+}
+
+#endif // GUEST_MEM_H
@@ -0,0 +1,161 @@
+//hart.c
+#include <stdio.h>
+#include <stdlib.h>
+#include "hart.h"
+#include "hex_loader.h"
+#include "trace.h"
+#include "cpi_stack.h"
+#include "coherence.h"
+#include "atomic.h"
+
+HART_LOCAL Word hart_id;
+
+static int      num_harts = 1;
+static uint64_t quantum;
+static int      run_cycles;         // of harts 1..n-1, as for hart_run()
+
+// quantum barrier: `active` harts have not reached their ecall yet,
+// `arrived` of them wait for the quantum `generation` to end
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  moved = PTHREAD_COND_INITIALIZER;
+static int      active;
+static int      arrived;
+static uint64_t generation;
+
+static void next_generation(void)
+{
+  arrived = 0;
+  generation++;
+  pthread_cond_broadcast(&moved);
+}
+
+/**
+ * wait for every hart still running to reach the end of this quantum
+ **/
+static void hart_sync(void)
+{
+  pthread_mutex_lock(&lock);
+  uint64_t gen = generation;
+  if (++arrived == active)
+    next_generation();
+  else
+    while (gen == generation)
+      pthread_cond_wait(&moved, &lock);
+  pthread_mutex_unlock(&lock);
+}
+
+/**
+ * leave the quantum barrier at the ecall, then wait for the other harts to
+ * reach theirs
+ **/
+static void hart_finish(void)
+{
+  pthread_mutex_lock(&lock);
+  active--;
+  if (arrived && arrived == active)
+    next_generation();
+  else if (active == 0)
+    pthread_cond_broadcast(&moved);
+  while (active > 0)
+    pthread_cond_wait(&moved, &lock);
+  pthread_mutex_unlock(&lock);
+}
+
+void hart_run(regfile_t* regfile_p, memory_t* memory_p, Cache* cache_p,
+              pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, int cycles)
+{
+  bool ecall_exit = false;
+  cycle_fn_t cycle_pipeline = select_cycle_pipeline();
+  uint64_t next_sync = (num_harts > 1) ? quantum : UINT64_MAX;
+
+  for (int simins = 0; (cycles < 0) ? !ecall_exit : simins < cycles; simins++) {
+    cycle_pipeline(regfile_p, memory_p, cache_p, pregs_p, pwires_p, &ecall_exit);
+    // a MEM stall may take the hart past more than one quantum
+    while (num_harts > 1 && hart_clock() >= next_sync) {
+      hart_sync();
+      next_sync += quantum;
+    }
+  }
+  if (num_harts > 1) {
+    // the stores older than the ecall are past MEM; the ones still in the
+    // store buffer reach memory now, another hart may be waiting for them
+    sb_drain(&store_buffer, memory_p, cache_p);
+    hart_finish();
+  }
+
+  if (hart_id == 0)
+    trace_text("\n========\n[MAIN]: Flushing pipeline\n========\n");
+  // a deeper pipeline needs more NOPs behind the program to drain
+  pthread_mutex_lock(&lock);
+  int drain = load_flush(memory_p, pwires_p->pc_src0, pipeline_depth());
+  pthread_mutex_unlock(&lock);
+  for (int simins = 0; simins < drain; simins++)
+    cycle_pipeline(regfile_p, memory_p, cache_p, pregs_p, pwires_p, &ecall_exit);
+  // stores still waiting in the store buffer reach memory
+  sb_drain(&store_buffer, memory_p, cache_p);
+}
+
+static void collect(hart_t* hart)
+{
+  hart->cycles       = hart_clock();
+  hart->instructions = cpi_cycles[CPI_BASE];
+  hart->stalls       = stall_counter;
+  hart->cache_misses = miss_count;
+  hart->atomics      = amo_counter;
+  hart->sc_failures  = sc_fail_counter;
+}
+
+static void* hart_main(void* arg)
+{
+  hart_t* hart = arg;
+  hart_id = hart->id;
+  cacheSetUp(&hart->cache, "L1");
+  if (sim_config.cache_en)
+    coh_attach(&hart->cache);
+  bootstrap(&hart->pwires, &hart->pregs, &hart->regfile);
+  hart_run(&hart->regfile, hart->memory, &hart->cache, &hart->pregs,
+           &hart->pwires, run_cycles);
+  collect(hart);
+  return NULL;
+}
+
+void harts_start(hart_t* harts, int n, uint64_t q, int cycles)
+{
+  num_harts = n;
+  quantum = q;
+  active = n;
+  run_cycles = cycles;
+  if (n > 1)
+    amo_share();
+  for (int i = 1; i < n; i++) {
+    if (pthread_create(&harts[i].thread, NULL, hart_main, &harts[i]) != 0) {
+      fprintf(stderr, "Cannot start a thread for hart %d\n", i);
+      exit(-1);
+    }
+  }
+}
+
+void harts_join(hart_t* harts, int n)
+{
+  for (int i = 1; i < n; i++)
+    pthread_join(harts[i].thread, NULL);
+  collect(&harts[0]);
+}
+
+void harts_print(const hart_t* harts, int n)
+{
+  uint64_t cycles = 0;
+  for (int i = 0; i < n; i++) {
+    const hart_t* h = &harts[i];
+    printf("#Hart %-2d cycles     = %5lu, instructions = %5lu, CPI = %.3f, stalls = %lu, cache misses = %lu\n",
+           i, h->cycles, h->instructions,
+           (h->instructions) ? (double)h->cycles / h->instructions : 0.0,
+           h->stalls, h->cache_misses);
+    if (h->atomics)
+      printf("#Hart %-2d atomics    = %5lu, sc failures = %lu\n", i, h->atomics, h->sc_failures);
+    if (h->cycles > cycles)
+      cycles = h->cycles;
+  }
+  if (sim_config.cache_en)
+    coh_print_stats(cycles);
+}
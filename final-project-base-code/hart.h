@@ -0,0 +1,74 @@
+#ifndef HART_H
+#define HART_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "types.h"
+#include "riscv.h"
+#include "cache.h"
+#include "pipeline.h"
+
+/**
+ * Multi-hart simulation (--harts N): every hart is a pipeline of its own,
+ * with its own registers, pipeline registers, store buffer, fetch unit,
+ * L1 and counters, running on a host thread of its own. The harts share
+ * the guest memory through views of it (mem_view) and start at the same
+ * entry point; a program tells them apart by reading mhartid. Each hart
+ * gets its own HART_STACK_SIZE bytes of stack below the usual one.
+ *
+ * The harts run `quantum` cycles apart at most: every `quantum` cycles of
+ * its hart_clock(), MEM stalls included, a hart waits until the others got
+ * that far too. A hart that has reached
+ * its ecall stops taking part. The memory drain sequence is only written
+ * once every hart has reached its ecall, so it never lands on code another
+ * hart still runs.
+ *
+ * Hart 0 runs on the main thread and is the one the usual stats report;
+ * the pipeline state behind them is HART_LOCAL.
+ **/
+
+#define MAX_HARTS         16
+#define HART_STACK_SIZE   0x10000
+#define HART_DEFAULT_QUANTUM 1000
+
+typedef struct {
+  Word             id;
+  regfile_t        regfile;
+  pipeline_regs_t  pregs;
+  pipeline_wires_t pwires;
+  memory_t*        memory;      // view of the shared memory
+  Cache            cache;
+  pthread_t        thread;
+  // counters of the hart, copied when it has drained
+  uint64_t         cycles;      // hart_clock()
+  uint64_t         instructions;
+  uint64_t         stalls;
+  uint64_t         cache_misses;
+  uint64_t         atomics;
+  uint64_t         sc_failures;
+} hart_t;
+
+/**
+ * run the pipeline of the calling thread's hart: to its ecall when
+ * `cycles` < 0, `cycles` cycles otherwise, then drain it
+ **/
+void hart_run(regfile_t* regfile_p, memory_t* memory_p, Cache* cache_p,
+              pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, int cycles);
+
+/**
+ * start harts 1..n-1 on host threads of their own, each running `cycles`
+ * as hart_run() does; hart 0 is left to the caller's thread
+ **/
+void harts_start(hart_t* harts, int n, uint64_t quantum, int cycles);
+
+/**
+ * wait for harts 1..n-1 to drain
+ **/
+void harts_join(hart_t* harts, int n);
+
+/**
+ * one line of counters per hart
+ **/
+void harts_print(const hart_t* harts, int n);
+
+#endif // HART_H
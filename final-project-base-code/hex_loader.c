@@ -0,0 +1,171 @@
+//hex_loader.c
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "riscv.h"
+#include "utils.h"
+#include "hex_loader.h"
+
+#define HEX_LINE_MAX   50     // longest line the strtol path parses
+#define FLUSH_FILE     "./code/input/FLUSH.input"
+#define FLUSH_NOPS     5      // drain sequence used when the file is missing
+
+/**
+ * decode 8 ASCII hex digits, most significant first. Returns false if one
+ * of them is not a hex digit.
+ **/
+static inline bool decode_hex8(const char* p, uint32_t* value_p)
+{
+#ifdef __SSE2__
+  __m128i c     = _mm_loadl_epi64((const __m128i*)p);
+  __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+  __m128i alpha = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+  // unsigned x <= n  <=>  min(x, n) == x
+  __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+  __m128i is_alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, _mm_set1_epi8(5)), alpha);
+  if ((_mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha)) & 0xFF) != 0xFF)
+    return false;
+  __m128i nibble = _mm_or_si128(_mm_and_si128(is_digit, digit),
+                                _mm_and_si128(is_alpha, _mm_add_epi8(alpha, _mm_set1_epi8(10))));
+  // pairs of nibbles to bytes, then the 4 bytes are the word most
+  // significant byte first
+  __m128i bytes = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(nibble, _mm_set1_epi16(0xFF)), 4),
+                               _mm_srli_epi16(nibble, 8));
+  bytes = _mm_packus_epi16(bytes, bytes);
+  *value_p = __builtin_bswap32((uint32_t)_mm_cvtsi128_si32(bytes));
+  return true;
+#else
+  uint32_t value = 0;
+  for (int i = 0; i < 8; i++) {
+    char ch = p[i];
+    uint32_t nibble;
+    if (ch >= '0' && ch <= '9')      nibble = ch - '0';
+    else if (ch >= 'a' && ch <= 'f') nibble = ch - 'a' + 10;
+    else if (ch >= 'A' && ch <= 'F') nibble = ch - 'A' + 10;
+    else return false;
+    value = (value << 4) | nibble;
+  }
+  *value_p = value;
+  return true;
+#endif
+}
+
+/**
+ * value of one line: "0x" and 8 digits or just 8 digits take the fast
+ * path, anything else is read with strtol
+ **/
+static uint32_t parse_line(const char* p, size_t len)
+{
+  uint32_t value;
+  const char* digits = p;
+  size_t n = len;
+
+  if (n > 0 && p[n-1] == '\r')
+    n--;
+  if (n == 10 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+    digits += 2;
+    n -= 2;
+  }
+  if (n == 8 && decode_hex8(digits, &value))
+    return value;
+
+  char line[HEX_LINE_MAX];
+  n = (len < HEX_LINE_MAX - 1) ? len : HEX_LINE_MAX - 1;
+  memcpy(line, p, n);
+  line[n] = '\0';
+  return (uint32_t)strtol(line, NULL, 16);
+}
+
+/**
+ * place one word per line of `text` at consecutive addresses from `startaddr`
+ **/
+static int parse_program(const char* text, size_t size, memory_t* mem,
+                         Address startaddr, int disasm)
+{
+  const char* p = text;
+  const char* end = text + size;
+  int programsize = 0;
+
+  while (p < end) {
+    const char* nl = memchr(p, '\n', end - p);
+    size_t len = (nl) ? (size_t)(nl - p) : (size_t)(end - p);
+    Address address = startaddr + 4 * programsize;
+    uint32_t instruction = parse_line(p, len);
+    store(mem, address, LENGTH_WORD, instruction);
+    programsize++;
+
+    if (disasm) {
+      printf("%08x: ", address);
+      decode_instruction(instruction);
+    }
+    p += len + 1;
+  }
+  return programsize;
+}
+
+int load_program(memory_t* mem, Address startaddr, const char* filename,
+                 int disasm)
+{
+  int fd = open(filename, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    perror(filename);
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+  // the SSE decoder reads 8 bytes at a time, which never passes the end of
+  // a line it decodes
+  const char* text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (text == MAP_FAILED) {
+    perror(filename);
+    return -1;
+  }
+  madvise((void*)text, st.st_size, MADV_SEQUENTIAL);
+  int programsize = parse_program(text, st.st_size, mem, startaddr, disasm);
+  munmap((void*)text, st.st_size);
+  return programsize;
+}
+
+int load_flush(memory_t* mem, Address startaddr, int min_words)
+{
+  static uint32_t* flush_seq;
+  static int       flush_words = -1;
+
+  if (flush_words < 0) {
+    // parsed into a scratch memory of its own, then kept as a word array
+    memory_t* scratch = mem_create(MEMORY_SPACE);
+    flush_words = load_program(scratch, 0, FLUSH_FILE, 0);
+    if (flush_words > 0) {
+      flush_seq = malloc(4 * flush_words);
+      mem_read(scratch, 0, flush_seq, 4 * flush_words);
+    } else {
+      fprintf(stderr, "Cannot read %s, draining with NOPs\n", FLUSH_FILE);
+      flush_seq = malloc(4 * FLUSH_NOPS);
+      for (flush_words = 0; flush_words < FLUSH_NOPS; flush_words++)
+        flush_seq[flush_words] = 0x00000013;
+    }
+    mem_destroy(scratch);
+  }
+
+  int loaded = 0;
+  do {
+    mem_write(mem, startaddr + 4 * loaded, flush_seq, 4 * flush_words);
+    loaded += flush_words;
+  } while (loaded < min_words);
+  return loaded;
+}
@@ -0,0 +1,23 @@
+#ifndef HEX_LOADER_H
+#define HEX_LOADER_H
+
+#include <stddef.h>
+#include "types.h"
+#include "guest_mem.h"
+
+/**
+ * Loader of .input programs: one hex instruction word per line, optionally
+ * with a 0x prefix, placed at consecutive words from `startaddr`. Returns
+ * the number of words loaded, -1 if the file cannot be read.
+ **/
+int load_program(memory_t* mem, Address startaddr, const char* filename,
+                 int disasm);
+
+/**
+ * load the pipeline drain sequence (./code/input/FLUSH.input) at
+ * `startaddr`, repeated until it is at least `min_words` long. The file is
+ * only read once, returns the number of words loaded.
+ **/
+int load_flush(memory_t* mem, Address startaddr, int min_words);
+
+#endif // HEX_LOADER_H
@@ -0,0 +1,110 @@
+//host_stats.c
+#include <stdio.h>
+#include <time.h>
+#include "host_stats.h"
+
+bool     host_stats_en;
+HART_LOCAL bool     hs_timing;
+HART_LOCAL uint64_t hs_next_sample;
+HART_LOCAL uint64_t hs_ticks[HS_NUM_REGIONS];
+HART_LOCAL uint64_t hs_switches[HS_NUM_REGIONS];
+HART_LOCAL uint64_t hs_last;
+HART_LOCAL uint8_t  hs_region;
+
+static struct timespec wall_start, wall_stop;
+static int      hs_period = HS_DEFAULT_PERIOD;
+static HART_LOCAL uint64_t hs_samples;             // cycles timed
+static double   hs_switch_cost;         // ticks hs_switch() adds to a region
+static HART_LOCAL uint32_t hs_rand = 0x2545F491;   // xorshift state for the intervals
+
+static const char* const hs_names[HS_NUM_REGIONS] = {
+  [HS_OTHER]  = "other",
+  [HS_HAZARD] = "hazard/fwd",
+  [HS_IF]     = "stage_fetch",
+  [HS_ID]     = "stage_decode",
+  [HS_EX]     = "stage_execute",
+  [HS_MEM]    = "stage_mem",
+  [HS_WB]     = "stage_writeback",
+  [HS_DECODE] = "decode",
+  [HS_CACHE]  = "operateCache",
+  [HS_TRACE]  = "trace",
+  [HS_COSIM]  = "cosim",
+};
+
+void hs_start(int period)
+{
+  hs_period = period;
+  hs_next_sample = 0;
+  // every switch charges one counter read to the region it leaves
+  uint64_t t0 = hs_now();
+  for (int i = 0; i < 1000; i++)
+    hs_switch(HS_OTHER);
+  hs_switch_cost = (double)(hs_now() - t0) / 1000;
+  hs_ticks[HS_OTHER] = hs_switches[HS_OTHER] = 0;
+  clock_gettime(CLOCK_MONOTONIC, &wall_start);
+}
+
+void hs_stop(void)
+{
+  clock_gettime(CLOCK_MONOTONIC, &wall_stop);
+}
+
+void hs_sample_begin(void)
+{
+  hs_timing = true;
+  hs_region = HS_OTHER;
+  hs_last = hs_now();
+}
+
+/**
+ * close the timed cycle, the next one is 1 to 2*period-1 cycles later
+ **/
+void hs_sample_end(uint64_t cycle)
+{
+  hs_switch(HS_OTHER);
+  hs_timing = false;
+  hs_samples++;
+  hs_rand ^= hs_rand << 13;
+  hs_rand ^= hs_rand >> 17;
+  hs_rand ^= hs_rand << 5;
+  hs_next_sample = cycle + hs_rand % (2 * hs_period - 1);
+}
+
+/**
+ * `count` per host second, scaled to K or M
+ **/
+static void print_rate(const char* what, uint64_t count, double seconds)
+{
+  double rate = (seconds > 0) ? count / seconds : 0.0;
+  if (rate >= 1e6)
+    printf("#Host %-15s = %8.3f M\n", what, rate / 1e6);
+  else
+    printf("#Host %-15s = %8.3f K\n", what, rate / 1e3);
+}
+
+void hs_print(uint64_t cycles, uint64_t instructions, bool pipeline)
+{
+  double seconds = (wall_stop.tv_sec - wall_start.tv_sec)
+                 + (wall_stop.tv_nsec - wall_start.tv_nsec) / 1e9;
+  printf("#Host %-15s = %8.3f s\n", "wall time", seconds);
+  print_rate("instructions/s", instructions, seconds);
+  if (!pipeline)
+    return;
+  print_rate("cycles/s", cycles, seconds);
+  printf("#Host %-15s = %8lu (1 in %d)\n", "cycles timed", hs_samples, hs_period);
+
+  double ticks[HS_NUM_REGIONS], total = 0;
+  for (int i = 0; i < HS_NUM_REGIONS; i++) {
+    ticks[i] = hs_ticks[i] - hs_switches[i] * hs_switch_cost;
+    if (ticks[i] < 0)
+      ticks[i] = 0;
+    total += ticks[i];
+  }
+  // the ticks of the timed cycles only give the shares, the wall clock
+  // time of the whole run is split in proportion
+  for (int i = 0; i < HS_NUM_REGIONS; i++) {
+    double share = (total) ? ticks[i] / total : 0.0;
+    printf("#Host %-15s = %8.1f ns/cycle (%.1f%%)\n", hs_names[i],
+           (cycles) ? share * seconds * 1e9 / cycles : 0.0, 100.0 * share);
+  }
+}
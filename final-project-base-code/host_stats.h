@@ -0,0 +1,96 @@
+#ifndef HOST_STATS_H
+#define HOST_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "riscv.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/**
+ * Host-side throughput of the simulator itself (--host-stats[=N]): the
+ * wall time of the run, simulated instructions and cycles per host second,
+ * and where the host time of the pipeline goes.
+ *
+ * The host time of a cycle is split into regions. The simulator is always
+ * in exactly one of them; hs_switch() charges the ticks since the last
+ * switch to the region it leaves, so a region entered from inside another
+ * one (decode inside IF and ID, operateCache inside MEM or the store
+ * buffer) is not counted twice.
+ *
+ * Reading the timestamp counter costs about as much as a small stage, so
+ * only one cycle in N on average (32 by default, at random intervals so
+ * that loops do not alias with it) is timed; the wall clock covers the
+ * whole run and scales the shares. The cost of a counter read is measured
+ * once and taken off every region it was charged to. Only the
+ * cycle_pipeline() variants built with HOST_STATS carry the timing code.
+ * With --harts, every hart times its own cycles and hart 0 is reported.
+ **/
+typedef enum {
+  HS_OTHER,       // stage registers, sub-stages, store buffer drain
+  HS_HAZARD,      // gen_forward, detect_hazard
+  HS_IF,          // stage_fetch, fetch queue
+  HS_ID,          // stage_decode
+  HS_EX,          // stage_execute
+  HS_MEM,         // stage_mem
+  HS_WB,          // stage_writeback
+  HS_DECODE,      // parse_instruction, gen_control, gen_imm
+  HS_CACHE,       // operateCache
+  HS_TRACE,       // traces, profile, pipeline view, stats samples
+  HS_COSIM,       // lockstep emulator
+  HS_NUM_REGIONS
+} hs_region_t;
+
+#define HS_DEFAULT_PERIOD 32
+
+extern bool     host_stats_en;
+extern HART_LOCAL bool     hs_timing;          // the current cycle is timed
+extern HART_LOCAL uint64_t hs_next_sample;     // cycle to time next
+extern HART_LOCAL uint64_t hs_ticks[HS_NUM_REGIONS];
+extern HART_LOCAL uint64_t hs_switches[HS_NUM_REGIONS];
+extern HART_LOCAL uint64_t hs_last;
+extern HART_LOCAL uint8_t  hs_region;
+
+/**
+ * timestamp counter on x86, nanoseconds elsewhere; either way only the
+ * ratios between regions are used, the wall clock gives the seconds
+ **/
+static inline uint64_t hs_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/**
+ * leave the current region for `region`, returns the one left
+ **/
+static inline int hs_switch(int region)
+{
+  uint64_t now = hs_now();
+  int prev = hs_region;
+  hs_ticks[prev] += now - hs_last;
+  hs_switches[prev]++;
+  hs_last = now;
+  hs_region = region;
+  return prev;
+}
+
+// regions entered from code shared by every cycle_pipeline() variant
+#define HS_ENTER(region)  ((hs_timing) ? hs_switch(region) : 0)
+#define HS_LEAVE(prev)    do { if (hs_timing) hs_switch(prev); } while (0)
+
+void hs_start(int period);
+void hs_stop(void);
+void hs_sample_begin(void);
+void hs_sample_end(uint64_t cycle);
+void hs_print(uint64_t cycles, uint64_t instructions, bool pipeline);
+
+#endif // HOST_STATS_H
@@ -6,20 +6,71 @@
 #include "utils.h"
 #include "pipeline.h"
 #include "stage_helpers.h"
-
-uint64_t total_cycle_counter = 0;
-uint64_t miss_count = 0;
-uint64_t hit_count = 0;
-uint64_t stall_counter = 0;
-uint64_t branch_counter = 0;
-uint64_t fwd_exex_counter = 0;
-uint64_t fwd_exmem_counter = 0;
-uint64_t mem_access_counter = 0;
+#include "trace.h"
+#include "cosim.h"
+#include "profile.h"
+#include "cpi_stack.h"
+#include "pipeview.h"
+#include "stats.h"
+#include "csr.h"
+#include "host_stats.h"
+#include "coherence.h"
+#include "atomic.h"
+
+HART_LOCAL uint64_t total_cycle_counter = 0;
+HART_LOCAL uint64_t miss_count = 0;
+HART_LOCAL uint64_t hit_count = 0;
+HART_LOCAL uint64_t mem_miss_counter = 0;
+HART_LOCAL uint64_t stall_counter = 0;
+HART_LOCAL uint64_t branch_counter = 0;
+HART_LOCAL uint64_t fwd_exex_counter = 0;
+HART_LOCAL uint64_t fwd_exmem_counter = 0;
+HART_LOCAL uint64_t fwd_memex_counter = 0;
+HART_LOCAL uint64_t fwd_memmem_counter = 0;
+HART_LOCAL uint64_t stall_removed_counter = 0;
+HART_LOCAL uint64_t mem_access_counter = 0;
+HART_LOCAL uint64_t misaligned_counter = 0;
+HART_LOCAL uint64_t misaligned_stall_counter = 0;
+HART_LOCAL uint64_t coherence_stall_counter = 0;
+HART_LOCAL uint64_t dcache_stall_counter = 0;
+HART_LOCAL uint64_t sb_stall_counter = 0;
+HART_LOCAL uint64_t amo_counter = 0;
+HART_LOCAL uint64_t sc_fail_counter = 0;
+HART_LOCAL uint64_t amo_stall_counter = 0;
 
 simulator_config_t sim_config = {0};
+HART_LOCAL store_buffer_t store_buffer;
+HART_LOCAL fetch_unit_t fetch_unit;
+
+static HART_LOCAL uint64_t fetch_seq = 0;   // numbers the fetched instructions
+static HART_LOCAL uint64_t mem_stall_counter = 0;          // the "#MEM stalls"
+static HART_LOCAL uint64_t mem_hold_left[CPI_NUM_CAUSES];  // cycles MEM still holds the pipeline
 
 ///////////////////////////////////////////////////////////////////////////////
 
+static void register_stats(void)
+{
+  stats_add_u64("cycles", "simulated cycles", &total_cycle_counter);
+  stats_add_u64("branches_taken", "taken branches and jumps, each flushes the pipeline", &branch_counter);
+  stats_add_u64("stalls", "load-use stall cycles", &stall_counter);
+  stats_add_u64("stalls_removed", "load-use stalls the MEM forwarding made unnecessary", &stall_removed_counter);
+  stats_add_u64("forwards.ex_ex", "operands forwarded from EX/MEM", &fwd_exex_counter);
+  stats_add_u64("forwards.ex_mem", "operands forwarded from MEM/WB", &fwd_exmem_counter);
+  stats_add_u64("forwards.mem_ex", "load data forwarded from the split MEM stage", &fwd_memex_counter);
+  stats_add_u64("forwards.mem_mem", "load data forwarded into a store", &fwd_memmem_counter);
+  stats_add_u64("mem_accesses", "loads, stores and atomics MEM sent to the data memory", &mem_access_counter);
+  stats_add_u64("misaligned", "misaligned loads and stores", &misaligned_counter);
+  stats_add_u64("misaligned_stalls", "cycles charged for misaligned accesses", &misaligned_stall_counter);
+  stats_add_u64("mem_misses", "L1 misses of the MEM stage's own accesses, drains aside", &mem_miss_counter);
+  stats_add_u64("dcache_stalls", "cycles MEM accesses spent in the data cache or memory beyond one", &dcache_stall_counter);
+  stats_add_u64("coherence_stalls", "cycles MEM accesses spent on the coherence bus", &coherence_stall_counter);
+  stats_add_u64("atomics", "lr.w, sc.w and amo*.w instructions", &amo_counter);
+  stats_add_u64("sc_failures", "sc.w that found no reservation and did not store", &sc_fail_counter);
+  stats_add_u64("atomic_stalls", "cycles charged for amo*.w and sc.w", &amo_stall_counter);
+  stats_add_fn("mem_stalls", "cycles the data memory accesses would cost", mem_stall_cycles);
+  cpi_register_stats();
+}
+
 void bootstrap(pipeline_wires_t* pwires_p, pipeline_regs_t* pregs_p, regfile_t* regfile_p)
 {
   // PC src must get the same value as the default PC value
@@ -28,23 +79,85 @@ void bootstrap(pipeline_wires_t* pwires_p, pipeline_regs_t* pregs_p, regfile_t*
 
   pwires_p->fwdA    = FWD_REG;
   pwires_p->fwdB    = FWD_REG;
+  pwires_p->fwdS    = false;
   pwires_p->stall   = false;
   pwires_p->flush   = false;
+
+  sb_init(&store_buffer, sim_config.sb_entries);
+  fq_init(&fetch_unit, sim_config.fq_entries, sim_config.lb_words, regfile_p->PC);
+  register_stats();
+}
+
+int pipeline_depth(void)
+{
+  // ID and WB are never split
+  return sim_config.if_stages + 1 + sim_config.ex_stages + sim_config.mem_stages + 1;
+}
+
+uint64_t mem_stall_cycles(void)
+{
+  return mem_stall_counter;
+}
+
+uint64_t hart_clock(void)
+{
+  return total_cycle_counter + mem_stall_cycles();
+}
+
+/**
+ * `cycles` the data memory would cost MEM, counted in `counter` and in the
+ * "#MEM stalls". MEM does not wait for them, they are not in #Cycles.
+ **/
+static inline void mem_stall(uint64_t* counter, uint64_t cycles)
+{
+  *counter += cycles;
+  mem_stall_counter += cycles;
+}
+
+/**
+ * MEM holds the pipeline `cycles` cycles for the access it just made,
+ * counted in `counter`. Each of them is a bubble in WB charged to `cause`.
+ **/
+static inline void mem_hold(uint64_t* counter, cpi_cause_t cause, uint64_t cycles)
+{
+  *counter += cycles;
+  mem_hold_left[cause] += cycles;
+}
+
+static inline bool mem_held(void)
+{
+  return mem_hold_left[CPI_DCACHE] || mem_hold_left[CPI_STRUCTURAL];
+}
+
+/**
+ * one cycle of a MEM hold, returns the CPI stack category it goes to
+ **/
+static inline cpi_cause_t mem_hold_cycle(void)
+{
+  cpi_cause_t cause = (mem_hold_left[CPI_DCACHE]) ? CPI_DCACHE : CPI_STRUCTURAL;
+  mem_hold_left[cause]--;
+  return cause;
 }
 
 ///////////////////////////
 /// STAGE FUNCTIONALITY ///
 ///////////////////////////
 
-/**
- * STAGE  : stage_fetch
- * output : ifid_reg_t
- **/ 
-ifid_reg_t stage_fetch(pipeline_wires_t* pwires_p, regfile_t* regfile_p, Byte* memory_p)
+// the decode helpers are timed as HS_DECODE under --host-stats, only by
+// the stage_*_timed() copies the timed cycle_pipeline() variants call:
+// `timed` is a constant, the other stages carry no host timing test
+#define HS_ENTER_IF(timed, region) ((timed) ? HS_ENTER(region) : 0)
+#define HS_LEAVE_IF(timed, prev)   do { if (timed) HS_LEAVE(prev); } while (0)
+
+static inline ifid_reg_t fetch_stage(pipeline_wires_t* pwires_p, regfile_t* regfile_p,
+                                     memory_t* memory_p, bool timed)
 {
   ifid_reg_t ifid_reg = {0};
 
   if (pwires_p->stall) {
+  // the fetch queue keeps filling while IF is stalled
+  if (fetch_unit.size)
+    fq_fill(&fetch_unit, memory_p);
   return (ifid_reg_t){0}; // Output nothing (NOP)
 }
 
@@ -53,57 +166,105 @@ ifid_reg_t stage_fetch(pipeline_wires_t* pwires_p, regfile_t* regfile_p, Byte* m
   if (pwires_p->pcsrc == 1){
     regfile_p->PC = pwires_p->pc_src1;
     pwires_p->pcsrc = 0;
+    if (fetch_unit.size)
+      fq_redirect(&fetch_unit, regfile_p->PC, pwires_p->branch_addr, memory_p);
   }
   else{
     regfile_p->PC = pwires_p->pc_src0;
   }
 
-  // Fetch instruction from memory
-  uint32_t instruction_bits = *(uint32_t*)(memory_p + regfile_p->PC);
+  // Fetch instruction from memory, or from the fetch queue in front of it
+  uint32_t instruction_bits;
+  if (fetch_unit.size) {
+    fq_fill(&fetch_unit, memory_p);
+    if (!fq_pop(&fetch_unit, regfile_p->PC, &instruction_bits)) {
+      // fetch starved: send a bubble and ask for the same PC next cycle
+      pwires_p->pc_src0 = regfile_p->PC;
+      return (ifid_reg_t){.bubble = CPI_IFETCH};
+    }
+  } else {
+    instruction_bits = mem_fetch(memory_p, regfile_p->PC);
+  }
+  // a deeper pipeline fetches past the NOPs behind the ecall before it
+  // retires, so unloaded (zero) words are fetched as NOPs
+  if (instruction_bits == 0) instruction_bits = 0x00000013;
+  int hs_prev = HS_ENTER_IF(timed, HS_DECODE);
   ifid_reg.instr = parse_instruction(instruction_bits);
-
-  #ifdef DEBUG_CYCLE
-  printf("[IF ]: Instruction [%08x]@[%08x]: ", instruction_bits, regfile_p->PC);
-  decode_instruction(instruction_bits);
-  #endif
+  HS_LEAVE_IF(timed, hs_prev);
+  ifid_reg.instr_bits = instruction_bits;
   
   ifid_reg.instr_addr = regfile_p->PC;
+  ifid_reg.seq = ++fetch_seq;
   pwires_p->pc_src0 = regfile_p->PC + 4;  // Next sequential PC
   
   return ifid_reg;
 }
 
 /**
- * STAGE  : stage_decode
- * output : idex_reg_t
+ * STAGE  : stage_fetch
+ * output : ifid_reg_t
  **/ 
-idex_reg_t stage_decode(ifid_reg_t ifid_reg, pipeline_wires_t* pwires_p, regfile_t* regfile_p)
+ifid_reg_t stage_fetch(pipeline_wires_t* pwires_p, regfile_t* regfile_p, memory_t* memory_p)
+{
+  return fetch_stage(pwires_p, regfile_p, memory_p, false);
+}
+
+static ifid_reg_t stage_fetch_timed(pipeline_wires_t* pwires_p, regfile_t* regfile_p,
+                                    memory_t* memory_p)
+{
+  return fetch_stage(pwires_p, regfile_p, memory_p, true);
+}
+
+static inline idex_reg_t decode_stage(ifid_reg_t ifid_reg, pipeline_wires_t* pwires_p,
+                                      regfile_t* regfile_p, bool timed)
 {
   idex_reg_t idex_reg = {0};
   
   // Generate control signals
+  int hs_prev = HS_ENTER_IF(timed, HS_DECODE);
   idex_reg = gen_control(ifid_reg.instr);
+  HS_LEAVE_IF(timed, hs_prev);
   
   // Read register file
   idex_reg.Read_Data_1 = regfile_p->R[ifid_reg.instr.rtype.rs1];
   idex_reg.Read_Data_2 = regfile_p->R[ifid_reg.instr.rtype.rs2];
+
+  // the write from WB in this same cycle happens in the first half
+  if (pwires_p->wb_RegWrite && pwires_p->wb_rd != 0) {
+    if (pwires_p->wb_rd == ifid_reg.instr.rtype.rs1)
+      idex_reg.Read_Data_1 = pwires_p->wb_data;
+    if (pwires_p->wb_rd == ifid_reg.instr.rtype.rs2)
+      idex_reg.Read_Data_2 = pwires_p->wb_data;
+  }
   
   // Generate immediate
+  hs_prev = HS_ENTER_IF(timed, HS_DECODE);
   idex_reg.imm_gen_out = gen_imm(ifid_reg.instr);
+  HS_LEAVE_IF(timed, hs_prev);
   
   // Pass through instruction address
   idex_reg.instr_addr = ifid_reg.instr_addr;
-  
-  uint32_t instruction_bits = idex_reg.instr.bits;
-  
-  #ifdef DEBUG_CYCLE
-  printf("[ID ]: Instruction [%08x]@[%08x]: ", instruction_bits, idex_reg.instr_addr);
-  decode_instruction(instruction_bits);
-  #endif
+  idex_reg.bubble = ifid_reg.bubble;
+  idex_reg.seq = ifid_reg.seq;
   
   return idex_reg;
 }
 
+/**
+ * STAGE  : stage_decode
+ * output : idex_reg_t
+ **/ 
+idex_reg_t stage_decode(ifid_reg_t ifid_reg, pipeline_wires_t* pwires_p, regfile_t* regfile_p)
+{
+  return decode_stage(ifid_reg, pwires_p, regfile_p, false);
+}
+
+static idex_reg_t stage_decode_timed(ifid_reg_t ifid_reg, pipeline_wires_t* pwires_p,
+                                     regfile_t* regfile_p)
+{
+  return decode_stage(ifid_reg, pwires_p, regfile_p, true);
+}
+
 /**
  * STAGE  : stage_execute
  * output : exmem_reg_t
@@ -115,6 +276,8 @@ exmem_reg_t stage_execute(idex_reg_t idex_reg, pipeline_wires_t* pwires_p, pipel
  
   exmem_reg.instr_addr = idex_reg.instr_addr;
   exmem_reg.instr = idex_reg.instr;
+  exmem_reg.bubble = idex_reg.bubble;
+  exmem_reg.seq = idex_reg.seq;
   
 
   exmem_reg.add_sum_output = idex_reg.imm_gen_out + idex_reg.instr_addr;
@@ -135,6 +298,12 @@ exmem_reg_t stage_execute(idex_reg_t idex_reg, pipeline_wires_t* pwires_p, pipel
                ? pregs_p->memwb_preg.out.Read_Data
                : pregs_p->memwb_preg.out.ALU_result;
       break;
+    case FWD_MEM:
+      alu_src1 = pwires_p->mem_load_data;
+      break;
+    case FWD_SUBSTAGE:
+      alu_src1 = pwires_p->fwdA_data;
+      break;
     default:
       alu_src1 = idex_reg.Read_Data_1;
       break;
@@ -149,116 +318,216 @@ exmem_reg_t stage_execute(idex_reg_t idex_reg, pipeline_wires_t* pwires_p, pipel
                ? pregs_p->memwb_preg.out.Read_Data
                 : pregs_p->memwb_preg.out.ALU_result;
     break;
+    case FWD_MEM:
+    alu_src2 = pwires_p->mem_load_data;
+    break;
+    case FWD_SUBSTAGE:
+    alu_src2 = pwires_p->fwdB_data;
+    break;
     default:
     alu_src2 = idex_reg.Read_Data_2;
     break;
 }
 
 
+uint32_t alu_operand1 = (idex_reg.EX_ALUSrcA == 1) ? idex_reg.instr_addr : alu_src1;
 uint32_t alu_operand2 = (idex_reg.EX_ALUSrc == 1) ? idex_reg.imm_gen_out : alu_src2;
 
 
-exmem_reg.ALU_result = execute_alu(alu_src1, alu_operand2, ALUcontrol);
+exmem_reg.ALU_result = execute_alu(alu_operand1, alu_operand2, ALUcontrol);
+// a CSR instruction or an atomic takes rs1 to MEM, where the CSR or memory
+// is read and written
+if (idex_reg.M_CSR || idex_reg.M_Atomic) {
+  exmem_reg.ALU_result = alu_src1;
+}
 
   
-  // Pass through Read_Data_2 for store operations
-  exmem_reg.Read_Data_2 = idex_reg.Read_Data_2;
+  // Pass through Read_Data_2 for store operations (after forwarding)
+  exmem_reg.Read_Data_2 = alu_src2;
   
   // Pass through control signals
   exmem_reg.M_Branch = idex_reg.M_Branch;
   exmem_reg.M_JAL = idex_reg.M_JAL;
+  exmem_reg.M_JALR = idex_reg.M_JALR;
   exmem_reg.WB_WBSRC = idex_reg.WB_WBSRC;
   exmem_reg.M_MemRead = idex_reg.M_MemRead;
   exmem_reg.M_MemWrite = idex_reg.M_MemWrite;
+  exmem_reg.M_CSR = idex_reg.M_CSR;
+  exmem_reg.M_Atomic = idex_reg.M_Atomic;
   exmem_reg.WB_RegWrite = idex_reg.WB_RegWrite;
   exmem_reg.WB_MemToReg = idex_reg.WB_MemToReg;
   
   // Set Zero flag
   exmem_reg.Zero = !exmem_reg.ALU_result;
   
-  uint32_t instruction_bits = exmem_reg.instr.bits;
-  
-  #ifdef DEBUG_CYCLE
-  printf("[EX ]: Instruction [%08x]@[%08x]: ", instruction_bits, exmem_reg.instr_addr);
-  decode_instruction(instruction_bits);
-  #endif
-  
   return exmem_reg;
 }
 
+int dcache_access(Address address, bool write, Cache* cache_p, int* coherence_p)
+{
+  result r;
+  *coherence_p = coh_access(cache_p, address, write, &r, hart_clock());
+  if (r.status == CACHE_HIT)
+    hit_count++;
+  else
+    miss_count++;
+  int latency = (r.status == CACHE_HIT) ? CACHE_HIT_LATENCY : CACHE_MISS_LATENCY;
+  if (sim_config.trace_cache) {
+    char line[64];
+    if (r.status == CACHE_HIT) {
+      snprintf(line, sizeof(line), CACHE_HIT_FORMAT, (unsigned long long)address);
+    } else {
+      snprintf(line, sizeof(line), CACHE_MISS_FORMAT, (unsigned long long)address);
+      trace_text(line);
+      if (r.status != CACHE_EVICT)
+        return latency;
+      snprintf(line, sizeof(line), CACHE_EVICTION_FORMAT, r.victim_block_addr);
+    }
+    trace_text(line);
+  }
+  return latency;
+}
+
+/**
+ * a load, store or atomic of the MEM stage, in the L1 when it is enabled
+ * and straight in memory otherwise. What the cache or memory costs beyond
+ * its one cycle is a MEM stall, the wait for the coherence bus between
+ * harts holds MEM. Its misses are the instruction's own (mem_miss_counter),
+ * unlike the ones of store buffer drains.
+ **/
+static void mem_data_access(Address address, bool write, Cache* cache_p)
+{
+  mem_access_counter++;
+  if (!sim_config.cache_en) {
+    mem_stall(&dcache_stall_counter, (mem_latency > 1) ? mem_latency - 1 : 0);
+    return;
+  }
+  int coherence;
+  uint64_t misses = miss_count;
+  mem_stall(&dcache_stall_counter, dcache_access(address, write, cache_p, &coherence) - 1);
+  mem_hold(&coherence_stall_counter, CPI_STRUCTURAL, coherence);
+  mem_miss_counter += miss_count - misses;
+}
+
+/**
+ * an lr.w, sc.w or amo*.w in MEM, rs1 in ALU_result and rs2 in Read_Data_2.
+ * It orders with the stores before it, so MEM waits for the store buffer
+ * to drain first. The access costs what a load or store does, and the
+ * ones that write (amo*.w, sc.w) hold MEM sim_config.amo_latency cycles
+ * more for the read-modify-write. Returns the value for rd.
+ **/
+static uint32_t mem_atomic(exmem_reg_t exmem_reg, memory_t* memory_p, Cache* cache_p)
+{
+  bool wrote;
+  if (store_buffer.count)
+    mem_hold(&sb_stall_counter, CPI_STRUCTURAL, sb_drain(&store_buffer, memory_p, cache_p));
+  uint32_t rd = amo_execute(exmem_reg.instr, exmem_reg.ALU_result, exmem_reg.Read_Data_2,
+                            memory_p, amo_hart_reservation(), &wrote);
+  amo_counter++;
+  if ((exmem_reg.instr.rtype.funct7 >> 2) != AMO_LR)
+    mem_hold(&amo_stall_counter, CPI_DCACHE, sim_config.amo_latency);
+  if ((exmem_reg.instr.rtype.funct7 >> 2) == AMO_SC && !wrote)
+    sc_fail_counter++;
+  mem_data_access(exmem_reg.ALU_result, wrote, cache_p);
+  return rd;
+}
+
 /**
  * STAGE  : stage_mem
  * output : memwb_reg_t
  **/ 
-memwb_reg_t stage_mem(exmem_reg_t exmem_reg, pipeline_wires_t* pwires_p, Byte* memory_p, Cache* cache_p)
+memwb_reg_t stage_mem(exmem_reg_t exmem_reg, pipeline_wires_t* pwires_p, memory_t* memory_p, Cache* cache_p)
 {
   memwb_reg_t memwb_reg = {0};
   
   // Pass through instruction and address
   memwb_reg.instr = exmem_reg.instr;
   memwb_reg.instr_addr = exmem_reg.instr_addr;
+  memwb_reg.bubble = exmem_reg.bubble;
+  memwb_reg.seq = exmem_reg.seq;
   memwb_reg.ALU_result = exmem_reg.ALU_result;
+
+  // loads and stores not aligned to their width, memory applies the
+  // --misaligned policy to the access itself
+  if ((exmem_reg.M_MemRead || exmem_reg.M_MemWrite || exmem_reg.M_Atomic) &&
+      mem_misaligned(exmem_reg.ALU_result, mem_access_len(exmem_reg.instr))) {
+    misaligned_counter++;
+    mem_hold(&misaligned_stall_counter, CPI_DCACHE, sim_config.misaligned_penalty);
+  }
   
   // Handle memory read operations
   if (exmem_reg.M_MemRead) {
-    if (sim_config.cache_en) {
-      // Cache handling would go here for milestone 2
-    } else {
-      switch (exmem_reg.instr.itype.funct3) {
-        case 0x0: // Load Byte
-          memwb_reg.Read_Data = sign_extend_number(load(memory_p, exmem_reg.ALU_result, LENGTH_BYTE), 8);
-          break;
-        case 0x1: // Load Halfword
-          memwb_reg.Read_Data = sign_extend_number(load(memory_p, exmem_reg.ALU_result, LENGTH_HALF_WORD), 16);
-          break;
-        case 0x2: // Load Word
-          memwb_reg.Read_Data = load(memory_p, exmem_reg.ALU_result, LENGTH_WORD);
-          break;
-        default:
-          printf("Invalid load instruction\n");
-          break;
-      }
-    }
+    memwb_reg.Read_Data = mem_read_data(exmem_reg, memory_p);
+    mem_data_access(exmem_reg.ALU_result, false, cache_p);
+    if (store_buffer.size && load_hits_store_buffer(exmem_reg, memory_p))
+      store_buffer.load_fwds++;
   }
   
+  // CSRs are read and written in MEM, where nothing is speculative any
+  // more: instructions in MEM are never squashed
+  if (exmem_reg.M_CSR) {
+    csr_counters_t now = {
+      .cycle   = total_cycle_counter,
+      .instret = cpi_cycles[CPI_BASE] + pwires_p->csr_older,
+      .events  = {
+        [HPM_CACHE_MISSES]    = cache_p->miss_count,
+        [HPM_LOAD_USE_STALLS] = stall_counter,
+        [HPM_BRANCHES_TAKEN]  = branch_counter,
+        [HPM_FORWARDS]        = fwd_exex_counter + fwd_exmem_counter +
+                                fwd_memex_counter + fwd_memmem_counter,
+      },
+      .hartid  = hart_id,
+    };
+    memwb_reg.Read_Data = csr_execute(exmem_reg.instr, exmem_reg.ALU_result, &now);
+  }
+
+  if (exmem_reg.M_Atomic)
+    memwb_reg.Read_Data = mem_atomic(exmem_reg, memory_p, cache_p);
+
+  // MEM->MEM forwarding: the store data is the value just loaded by the
+  // instruction now in WB
+  if (exmem_reg.M_MemWrite && pwires_p->fwdS) {
+    exmem_reg.Read_Data_2 = pwires_p->store_fwd_data;
+  }
+  memwb_reg.Write_Data = exmem_reg.Read_Data_2;
+
   // Handle memory write operations
-  if (exmem_reg.M_MemWrite) {
-    if (sim_config.cache_en) {
-      // Cache handling would go here for milestone 2
-    } else {
-      switch (exmem_reg.instr.stype.funct3) {
-        case 0x0: // Store Byte
-          store(memory_p, exmem_reg.ALU_result, LENGTH_BYTE, exmem_reg.Read_Data_2);
-          break;
-        case 0x1: // Store Halfword
-          store(memory_p, exmem_reg.ALU_result, LENGTH_HALF_WORD, exmem_reg.Read_Data_2);
-          break;
-        case 0x2: // Store Word
-          store(memory_p, exmem_reg.ALU_result, LENGTH_WORD, exmem_reg.Read_Data_2);
-          break;
-        default:
-          printf("Invalid store instruction\n");
-          break;
-      }
+  if (exmem_reg.M_MemWrite && store_buffer.size) {
+    // the store retires into the store buffer, MEM only waits if it is full
+    mem_hold(&sb_stall_counter, CPI_STRUCTURAL,
+             sb_store(&store_buffer, exmem_reg.ALU_result, mem_access_len(exmem_reg.instr),
+                      exmem_reg.Read_Data_2, memory_p, cache_p));
+  } else if (exmem_reg.M_MemWrite) {
+    mem_data_access(exmem_reg.ALU_result, true, cache_p);
+    switch (exmem_reg.instr.stype.funct3) {
+      case 0x0: // Store Byte
+        amo_store(memory_p, exmem_reg.ALU_result, LENGTH_BYTE, exmem_reg.Read_Data_2);
+        break;
+      case 0x1: // Store Halfword
+        amo_store(memory_p, exmem_reg.ALU_result, LENGTH_HALF_WORD, exmem_reg.Read_Data_2);
+        break;
+      case 0x2: // Store Word
+        amo_store(memory_p, exmem_reg.ALU_result, LENGTH_WORD, exmem_reg.Read_Data_2);
+        break;
+      default:
+        trace_text("Invalid store instruction\n");
+        break;
     }
   }
   
   // Handle PC source selection for branches and jumps
-  pwires_p->pcsrc = (exmem_reg.Zero & exmem_reg.M_Branch) | exmem_reg.M_JAL;
-  pwires_p->pc_src1 = exmem_reg.add_sum_output;
+  pwires_p->pcsrc = gen_branch(exmem_reg) | exmem_reg.M_JAL;
+  // jalr jumps to the register-relative ALU result with bit 0 cleared;
+  // branches and jal use the PC-relative adder output
+  pwires_p->pc_src1 = (exmem_reg.M_JALR) ? (exmem_reg.ALU_result & ~1U)
+                                         : exmem_reg.add_sum_output;
+  pwires_p->branch_addr = exmem_reg.instr_addr;
   
   // Pass through control signals
   memwb_reg.WB_RegWrite = exmem_reg.WB_RegWrite;
   memwb_reg.WB_MemToReg = exmem_reg.WB_MemToReg;
   memwb_reg.WB_WBSRC = exmem_reg.WB_WBSRC;
   
-  uint32_t instruction_bits = memwb_reg.instr.bits;
-  
-  #ifdef DEBUG_CYCLE
-  printf("[MEM]: Instruction [%08x]@[%08x]: ", instruction_bits, memwb_reg.instr_addr);
-  decode_instruction(instruction_bits);
-  #endif
-  
   return memwb_reg;
 }
 
@@ -268,23 +537,8 @@ memwb_reg_t stage_mem(exmem_reg_t exmem_reg, pipeline_wires_t* pwires_p, Byte* m
  **/ 
 void stage_writeback(memwb_reg_t memwb_reg, pipeline_wires_t* pwires_p, regfile_t* regfile_p)
 {
-  // Memory to register mux
-  uint32_t muxout;
-  if (memwb_reg.WB_MemToReg == 1){
-    muxout = memwb_reg.Read_Data;
-  }
-  else{
-    muxout = memwb_reg.ALU_result;
-  }
-  
-  // Write back source mux (for JAL/JALR)
-  uint32_t muxout2;
-  if (memwb_reg.WB_WBSRC == 1){
-    muxout2 = memwb_reg.instr_addr + 4;
-  }
-  else{
-    muxout2 = muxout;
-  }
+  // Memory to register and write back source (JAL/JALR) muxes
+  uint32_t muxout2 = gen_wb_data(memwb_reg);
   
   // Write to register file if RegWrite is enabled
   if (memwb_reg.WB_RegWrite == 1){
@@ -293,105 +547,138 @@ void stage_writeback(memwb_reg_t memwb_reg, pipeline_wires_t* pwires_p, regfile_
   
   // Ensure x0 is always 0
   regfile_p->R[0] = 0;
-  
-  uint32_t instruction_bits = memwb_reg.instr.bits;
-  
-  #ifdef DEBUG_CYCLE
-  printf("[WB ]: Instruction [%08x]@[%08x]: ", instruction_bits, memwb_reg.instr_addr);
-  decode_instruction(instruction_bits);
-  #endif
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-/** 
- * excite the pipeline with one clock cycle
+/**
+ * cycle_pipeline() variants, one per combination of the per-cycle traces
+ * and the host timing, and the lean one without any per-cycle hook
  **/
-void cycle_pipeline(regfile_t* regfile_p, Byte* memory_p, Cache* cache_p, pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, bool* ecall_exit)
-{
-  #ifdef DEBUG_CYCLE
-  printf("v==============");
-  printf("Cycle Counter = %5ld", total_cycle_counter);
-  printf("==============v\n\n");
-  #endif
-
-  // process each stage
+#define CYCLE_FN cycle_pipeline_lean
+#define TRACE_CYCLE 0
+#define TRACE_REGS 0
+#define HOST_STATS 0
+#define HOOKS 0
+#include "pipeline_cycle.h"
+#undef CYCLE_FN
+#undef TRACE_CYCLE
+#undef TRACE_REGS
+#undef HOST_STATS
+#undef HOOKS
+
+#define CYCLE_FN cycle_pipeline_quiet
+#define TRACE_CYCLE 0
+#define TRACE_REGS 0
+#define HOST_STATS 0
+#define HOOKS 1
+#include "pipeline_cycle.h"
+#undef CYCLE_FN
+#undef TRACE_CYCLE
+#undef TRACE_REGS
+#undef HOST_STATS
+#undef HOOKS
+
+#define CYCLE_FN cycle_pipeline_regs
+#define TRACE_CYCLE 0
+#define TRACE_REGS 1
+#define HOST_STATS 0
+#define HOOKS 1
+#include "pipeline_cycle.h"
+#undef CYCLE_FN
+#undef TRACE_CYCLE
+#undef TRACE_REGS
+#undef HOST_STATS
+#undef HOOKS
+
+#define CYCLE_FN cycle_pipeline_stages
+#define TRACE_CYCLE 1
+#define TRACE_REGS 0
+#define HOST_STATS 0
+#define HOOKS 1
+#include "pipeline_cycle.h"
+#undef CYCLE_FN
+#undef TRACE_CYCLE
+#undef TRACE_REGS
+#undef HOST_STATS
+#undef HOOKS
+
+#define CYCLE_FN cycle_pipeline_full
+#define TRACE_CYCLE 1
+#define TRACE_REGS 1
+#define HOST_STATS 0
+#define HOOKS 1
+#include "pipeline_cycle.h"
+#undef CYCLE_FN
+#undef TRACE_CYCLE
+#undef TRACE_REGS
+#undef HOST_STATS
+#undef HOOKS
+
+#define CYCLE_FN cycle_pipeline_quiet_timed
+#define TRACE_CYCLE 0
+#define TRACE_REGS 0
+#define HOST_STATS 1
+#define HOOKS 1
+#include "pipeline_cycle.h"
+#undef CYCLE_FN
+#undef TRACE_CYCLE
+#undef TRACE_REGS
+#undef HOST_STATS
+#undef HOOKS
+
+#define CYCLE_FN cycle_pipeline_regs_timed
+#define TRACE_CYCLE 0
+#define TRACE_REGS 1
+#define HOST_STATS 1
+#define HOOKS 1
+#include "pipeline_cycle.h"
+#undef CYCLE_FN
+#undef TRACE_CYCLE
+#undef TRACE_REGS
+#undef HOST_STATS
+#undef HOOKS
+
+#define CYCLE_FN cycle_pipeline_stages_timed
+#define TRACE_CYCLE 1
+#define TRACE_REGS 0
+#define HOST_STATS 1
+#define HOOKS 1
+#include "pipeline_cycle.h"
+#undef CYCLE_FN
+#undef TRACE_CYCLE
+#undef TRACE_REGS
+#undef HOST_STATS
+#undef HOOKS
+
+#define CYCLE_FN cycle_pipeline_full_timed
+#define TRACE_CYCLE 1
+#define TRACE_REGS 1
+#define HOST_STATS 1
+#define HOOKS 1
+#include "pipeline_cycle.h"
+#undef CYCLE_FN
+#undef TRACE_CYCLE
+#undef TRACE_REGS
+#undef HOST_STATS
+#undef HOOKS
 
-  gen_forward(pregs_p, pwires_p);
-  detect_hazard(pregs_p, pwires_p, regfile_p);
-
-  /* Output               |    Stage      |       Inputs  */
-  pregs_p->ifid_preg.inp  = stage_fetch     (pwires_p, regfile_p, memory_p);
-  
-  pregs_p->idex_preg.inp  = stage_decode    (pregs_p->ifid_preg.out, pwires_p, regfile_p);
-
-  pregs_p->exmem_preg.inp = stage_execute   (pregs_p->idex_preg.out, pwires_p, pregs_p);
-
-  pregs_p->memwb_preg.inp = stage_mem       (pregs_p->exmem_preg.out, pwires_p, memory_p, cache_p);
-
-                            stage_writeback (pregs_p->memwb_preg.out, pwires_p, regfile_p);
-
-  //control hazards
-if (pwires_p->pcsrc == 1) {
-    pregs_p->ifid_preg.out = (ifid_reg_t){0};
-    pregs_p->idex_preg.out = (idex_reg_t){0};
-    pregs_p->idex_preg.out.instr.bits = 0x00000013;  // NOP
-    branch_counter++;
-}
-
-
-  // update all the output registers for the next cycle from the input registers in the current cycle
-// Update IF/ID output (stalling prevents PC and IF/ID register updates)
-if (!pwires_p->stall) {
-    pregs_p->ifid_preg.out = pregs_p->ifid_preg.inp;
-} else {
-    // re-freeze IF/ID output — keep old instruction for one more cycle
-    pregs_p->ifid_preg.out = pregs_p->ifid_preg.out;
-}
-
-// Update ID/EX
-if (pwires_p->stall) {
-    // insert bubble
-    pregs_p->idex_preg.out = (idex_reg_t){0};
-    pregs_p->idex_preg.out.instr.bits = 0x00000013;  // addi x0, x0, 0 (NOP)
-} else {
-    pregs_p->idex_preg.out = pregs_p->idex_preg.inp;
+/**
+ * pick the cycle_pipeline() variant for the trace and host timing options,
+ * once at startup: the cycle loop then runs without testing them every cycle
+ **/
+cycle_fn_t select_cycle_pipeline(void)
+{
+  bool hooks = sim_config.cosim_en || sim_config.profile_en || sim_config.pipeview_en ||
+               store_buffer.size || stats_next_sample != UINT64_MAX;
+  if (!hooks && !host_stats_en && !sim_config.trace_cycle && !sim_config.trace_regs)
+    return cycle_pipeline_lean;
+
+  static const cycle_fn_t variants[2][2][2] = {
+    {{cycle_pipeline_quiet,        cycle_pipeline_regs},
+     {cycle_pipeline_stages,       cycle_pipeline_full}},
+    {{cycle_pipeline_quiet_timed,  cycle_pipeline_regs_timed},
+     {cycle_pipeline_stages_timed, cycle_pipeline_full_timed}},
+  };
+  return variants[host_stats_en][sim_config.trace_cycle][sim_config.trace_regs];
 }
-
-// EX/MEM and MEM/WB always advance
-pregs_p->exmem_preg.out = pregs_p->exmem_preg.inp;
-pregs_p->memwb_preg.out = pregs_p->memwb_preg.inp;
-
-
-  /////////////////// NO CHANGES BELOW THIS ARE REQUIRED //////////////////////
-
-  // increment the cycle
-  total_cycle_counter++;
-
-  #ifdef DEBUG_REG_TRACE
-  print_register_trace(regfile_p);
-  #endif
-
-  /**
-   * check ecall condition
-   * To do this, the value stored in R[10] (a0 or x10) should be 10.
-   * Hence, the ecall condition is checked by the existence of following
-   * two instructions in sequence:
-   * 1. <instr>  x10, <val1>, <val2> 
-   * 2. ecall
-   * 
-   * The first instruction must write the value 10 to x10.
-   * The second instruction is the ecall (opcode: 0x73)
-   * 
-   * The condition checks whether the R[10] value is 10 when the
-   * `memwb_reg.instr.opcode` == 0x73 (to propagate the ecall)
-   * 
-   * If more functionality on ecall needs to be added, it can be done
-   * by adding more conditions on the value of R[10]
-   */
-  if( (pregs_p->memwb_preg.out.instr.bits == 0x00000073) &&
-      (regfile_p->R[10] == 10) )
-  {
-    *(ecall_exit) = true;
-  }
-}
\ No newline at end of file
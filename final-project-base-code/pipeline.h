@@ -4,37 +4,73 @@
 
 #include "config.h"
 #include "types.h"
+#include "riscv.h"
 #include "cache.h"
+#include "store_buffer.h"
+#include "fetch_unit.h"
 #include <stdbool.h>
 
 // forwarding control codes 
 #define FWD_REG   0
 #define FWD_EXMEM 1
 #define FWD_MEMWB 2
+#define FWD_MEM   3   // load data from the MEM stage (split MEM timing)
+#define FWD_SUBSTAGE 4  // value from a MEM sub-stage register (deep pipelines)
+
+// deepest split of a single stage (IF, EX or MEM) into sub-stages
+#define MAX_SUB_STAGES 4
 
 ///////////////////////////////////////////////////////////////////////////////
 /// Functionality
 ///////////////////////////////////////////////////////////////////////////////
 
 extern simulator_config_t sim_config;
-extern uint64_t miss_count;
-extern uint64_t hit_count;
-extern uint64_t total_cycle_counter;
-extern uint64_t stall_counter;
-extern uint64_t branch_counter;
-extern uint64_t fwd_exex_counter;
-extern uint64_t fwd_exmem_counter;
-extern uint64_t mem_access_counter;
+extern HART_LOCAL uint64_t miss_count;
+extern HART_LOCAL uint64_t hit_count;
+extern HART_LOCAL uint64_t mem_miss_counter;
+extern HART_LOCAL uint64_t total_cycle_counter;
+extern HART_LOCAL uint64_t stall_counter;
+extern HART_LOCAL uint64_t branch_counter;
+extern HART_LOCAL uint64_t fwd_exex_counter;
+extern HART_LOCAL uint64_t fwd_exmem_counter;
+extern HART_LOCAL uint64_t fwd_memex_counter;
+extern HART_LOCAL uint64_t fwd_memmem_counter;
+extern HART_LOCAL uint64_t stall_removed_counter;
+extern HART_LOCAL uint64_t mem_access_counter;
+extern HART_LOCAL uint64_t misaligned_counter;
+extern HART_LOCAL uint64_t misaligned_stall_counter;
+extern HART_LOCAL uint64_t coherence_stall_counter;
+extern HART_LOCAL uint64_t dcache_stall_counter;
+extern HART_LOCAL uint64_t sb_stall_counter;
+extern HART_LOCAL uint64_t amo_counter;
+extern HART_LOCAL uint64_t sc_fail_counter;
+extern HART_LOCAL uint64_t amo_stall_counter;
+extern HART_LOCAL store_buffer_t store_buffer;
+extern HART_LOCAL fetch_unit_t fetch_unit;
 
 ///////////////////////////////////////////////////////////////////////////////
 /// RISC-V Pipeline Register Types
 ///////////////////////////////////////////////////////////////////////////////
 
+// what a cycle is spent on (see cpi_stack.h); a pipeline register holding
+// a bubble carries the reason it was inserted, CPI_BASE for an instruction
+typedef enum {
+  CPI_BASE,         // an instruction retires
+  CPI_LOAD_USE,     // bubble of a load-use stall
+  CPI_CONTROL,      // instruction squashed by a taken branch or jump
+  CPI_DCACHE,       // MEM waiting for data memory
+  CPI_IFETCH,       // nothing fetched: fetch queue starved or pipeline fill
+  CPI_STRUCTURAL,   // a shared resource was busy
+  CPI_NUM_CAUSES
+} cpi_cause_t;
+
 typedef struct
 {
   Instruction instr;
   uint32_t    instr_addr;
   uint32_t    instr_bits;
+  uint8_t     bubble;       // cpi_cause_t
+  uint64_t    seq;          // fetch order, 0 for a bubble (pipeview.h)
   /**
    * Add other fields here
    */
@@ -47,13 +83,19 @@ typedef struct
   uint32_t    imm_gen_out;
   uint32_t    Read_Data_1;
   uint32_t    Read_Data_2;
+  uint8_t     bubble;
+  uint64_t    seq;
 
   // CONTROL SIGNALS
   bool    EX_ALUSrc;
+  bool    EX_ALUSrcA;   // ALU input A takes the PC (auipc)
   bool    EX_ALUOp;
   bool    M_Branch;
   bool    M_JAL;
+  bool    M_JALR;       // jump target comes from the ALU (rs1 + imm)
   bool    M_MemRead;
+  bool    M_CSR;        // Zicsr access, done in MEM and written back like a load
+  bool    M_Atomic;     // RV32A access, done in MEM and written back like a load
   bool    M_MemWrite;
   bool    WB_RegWrite;
   bool    WB_MemToReg;
@@ -70,12 +112,17 @@ typedef struct
   uint32_t    add_sum_output;
   uint32_t    ALU_result;
   uint32_t    Read_Data_2;
+  uint8_t     bubble;
+  uint64_t    seq;
 
   // CONTROL SIGNALS
   bool    Zero;
   bool    M_Branch;
   bool    M_JAL;
+  bool    M_JALR;
   bool    M_MemRead;
+  bool    M_CSR;
+  bool    M_Atomic;
   bool    M_MemWrite;
   bool    WB_RegWrite;
   bool    WB_MemToReg;
@@ -92,6 +139,9 @@ typedef struct
   uint32_t    instr_addr;
   uint32_t    ALU_result;
   uint32_t    Read_Data;
+  uint32_t    Write_Data;   // what a store wrote, checked by --cosim
+  uint8_t     bubble;
+  uint64_t    seq;
 
   // CONTROL SIGNALS
   bool    WB_RegWrite;
@@ -141,6 +191,13 @@ typedef struct
   idex_reg_pair_t  idex_preg;
   exmem_reg_pair_t exmem_preg;
   memwb_reg_pair_t memwb_preg;
+
+  // registers between the sub-stages of a split stage: entry i holds the
+  // output of sub-stage i+1, the last sub-stage writes the stage register
+  // above (e.g. IF1 -> if_sub_preg[0] -> IF2 -> ifid_preg)
+  ifid_reg_pair_t  if_sub_preg[MAX_SUB_STAGES-1];
+  exmem_reg_pair_t ex_sub_preg[MAX_SUB_STAGES-1];
+  memwb_reg_pair_t mem_sub_preg[MAX_SUB_STAGES-1];
 }pipeline_regs_t;
 
 typedef struct
@@ -154,6 +211,19 @@ typedef struct
 
   uint8_t fwdA;
   uint8_t fwdB;
+  uint32_t fwdA_data;       // forwarded values for FWD_SUBSTAGE
+  uint32_t fwdB_data;
+  bool    fwdS;             // store data comes from the load in WB
+  uint32_t store_fwd_data;
+  uint32_t mem_load_data;   // early load data of the split MEM stage
+  uint8_t  csr_older;       // older instructions a CSR in MEM sees retire
+
+  // register file write port driven by WB (written before ID reads it)
+  bool     wb_RegWrite;
+  uint8_t  wb_rd;
+  uint32_t wb_data;
+
+  uint32_t branch_addr;      // address of the branch/jump that set pc_src1
 
   bool stall;
   bool flush;
@@ -170,7 +240,7 @@ typedef struct
 /**
  * output : ifid_reg_t
  **/ 
-ifid_reg_t stage_fetch(pipeline_wires_t* pwires_p, regfile_t* regfile_p, Byte* memory_p);
+ifid_reg_t stage_fetch(pipeline_wires_t* pwires_p, regfile_t* regfile_p, memory_t* memory_p);
 
 /**
  * output : idex_reg_t
@@ -185,15 +255,48 @@ exmem_reg_t stage_execute(idex_reg_t idex_reg, pipeline_wires_t* pwires_p, pipel
 /**
  * output : memwb_reg_t
  **/ 
-memwb_reg_t stage_mem(exmem_reg_t exmem_reg, pipeline_wires_t* pwires_p, Byte* memory, Cache* cache_p);
+memwb_reg_t stage_mem(exmem_reg_t exmem_reg, pipeline_wires_t* pwires_p, memory_t* memory_p, Cache* cache_p);
 
 /**
  * output : write_data
  **/ 
 void stage_writeback(memwb_reg_t memwb_reg, pipeline_wires_t* pwires_p, regfile_t* regfile_p);
 
-void cycle_pipeline(regfile_t* regfile_p, Byte* memory_p, Cache* cache_p, pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, bool* ecall_exit);
+/**
+ * excite the pipeline with one clock cycle; select_cycle_pipeline() returns
+ * the variant built for the --trace options in sim_config
+ **/
+typedef void (*cycle_fn_t)(regfile_t* regfile_p, memory_t* memory_p, Cache* cache_p, pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, bool* ecall_exit);
+cycle_fn_t select_cycle_pipeline(void);
 
 void bootstrap(pipeline_wires_t* pwires_p, pipeline_regs_t* pregs_p, regfile_t* regfile_p);
 
+/**
+ * number of pipeline stages, counting every sub-stage (5 when nothing is split)
+ **/
+int pipeline_depth(void);
+
+/**
+ * cycles memory accesses would have cost the MEM stage ("#MEM stalls"):
+ * the cache or memory latency beyond one cycle, which MEM does not wait
+ * for, so they are neither in #Cycles nor in the CPI stack
+ **/
+uint64_t mem_stall_cycles(void);
+
+/**
+ * the time of the calling thread's hart: #Cycles and the MEM stalls
+ * counted on top. The harts keep their quantum and meet on the coherence
+ * bus by it.
+ **/
+uint64_t hart_clock(void);
+
+/**
+ * the data cache side of an access to `address`, a store when `write`:
+ * the data is in memory, the L1 decides the hit or miss. Counts it in
+ * hit_count/miss_count and traces it. Returns the cycles the access takes
+ * in the cache, and between harts the coherence cycles on top in
+ * *coherence_p.
+ **/
+int dcache_access(Address address, bool write, Cache* cache_p, int* coherence_p);
+
 #endif  // __PIPELINE_H__
\ No newline at end of file
@@ -0,0 +1,256 @@
+// pipeline_cycle.h
+// Body of cycle_pipeline(), included by pipeline.c once for every
+// combination of the per-cycle trace options so that each variant only
+// carries the trace calls it makes. Before including it, define
+//   CYCLE_FN     name of the variant
+//   TRACE_CYCLE  1 to trace the stages of every cycle   (--trace cycle)
+//   TRACE_REGS   1 to dump the registers every cycle    (--trace regs)
+//   HOST_STATS   1 to time the stages on the host         (--host-stats)
+//   HOOKS        1 to call the per-cycle hooks: --cosim, --profile, the
+//                pipeline views, the store buffer and --stats-interval
+// The variant without any of them tests none of these options per cycle.
+
+#if HOST_STATS
+#define HS_TO(region) (void)HS_ENTER(region)
+#define STAGE_FETCH   stage_fetch_timed
+#define STAGE_DECODE  stage_decode_timed
+#else
+#define HS_TO(region)
+#define STAGE_FETCH   stage_fetch
+#define STAGE_DECODE  stage_decode
+#endif
+
+/** 
+ * excite the pipeline with one clock cycle
+ **/
+static void CYCLE_FN(regfile_t* regfile_p, memory_t* memory_p, Cache* cache_p, pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, bool* ecall_exit)
+{
+  #if HOST_STATS
+  if (total_cycle_counter == hs_next_sample)
+    hs_sample_begin();
+  #endif
+  #if TRACE_CYCLE
+  HS_TO(HS_TRACE);
+  trace_cycle_begin(total_cycle_counter);
+  #endif
+
+  // MEM is still busy with the access it made: no stage works this cycle,
+  // WB gets a bubble charged to what MEM waits for
+  if (mem_held()) {
+    HS_TO(HS_OTHER);
+    cpi_cycles[mem_hold_cycle()]++;
+    #if TRACE_CYCLE
+    HS_TO(HS_TRACE);
+    trace_text(MEM_HELD_TEXT);
+    #endif
+    #if HOOKS
+    if (sim_config.profile_en)
+      prof_hold_cycle();
+    #endif
+    goto clock_edge;
+  }
+
+  // process each stage
+
+  HS_TO(HS_HAZARD);
+  gen_forward(pregs_p, pwires_p);
+  detect_hazard(pregs_p, pwires_p, regfile_p);
+
+  // a split stage does its work in its first sub-stage, the others only
+  // pass the instruction on towards the stage register
+  int nif  = sim_config.if_stages;
+  int nex  = sim_config.ex_stages;
+  int nmem = sim_config.mem_stages;
+  ifid_reg_t*  if_inp  = (nif  > 1) ? &pregs_p->if_sub_preg[0].inp  : &pregs_p->ifid_preg.inp;
+  exmem_reg_t* ex_inp  = (nex  > 1) ? &pregs_p->ex_sub_preg[0].inp  : &pregs_p->exmem_preg.inp;
+  memwb_reg_t* mem_inp = (nmem > 1) ? &pregs_p->mem_sub_preg[0].inp : &pregs_p->memwb_preg.inp;
+
+  /* Output               |    Stage      |       Inputs  */
+  HS_TO(HS_IF);
+  *if_inp                 = STAGE_FETCH     (pwires_p, regfile_p, memory_p);
+  #if TRACE_CYCLE
+  HS_TO(HS_TRACE);
+  if (if_inp->instr_bits)    // nothing fetched while stalled or starved
+    trace_stage(TRACE_IF, 1, if_inp->instr_bits, if_inp->instr_addr);
+  #endif
+  HS_TO(HS_OTHER);
+  for (int i = 0; i < nif - 1; i++) {
+    if (i < nif - 2) pregs_p->if_sub_preg[i+1].inp = pregs_p->if_sub_preg[i].out;
+    else             pregs_p->ifid_preg.inp        = pregs_p->if_sub_preg[i].out;
+    #if TRACE_CYCLE
+    HS_TO(HS_TRACE);
+    trace_stage(TRACE_IF, i + 2, pregs_p->if_sub_preg[i].out.instr.bits, pregs_p->if_sub_preg[i].out.instr_addr);
+    HS_TO(HS_OTHER);
+    #endif
+  }
+  
+  HS_TO(HS_ID);
+  pregs_p->idex_preg.inp  = STAGE_DECODE    (pregs_p->ifid_preg.out, pwires_p, regfile_p);
+  #if TRACE_CYCLE
+  HS_TO(HS_TRACE);
+  trace_stage(TRACE_ID, 1, pregs_p->idex_preg.inp.instr.bits, pregs_p->idex_preg.inp.instr_addr);
+  #endif
+
+  // split MEM stage: the load data of the instruction in MEM is ready
+  // early enough in the cycle to be forwarded into EX
+  if (sim_config.split_mem_en && pregs_p->exmem_preg.out.M_MemRead) {
+    HS_TO(HS_MEM);
+    pwires_p->mem_load_data = mem_read_data(pregs_p->exmem_preg.out, memory_p);
+  }
+
+  HS_TO(HS_EX);
+  *ex_inp                 = stage_execute   (pregs_p->idex_preg.out, pwires_p, pregs_p);
+  #if TRACE_CYCLE
+  HS_TO(HS_TRACE);
+  trace_stage(TRACE_EX, 1, ex_inp->instr.bits, ex_inp->instr_addr);
+  #endif
+  HS_TO(HS_OTHER);
+  for (int i = 0; i < nex - 1; i++) {
+    if (i < nex - 2) pregs_p->ex_sub_preg[i+1].inp = pregs_p->ex_sub_preg[i].out;
+    else             pregs_p->exmem_preg.inp       = pregs_p->ex_sub_preg[i].out;
+    #if TRACE_CYCLE
+    HS_TO(HS_TRACE);
+    trace_stage(TRACE_EX, i + 2, pregs_p->ex_sub_preg[i].out.instr.bits, pregs_p->ex_sub_preg[i].out.instr_addr);
+    HS_TO(HS_OTHER);
+    #endif
+  }
+
+  HS_TO(HS_MEM);
+  *mem_inp                = stage_mem       (pregs_p->exmem_preg.out, pwires_p, memory_p, cache_p);
+  #if TRACE_CYCLE
+  HS_TO(HS_TRACE);
+  trace_stage(TRACE_MEM, 1, mem_inp->instr.bits, mem_inp->instr_addr);
+  #endif
+  HS_TO(HS_OTHER);
+  for (int i = 0; i < nmem - 1; i++) {
+    if (i < nmem - 2) pregs_p->mem_sub_preg[i+1].inp = pregs_p->mem_sub_preg[i].out;
+    else              pregs_p->memwb_preg.inp        = pregs_p->mem_sub_preg[i].out;
+    #if TRACE_CYCLE
+    HS_TO(HS_TRACE);
+    trace_stage(TRACE_MEM, i + 2, pregs_p->mem_sub_preg[i].out.instr.bits, pregs_p->mem_sub_preg[i].out.instr_addr);
+    HS_TO(HS_OTHER);
+    #endif
+  }
+
+  HS_TO(HS_WB);
+                            stage_writeback (pregs_p->memwb_preg.out, pwires_p, regfile_p);
+  #if HOOKS
+  HS_TO(HS_COSIM);
+  if (sim_config.cosim_en)
+    cosim_retire(&pregs_p->memwb_preg.out, regfile_p, total_cycle_counter);
+  #endif
+  #if TRACE_CYCLE
+  HS_TO(HS_TRACE);
+  trace_stage(TRACE_WB, 1, pregs_p->memwb_preg.out.instr.bits, pregs_p->memwb_preg.out.instr_addr);
+  #endif
+
+  // every cycle counts towards exactly one CPI stack category
+  HS_TO(HS_OTHER);
+  cpi_cycle(&pregs_p->memwb_preg.out);
+  #if HOOKS
+  HS_TO(HS_TRACE);
+  if (sim_config.profile_en)
+    prof_cycle(pregs_p, pwires_p);
+  if (sim_config.pipeview_en)
+    pv_cycle(pregs_p, pwires_p);
+  HS_TO(HS_OTHER);
+  #endif
+
+  //control hazards
+  // the branch/jump resolved in MEM this cycle: squash the younger
+  // instructions just produced by IF, ID and EX (they keep their address)
+if (pwires_p->pcsrc == 1) {
+    flush_pipeline(pregs_p, pwires_p);
+    branch_counter++;
+    #if TRACE_CYCLE
+    HS_TO(HS_TRACE);
+    trace_flushed();
+    HS_TO(HS_OTHER);
+    #endif
+}
+
+
+  // update all the output registers for the next cycle from the input registers in the current cycle
+// Update IF/ID output (stalling prevents PC and IF/ID register updates)
+if (!pwires_p->stall) {
+    pregs_p->ifid_preg.out = pregs_p->ifid_preg.inp;
+} else {
+    // re-freeze IF/ID output — keep old instruction for one more cycle
+    pregs_p->ifid_preg.out = pregs_p->ifid_preg.out;
+}
+
+// Update ID/EX
+if (pwires_p->stall) {
+    // insert bubble
+    pregs_p->idex_preg.out = (idex_reg_t){0};
+    pregs_p->idex_preg.out.instr.bits = 0x00000013;  // addi x0, x0, 0 (NOP)
+    pregs_p->idex_preg.out.bubble = CPI_LOAD_USE;
+} else {
+    pregs_p->idex_preg.out = pregs_p->idex_preg.inp;
+}
+
+// EX/MEM and MEM/WB always advance
+pregs_p->exmem_preg.out = pregs_p->exmem_preg.inp;
+pregs_p->memwb_preg.out = pregs_p->memwb_preg.inp;
+
+// and so do the sub-stage registers of split stages (IF ones hold on a stall)
+advance_sub_stages(pregs_p, pwires_p);
+
+
+  /////////////////// NO CHANGES BELOW THIS ARE REQUIRED //////////////////////
+
+clock_edge:
+  // stores buffered in earlier cycles drain to memory in the background
+  #if HOOKS
+  if (store_buffer.size)
+    sb_tick(&store_buffer, memory_p, cache_p);
+  #endif
+
+  // increment the cycle
+  total_cycle_counter++;
+  #if HOOKS
+  HS_TO(HS_TRACE);
+  if (total_cycle_counter == stats_next_sample)
+    stats_sample(total_cycle_counter);
+  #endif
+
+  #if TRACE_REGS
+  trace_regs(regfile_p);
+  #endif
+  #if TRACE_CYCLE || TRACE_REGS
+  trace_cycle_end();
+  #endif
+  HS_TO(HS_OTHER);
+
+  /**
+   * check ecall condition
+   * To do this, the value stored in R[10] (a0 or x10) should be 10.
+   * Hence, the ecall condition is checked by the existence of following
+   * two instructions in sequence:
+   * 1. <instr>  x10, <val1>, <val2> 
+   * 2. ecall
+   * 
+   * The first instruction must write the value 10 to x10.
+   * The second instruction is the ecall (opcode: 0x73)
+   * 
+   * The condition checks whether the R[10] value is 10 when the
+   * `memwb_reg.instr.opcode` == 0x73 (to propagate the ecall)
+   * 
+   * If more functionality on ecall needs to be added, it can be done
+   * by adding more conditions on the value of R[10]
+   */
+  if( (pregs_p->memwb_preg.out.instr.bits == 0x00000073) &&
+      (regfile_p->R[10] == 10) )
+  {
+    *(ecall_exit) = true;
+  }
+
+  #if HOST_STATS
+  if (hs_timing)
+    hs_sample_end(total_cycle_counter);
+  #endif
+}
+
+#undef HS_TO
+#undef STAGE_FETCH
+#undef STAGE_DECODE
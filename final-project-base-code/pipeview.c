@@ -0,0 +1,243 @@
+//pipeview.c
+#include <stdio.h>
+#include <string.h>
+#include "pipeview.h"
+#include "trace.h"
+
+#define PV_WINDOW     64                       // in-flight table, a power of two
+#define PV_MAX_SLOTS  (3 * MAX_SUB_STAGES + 2)  // IF, EX and MEM split, ID, WB
+
+typedef struct {
+  uint64_t seq;           // fetch number, 0 for a free entry
+  uint64_t id;            // Konata id, in the order instructions show up
+  uint32_t addr;
+  char     label[48];     // disassembly
+  char     stage[8];      // stage it is in, "" until it enters one
+  uint8_t  slot;          // stage slot, the Chrome trace row
+  uint64_t start;         // cycle it entered `stage`
+  uint64_t seen;          // last cycle it was in a stage
+  bool     retiring;      // it was in WB, retires the next cycle
+} pv_inst_t;
+
+static FILE* konata;
+static FILE* chrome;
+static bool  chrome_first = true;      // no comma before the first event
+static bool  konata_started;
+static uint64_t konata_cycle;          // cycle of the last Konata command
+
+// instructions in flight, indexed by fetch number
+static pv_inst_t inflight[PV_WINDOW];
+static uint64_t  next_id;
+static uint64_t  next_retire_id;
+
+static char slot_names[PV_MAX_SLOTS][TRACE_SLOT_NAME_SIZE];
+static int  num_slots;
+
+static void pv_init(void)
+{
+  if (num_slots)
+    return;
+  num_slots = pipeline_depth();
+  for (int s = 0; s < num_slots; s++) {
+    trace_slot_name(s, sim_config.if_stages, sim_config.ex_stages,
+                    sim_config.mem_stages, slot_names[s]);
+    char* pad = strchr(slot_names[s], ' ');
+    if (pad)
+      *pad = '\0';
+  }
+}
+
+int pv_open_konata(const char* path)
+{
+  pv_init();
+  konata = fopen(path, "w");
+  if (konata == NULL)
+    return -1;
+  fprintf(konata, "Kanata\t0004\n");
+  return 0;
+}
+
+static void chrome_sep(void)
+{
+  if (!chrome_first)
+    fputs(",\n", chrome);
+  chrome_first = false;
+}
+
+int pv_open_chrome(const char* path)
+{
+  pv_init();
+  chrome = fopen(path, "w");
+  if (chrome == NULL)
+    return -1;
+  // JSON array format: viewers also accept it without the closing bracket,
+  // so a run that is cut short still loads
+  fputs("[\n", chrome);
+  chrome_sep();
+  fprintf(chrome, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+                  "\"args\":{\"name\":\"pipeline\"}}");
+  for (int s = 0; s < num_slots; s++) {
+    chrome_sep();
+    fprintf(chrome, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+                    "\"args\":{\"name\":\"%s\"}}", s, slot_names[s]);
+    chrome_sep();
+    fprintf(chrome, "{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+                    "\"args\":{\"sort_index\":%d}}", s, s);
+  }
+  return 0;
+}
+
+/**
+ * Konata commands apply at the current cycle, advance it to `cycle`
+ **/
+static void konata_at(uint64_t cycle)
+{
+  if (!konata_started) {
+    fprintf(konata, "C=\t%lu\n", cycle);
+    konata_started = true;
+  } else if (cycle != konata_cycle) {
+    fprintf(konata, "C\t%lu\n", cycle - konata_cycle);
+  }
+  konata_cycle = cycle;
+}
+
+static void pv_end_stage(const pv_inst_t* in, uint64_t cycle, bool flushed)
+{
+  if (in->stage[0] == '\0')
+    return;
+  if (konata) {
+    konata_at(cycle);
+    fprintf(konata, "E\t%lu\t0\t%s\n", in->id, in->stage);
+  }
+  if (chrome) {
+    bool stalled = strcmp(in->stage, "stall") == 0;
+    chrome_sep();
+    fprintf(chrome, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,"
+                    "\"pid\":0,\"tid\":%u,\"args\":{\"pc\":\"0x%08x\",\"seq\":%lu}%s}",
+            in->label, in->stage, in->start, cycle - in->start, in->slot,
+            in->addr, in->seq,
+            (flushed) ? ",\"cname\":\"grey\"" : (stalled) ? ",\"cname\":\"terrible\"" : "");
+  }
+}
+
+static void pv_enter(pv_inst_t* in, const char* stage, int slot, uint64_t cycle)
+{
+  pv_end_stage(in, cycle, false);
+  snprintf(in->stage, sizeof(in->stage), "%s", stage);
+  in->slot = slot;
+  in->start = cycle;
+  if (konata) {
+    konata_at(cycle);
+    fprintf(konata, "S\t%lu\t0\t%s\n", in->id, stage);
+  }
+}
+
+static void pv_finish(pv_inst_t* in, uint64_t cycle, bool flushed)
+{
+  pv_end_stage(in, cycle, flushed);
+  if (konata) {
+    konata_at(cycle);
+    fprintf(konata, "R\t%lu\t%lu\t%d\n", in->id,
+            (flushed) ? 0 : next_retire_id++, (flushed) ? 1 : 0);
+  }
+  in->seq = 0;
+}
+
+static void pv_new(pv_inst_t* in, uint64_t seq, uint32_t addr, uint32_t bits,
+                   uint64_t cycle)
+{
+  *in = (pv_inst_t){.seq = seq, .id = next_id++, .addr = addr};
+  disasm_string(bits, in->label, sizeof(in->label));
+  if (konata) {
+    konata_at(cycle);
+    fprintf(konata, "I\t%lu\t%lu\t0\n", in->id, seq);
+    fprintf(konata, "L\t%lu\t0\t%08x: %s\n", in->id, addr, in->label);
+  }
+}
+
+void pv_cycle(const pipeline_regs_t* pregs_p, const pipeline_wires_t* pwires_p)
+{
+  uint64_t cycle = total_cycle_counter;
+  int nif  = sim_config.if_stages;
+  int nex  = sim_config.ex_stages;
+  int nmem = sim_config.mem_stages;
+
+  // what each stage worked on this cycle, the same registers trace_stage()
+  // prints: the fetched instruction, then the stage registers read
+  struct { uint64_t seq; uint8_t bubble; uint32_t addr; uint32_t bits; } slot[PV_MAX_SLOTS];
+  int n = 0;
+  #define PV_SLOT(reg) (slot[n].seq = (reg).seq, slot[n].bubble = (reg).bubble, \
+                        slot[n].addr = (reg).instr_addr, slot[n].bits = (reg).instr.bits, n++)
+  PV_SLOT((nif > 1) ? pregs_p->if_sub_preg[0].inp : pregs_p->ifid_preg.inp);
+  for (int i = 0; i < nif - 1; i++)
+    PV_SLOT(pregs_p->if_sub_preg[i].out);
+  PV_SLOT(pregs_p->ifid_preg.out);
+  PV_SLOT(pregs_p->idex_preg.out);
+  for (int i = 0; i < nex - 1; i++)
+    PV_SLOT(pregs_p->ex_sub_preg[i].out);
+  PV_SLOT(pregs_p->exmem_preg.out);
+  for (int i = 0; i < nmem - 1; i++)
+    PV_SLOT(pregs_p->mem_sub_preg[i].out);
+  PV_SLOT(pregs_p->memwb_preg.out);
+  #undef PV_SLOT
+
+  // what was in WB last cycle has retired
+  for (int i = 0; i < PV_WINDOW; i++) {
+    if (inflight[i].seq && inflight[i].retiring)
+      pv_finish(&inflight[i], cycle, false);
+  }
+
+  for (int s = 0; s < n; s++) {
+    // stall bubbles and squashed instructions (NOPs that keep the fetch
+    // number) are not instructions
+    if (slot[s].seq == 0 || slot[s].bubble != CPI_BASE)
+      continue;
+    pv_inst_t* in = &inflight[slot[s].seq & (PV_WINDOW - 1)];
+    if (in->seq != slot[s].seq) {
+      if (in->seq)
+        pv_finish(in, cycle, true);
+      pv_new(in, slot[s].seq, slot[s].addr, slot[s].bits, cycle);
+    }
+    // the instruction ID holds during a load-use stall
+    bool stalled = (s == nif && pwires_p->stall && !pwires_p->pcsrc);
+    const char* stage = (stalled) ? "stall" : slot_names[s];
+    if (strcmp(in->stage, stage) != 0)
+      pv_enter(in, stage, s, cycle);
+    in->seen = cycle;
+    in->retiring = (s == n - 1);
+  }
+
+  // in flight but in no stage any more: squashed by last cycle's flush
+  for (int i = 0; i < PV_WINDOW; i++) {
+    if (inflight[i].seq && inflight[i].seen != cycle)
+      pv_finish(&inflight[i], cycle, true);
+  }
+
+  // the branch or jump in MEM squashes everything younger at the end of
+  // this cycle
+  if (chrome && pwires_p->pcsrc) {
+    chrome_sep();
+    fprintf(chrome, "{\"name\":\"flush\",\"cat\":\"flush\",\"ph\":\"i\",\"s\":\"p\","
+                    "\"ts\":%lu,\"pid\":0,\"tid\":%d,\"args\":{\"branch\":\"0x%08x\"}}",
+            cycle + 1, nif + 1 + nex, pregs_p->exmem_preg.out.instr_addr);
+  }
+}
+
+void pv_close(void)
+{
+  uint64_t cycle = total_cycle_counter;
+  // the simulation stops at the ecall, the younger instructions never retire
+  for (int i = 0; i < PV_WINDOW; i++) {
+    if (inflight[i].seq)
+      pv_finish(&inflight[i], cycle, !inflight[i].retiring);
+  }
+  if (konata) {
+    fclose(konata);
+    konata = NULL;
+  }
+  if (chrome) {
+    fputs("\n]\n", chrome);
+    fclose(chrome);
+    chrome = NULL;
+  }
+}
@@ -0,0 +1,28 @@
+#ifndef PIPEVIEW_H
+#define PIPEVIEW_H
+
+#include "riscv.h"
+#include "pipeline.h"
+
+/**
+ * Pipeline occupancy export for timeline viewers. Every fetched
+ * instruction is followed by its fetch number (the `seq` field of the
+ * stage registers) from stage to stage, and each stage it enters and
+ * leaves is written out as it happens:
+ *
+ *   --konata FILE        Konata log (Kanata 0004): one row per instruction,
+ *                        a segment per stage, retired or flushed at the end
+ *   --chrome-trace FILE  Chrome trace_event JSON (chrome://tracing,
+ *                        Perfetto): one row per stage slot, 1 cycle = 1 us
+ *
+ * A load-use stall shows as a "stall" segment of the instruction held in
+ * ID; instructions squashed by a taken branch or jump end as flushed, with
+ * a flush marker in the Chrome trace. Only the instructions in flight are
+ * kept in memory.
+ **/
+int  pv_open_konata(const char* path);
+int  pv_open_chrome(const char* path);
+void pv_cycle(const pipeline_regs_t* pregs_p, const pipeline_wires_t* pwires_p);
+void pv_close(void);
+
+#endif // PIPEVIEW_H
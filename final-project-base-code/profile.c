@@ -0,0 +1,175 @@
+//profile.c
+#include <stdio.h>
+#include <stdlib.h>
+#include "riscv.h"
+#include "elf_loader.h"
+#include "profile.h"
+
+typedef struct {
+  Address  addr;
+  uint32_t bits;
+  bool     used;
+  uint64_t retired;
+  uint64_t cycles;
+  uint64_t stalls;
+  uint64_t flushes;
+  uint64_t fwds;
+  uint64_t misses;
+} prof_entry_t;
+
+// open-addressing table keyed by instruction address
+static prof_entry_t* table;
+static size_t        capacity;
+static size_t        num_entries;
+
+// events of cycles with no instruction to charge (bubbles in WB or MEM)
+static prof_entry_t  unattributed;
+static uint64_t      pending_cycles;   // charged to the next retiring instruction
+
+// global counters as of the previous cycle
+static uint64_t last_stalls, last_fwds, last_store_fwds;
+static uint64_t last_misses, last_mem_misses;
+
+static size_t prof_slot(Address addr, size_t cap)
+{
+  return ((addr >> 2) * 0x9E3779B1U) & (cap - 1);
+}
+
+static void prof_grow(void)
+{
+  size_t new_cap = (capacity) ? 2 * capacity : 1024;
+  prof_entry_t* new_table = calloc(new_cap, sizeof(prof_entry_t));
+  if (new_table == NULL) {
+    fprintf(stderr, "[PROFILE]: cannot allocate the profile\n");
+    exit(-1);
+  }
+  for (size_t i = 0; i < capacity; i++) {
+    if (!table[i].used)
+      continue;
+    size_t s = prof_slot(table[i].addr, new_cap);
+    while (new_table[s].used)
+      s = (s + 1) & (new_cap - 1);
+    new_table[s] = table[i];
+  }
+  free(table);
+  table = new_table;
+  capacity = new_cap;
+}
+
+/**
+ * the entry of the instruction at `addr`, bubbles (no instruction bits) go
+ * to `unattributed`
+ **/
+static prof_entry_t* prof_entry(Address addr, uint32_t bits)
+{
+  if (bits == 0)
+    return &unattributed;
+  if (2 * (num_entries + 1) > capacity)
+    prof_grow();
+  size_t s = prof_slot(addr, capacity);
+  while (table[s].used && table[s].addr != addr)
+    s = (s + 1) & (capacity - 1);
+  if (!table[s].used) {
+    table[s].used = true;
+    table[s].addr = addr;
+    num_entries++;
+  }
+  table[s].bits = bits;
+  return &table[s];
+}
+
+void prof_hold_cycle(void)
+{
+  pending_cycles++;
+}
+
+void prof_cycle(const pipeline_regs_t* pregs_p, const pipeline_wires_t* pwires_p)
+{
+  // squashed instructions and stall bubbles retire as tagged NOPs
+  const memwb_reg_t* wb = &pregs_p->memwb_preg.out;
+  pending_cycles++;
+  if (wb->instr.bits != 0 && wb->bubble == CPI_BASE) {
+    prof_entry_t* e = prof_entry(wb->instr_addr, wb->instr.bits);
+    e->retired++;
+    e->cycles += pending_cycles;
+    pending_cycles = 0;
+  }
+
+  const ifid_reg_t*  id  = &pregs_p->ifid_preg.out;
+  const idex_reg_t*  ex  = &pregs_p->idex_preg.inp;
+  const exmem_reg_t* mem = &pregs_p->exmem_preg.out;
+
+  uint64_t fwds = fwd_exex_counter + fwd_exmem_counter + fwd_memex_counter;
+  if (stall_counter != last_stalls)
+    prof_entry(id->instr_addr, id->instr.bits)->stalls += stall_counter - last_stalls;
+  if (fwds != last_fwds)
+    prof_entry(ex->instr_addr, ex->instr.bits)->fwds += fwds - last_fwds;
+  if (fwd_memmem_counter != last_store_fwds)
+    prof_entry(mem->instr_addr, mem->instr.bits)->fwds += fwd_memmem_counter - last_store_fwds;
+  // misses of the MEM access are the instruction's, the ones of store
+  // buffer drains belong to no instruction in particular
+  uint64_t drain_misses = (miss_count - last_misses) - (mem_miss_counter - last_mem_misses);
+  if (mem_miss_counter != last_mem_misses)
+    prof_entry(mem->instr_addr, mem->instr.bits)->misses += mem_miss_counter - last_mem_misses;
+  unattributed.misses += drain_misses;
+  if (pwires_p->pcsrc)
+    prof_entry(mem->instr_addr, mem->instr.bits)->flushes++;
+
+  last_stalls = stall_counter;
+  last_fwds = fwds;
+  last_store_fwds = fwd_memmem_counter;
+  last_misses = miss_count;
+  last_mem_misses = mem_miss_counter;
+}
+
+static int cmp_cost(const void* a, const void* b)
+{
+  const prof_entry_t* x = a;
+  const prof_entry_t* y = b;
+  if (x->cycles != y->cycles)
+    return (x->cycles < y->cycles) ? 1 : -1;
+  return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+static void prof_print_row(const prof_entry_t* e, uint64_t total)
+{
+  printf("%10lu %5.1f%% %9lu %6.2f %7lu %7lu %7lu %7lu  ", e->cycles,
+         (total) ? 100.0 * e->cycles / total : 0.0, e->retired,
+         (e->retired) ? (double)e->cycles / e->retired : 0.0,
+         e->stalls, e->flushes, e->fwds, e->misses);
+}
+
+void prof_print(int top)
+{
+  prof_entry_t* sorted = malloc((num_entries + 1) * sizeof(prof_entry_t));
+  size_t n = 0;
+  uint64_t total = pending_cycles + unattributed.cycles;
+  for (size_t i = 0; i < capacity; i++) {
+    if (table[i].used) {
+      sorted[n++] = table[i];
+      total += table[i].cycles;
+    }
+  }
+  qsort(sorted, n, sizeof(prof_entry_t), cmp_cost);
+  if (top > 0 && (size_t)top < n)
+    n = top;
+
+  printf("#Profile           = %5lu instructions, %lu cycles\n", num_entries, total);
+  printf("#    cycles      %%   retired    CPI  stalls flushes    fwds  misses  address\n");
+  for (size_t i = 0; i < n; i++) {
+    prof_print_row(&sorted[i], total);
+    printf("%08x  ", sorted[i].addr);
+    uint32_t offset;
+    const char* name = elf_symbol_at(sorted[i].addr, &offset);
+    if (name && offset)
+      printf("<%s+%u>  ", name, offset);
+    else if (name)
+      printf("<%s>  ", name);
+    decode_instruction(sorted[i].bits);
+  }
+  unattributed.cycles += pending_cycles;
+  pending_cycles = 0;
+  prof_print_row(&unattributed, total);
+  printf("(no instruction)\n");
+  free(sorted);
+}
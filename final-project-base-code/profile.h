@@ -0,0 +1,34 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include "types.h"
+#include "pipeline.h"
+
+/**
+ * Per-PC hotspot profile (--profile). Every cycle the events counted by the
+ * pipeline are charged to the instruction that caused them:
+ *   cycles   a cycle is charged to the instruction retiring in WB; cycles
+ *            with nothing retiring go to the next instruction that does
+ *   stalls   load-use stalls, to the instruction held in ID
+ *   flushes  taken branches and jumps, to the branch resolving in MEM
+ *   fwds     forwarded operands, to the instruction receiving them
+ *   misses   cache misses, to the instruction in MEM when its own access
+ *            missed, to no instruction when a store buffer drain did
+ * so the columns add up to the global stats.
+ **/
+void prof_cycle(const pipeline_regs_t* pregs_p, const pipeline_wires_t* pwires_p);
+
+/**
+ * a cycle MEM holds the pipeline, charged to the instruction that made the
+ * access: it is the next to retire
+ **/
+void prof_hold_cycle(void);
+
+/**
+ * print the `top` costliest instructions (all of them when 0), sorted by
+ * cycles, with their disassembly
+ **/
+void prof_print(int top);
+
+#endif // PROFILE_H
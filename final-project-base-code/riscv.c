@@ -11,17 +11,84 @@
 #include <unistd.h>
 #include "cache.h"
 #include "pipeline.h"
+#include "trace.h"
+#include "cosim.h"
+#include "profile.h"
+#include "cpi_stack.h"
+#include "pipeview.h"
+#include "stats.h"
+#include "host_stats.h"
+#include "elf_loader.h"
+#include "hex_loader.h"
+#include "hart.h"
+#include "coherence.h"
+#include "atomic.h"
 
 /* WARNING: DO NOT CHANGE THIS FILE.
  YOU PROBABLY DON'T EVEN NEED TO LOOK AT IT... */
 
-// Pointer to simulator memory
-Byte *memory;
-#define MAX_SIZE 50
+// Simulator memory
+memory_t *memory;
+
+// long-only command-line options
+enum {
+  OPT_STORE_FWD = 256,
+  OPT_SPLIT_MEM,
+  OPT_DEPTH,
+  OPT_STAGES,
+  OPT_STORE_BUFFER,
+  OPT_FETCH_QUEUE,
+  OPT_LOOP_BUFFER,
+  OPT_TRACE_BIN,
+  OPT_TRACE,
+  OPT_STATS,
+  OPT_MEM_LATENCY,
+  OPT_COSIM,
+  OPT_MEM_SIZE,
+  OPT_MISALIGNED,
+  OPT_PROFILE,
+  OPT_CPI_STACK,
+  OPT_KONATA,
+  OPT_CHROME_TRACE,
+  OPT_STATS_OUT,
+  OPT_STATS_INTERVAL,
+  OPT_HOST_STATS,
+  OPT_HARTS,
+  OPT_QUANTUM,
+  OPT_AMO_LATENCY,
+};
+
+static const struct option long_options[] = {
+  {"store-fwd", no_argument, NULL, OPT_STORE_FWD},
+  {"split-mem", no_argument, NULL, OPT_SPLIT_MEM},
+  {"depth",     required_argument, NULL, OPT_DEPTH},
+  {"stages",    required_argument, NULL, OPT_STAGES},
+  {"store-buffer", required_argument, NULL, OPT_STORE_BUFFER},
+  {"fetch-queue",  required_argument, NULL, OPT_FETCH_QUEUE},
+  {"loop-buffer",  required_argument, NULL, OPT_LOOP_BUFFER},
+  {"trace-bin",    required_argument, NULL, OPT_TRACE_BIN},
+  {"trace",        required_argument, NULL, OPT_TRACE},
+  {"stats",        required_argument, NULL, OPT_STATS},
+  {"mem-latency",  required_argument, NULL, OPT_MEM_LATENCY},
+  {"cosim",        no_argument,       NULL, OPT_COSIM},
+  {"mem-size",     required_argument, NULL, OPT_MEM_SIZE},
+  {"misaligned",   required_argument, NULL, OPT_MISALIGNED},
+  {"profile",      optional_argument, NULL, OPT_PROFILE},
+  {"cpi-stack",    required_argument, NULL, OPT_CPI_STACK},
+  {"konata",       required_argument, NULL, OPT_KONATA},
+  {"chrome-trace", required_argument, NULL, OPT_CHROME_TRACE},
+  {"stats-out",    required_argument, NULL, OPT_STATS_OUT},
+  {"stats-interval", required_argument, NULL, OPT_STATS_INTERVAL},
+  {"host-stats",   optional_argument, NULL, OPT_HOST_STATS},
+  {"harts",        required_argument, NULL, OPT_HARTS},
+  {"quantum",      required_argument, NULL, OPT_QUANTUM},
+  {"amo-latency",  required_argument, NULL, OPT_AMO_LATENCY},
+  {NULL, 0, NULL, 0}
+};
 
 void execute_emu(regfile_t *regfile, int prompt, int print) {
   /* fetch an instruction */
-  uint32_t instruction_bits = load(memory, regfile->PC, LENGTH_WORD);
+  uint32_t instruction_bits = mem_fetch(memory, regfile->PC);
 
   /* interactive-mode prompt */
   if (prompt) {
@@ -41,7 +108,7 @@ void execute_emu(regfile_t *regfile, int prompt, int print) {
   regfile->R[0] = 0;
 
   // print trace
-  if (print) {
+  if (print && !emu_exited) {
     int i, j;
 
     for (i = 0; i < 8; i++) {
@@ -56,30 +123,134 @@ void execute_emu(regfile_t *regfile, int prompt, int print) {
   }
 }
 
-int load_program(uint8_t *mem, size_t memsize, int startaddr,
-                 const char *filename, int disasm) {
-  FILE *file = fopen(filename, "r");
-  char line[MAX_SIZE];
-  int instruction, offset = 0;
-  int programsize = 0;
-  while (fgets(line, MAX_SIZE, file) != NULL) {
-    instruction = (int32_t)strtol(line, NULL, 16);
-    // printf("[load_program]: Instruction: %x\n", instruction);
-    programsize++;
-    // printf("%x, %d, %d\n", instruction, startaddr, offset);
-    mem[startaddr + offset] = instruction & 0xFF;
-    mem[startaddr + offset + 1] = (instruction >> 8) & 0xFF;
-    mem[startaddr + offset + 2] = (instruction >> 16) & 0xFF;
-    mem[startaddr + offset + 3] = (instruction >> 24) & 0xFF;
-
-    if (disasm) {
-      printf("%08x: ", startaddr + offset);
-      decode_instruction((uint32_t)instruction);
+/* parse the number of IF, EX and MEM sub-stages from "--depth 5|7|9" or
+ * "--stages IF,EX,MEM" */
+int parse_pipeline_depth(int opt, const char *arg, uint8_t stages[3]) {
+  if (opt == OPT_DEPTH) {
+    switch (atoi(arg)) {
+    case 5: stages[0] = 1; stages[1] = 1; stages[2] = 1; return 0;
+    case 7: stages[0] = 2; stages[1] = 1; stages[2] = 2; return 0;
+    case 9: stages[0] = 3; stages[1] = 2; stages[2] = 2; return 0;
+    default:
+      fprintf(stderr, "Pipeline depth must be 5, 7 or 9\n");
+      return -1;
     }
+  }
+  int f, e, m;
+  if (sscanf(arg, "%d,%d,%d", &f, &e, &m) != 3 ||
+      f < 1 || f > MAX_SUB_STAGES || e < 1 || e > MAX_SUB_STAGES ||
+      m < 1 || m > MAX_SUB_STAGES) {
+    fprintf(stderr, "--stages expects IF,EX,MEM sub-stage counts from 1 to %d\n",
+            MAX_SUB_STAGES);
+    return -1;
+  }
+  stages[0] = f; stages[1] = e; stages[2] = m;
+  return 0;
+}
+
+/* parse "--mem-size N[K|M|G]": a whole number of pages up to the full 4 GiB
+ * address space */
+int parse_mem_size(const char *arg, uint64_t *size_p) {
+  char *end;
+  unsigned long long size = strtoull(arg, &end, 0);
+  int shift = 0;
+  switch (*end) {
+  case 'K': case 'k': shift = 10; end++; break;
+  case 'M': case 'm': shift = 20; end++; break;
+  case 'G': case 'g': shift = 30; end++; break;
+  }
+  if (*arg == '\0' || *arg == '-' || *end != '\0' || size == 0 ||
+      size > (MEMORY_SPACE >> shift) || (size << shift) % MEM_PAGE_SIZE != 0) {
+    fprintf(stderr, "--mem-size expects a multiple of %u bytes up to 4G\n",
+            MEM_PAGE_SIZE);
+    return -1;
+  }
+  *size_p = size << shift;
+  return 0;
+}
+
+/* parse "--misaligned trap|split|penalty[:N]", N extra cycles (default 1)
+ * for every misaligned load or store in the pipeline */
+int parse_misaligned(const char *arg, mem_misaligned_t *policy_p,
+                     uint16_t *penalty_p) {
+  *penalty_p = 0;
+  if (strcmp(arg, "trap") == 0) {
+    *policy_p = MEM_MISALIGNED_TRAP;
+    return 0;
+  }
+  if (strcmp(arg, "split") == 0) {
+    *policy_p = MEM_MISALIGNED_SPLIT;
+    return 0;
+  }
+  if (strcmp(arg, "penalty") == 0) {
+    *policy_p = MEM_MISALIGNED_PENALTY;
+    *penalty_p = 1;
+    return 0;
+  }
+  if (strncmp(arg, "penalty:", 8) == 0) {
+    char *end;
+    long cycles = strtol(arg + 8, &end, 10);
+    if (arg[8] != '\0' && *end == '\0' && cycles >= 0 && cycles <= UINT16_MAX) {
+      *policy_p = MEM_MISALIGNED_PENALTY;
+      *penalty_p = (uint16_t)cycles;
+      return 0;
+    }
+  }
+  fprintf(stderr, "--misaligned expects trap, split or penalty[:cycles]\n");
+  return -1;
+}
 
-    offset += 4;
+/* "--trace" and "--stats" list items and the sim_config flag each one sets */
+typedef struct {
+  const char *name;
+  bool *flag;
+} output_item_t;
+
+static const output_item_t trace_items[] = {
+  {"cycle", &sim_config.trace_cycle},
+  {"regs",  &sim_config.trace_regs},
+  {"cache", &sim_config.trace_cache},
+  {NULL, NULL}
+};
+
+static const output_item_t stats_items[] = {
+  {"pipeline", &sim_config.print_stats},
+  {"cache",    &sim_config.print_cache_stats},
+  {"cpi",      &sim_config.print_cpi_stack},
+  {NULL, NULL}
+};
+
+/* parse a comma-separated list like "cycle,regs" or "none"; it replaces the
+ * config.h defaults of every item in `items` */
+int parse_output_list(const char *opt, const char *arg,
+                      const output_item_t *items) {
+  const output_item_t *it;
+  for (it = items; it->name; it++)
+    *it->flag = false;
+
+  while (*arg) {
+    size_t len = strcspn(arg, ",");
+    if (len == 4 && strncmp(arg, "none", 4) == 0) {
+      // nothing to set
+    } else {
+      for (it = items; it->name; it++) {
+        if (strlen(it->name) == len && strncmp(arg, it->name, len) == 0)
+          break;
+      }
+      if (it->name == NULL) {
+        fprintf(stderr, "--%s expects a list of", opt);
+        for (it = items; it->name; it++)
+          fprintf(stderr, " %s,", it->name);
+        fprintf(stderr, " or none\n");
+        return -1;
+      }
+      *it->flag = true;
+    }
+    arg += len;
+    if (*arg == ',')
+      arg++;
   }
-  return programsize;
+  return 0;
 }
 
 int main(int argc, char **argv) {
@@ -93,17 +264,56 @@ int main(int argc, char **argv) {
       opt_init_reg = 0,
       opt_cache = 0,
       opt_forwarding = 0,
-      opt_printmem = 0;
+      opt_printmem = 0,
+      opt_store_fwd = 0,
+      opt_split_mem = 0,
+      opt_cosim = 0,
+      opt_misaligned_stats = 0;
 
   uint32_t print_mem_startaddr = 0, print_mem_stopaddr = 0;
+  uint8_t opt_stages[3] = {1, 1, 1};   // IF, EX, MEM sub-stages
+  int opt_sb_entries = 0;               // store buffer entries, 0 = none
+  int opt_fq_entries = 0;               // fetch queue entries, 0 = none
+  int opt_lb_words = 0;                 // loop buffer instructions, 0 = none
+  const char* opt_trace_bin = NULL;     // binary cycle trace file
+  const char* opt_konata = NULL;        // Konata pipeline view
+  const char* opt_chrome_trace = NULL;  // Chrome trace_event pipeline view
+  uint64_t opt_mem_size = MEMORY_SPACE; // guest memory size in bytes
+  mem_misaligned_t opt_misaligned = MEM_MISALIGNED_SPLIT;
+  uint16_t opt_misaligned_penalty = 0;  // cycles per misaligned access
+  int opt_profile_top = -1;             // profile rows, 0 = all, -1 = no profile
+  const char* opt_cpi_csv = NULL;       // CPI stack CSV file
+  const char* opt_stats_out = NULL;     // stats registry file, JSON or CSV
+  uint64_t opt_stats_interval = 0;      // cycles between samples, 0 = totals only
+  int opt_host_period = HS_DEFAULT_PERIOD; // --host-stats times 1 cycle in N
+  int opt_harts = 1;                    // pipelines sharing the memory
+  uint64_t opt_quantum = HART_DEFAULT_QUANTUM; // cycles the harts run apart
+  int opt_amo_latency = AMO_DEFAULT_LATENCY; // extra cycles of amo*.w and sc.w
 
 
   /* the architectural state of the CPU */
   regfile_t regfile;
 
+  /* output defaults from config.h, --trace and --stats replace them */
+  #ifdef DEBUG_CYCLE
+  sim_config.trace_cycle = true;
+  #endif
+  #ifdef DEBUG_REG_TRACE
+  sim_config.trace_regs = true;
+  #endif
+  #ifdef PRINT_CACHE_TRACES
+  sim_config.trace_cache = true;
+  #endif
+  #ifdef PRINT_STATS
+  sim_config.print_stats = true;
+  #endif
+  #ifdef PRINT_CACHE_STATS
+  sim_config.print_cache_stats = true;
+  #endif
+
   /* parse the command-line args */
   int c;
-  while ((c = getopt(argc, argv, "dvritesmpcf")) != -1) {
+  while ((c = getopt_long(argc, argv, "dvritesmpcf", long_options, NULL)) != -1) {
     switch (c) {
     case 'd':
       opt_disasm = 1; break;
@@ -125,6 +335,118 @@ int main(int argc, char **argv) {
       opt_cache = 1; break;
     case 'f':
       opt_forwarding = 1; break;
+    case OPT_STORE_FWD:
+      opt_store_fwd = 1; break;
+    case OPT_SPLIT_MEM:
+      opt_split_mem = 1; break;
+    case OPT_COSIM:
+      opt_cosim = 1; break;
+    case OPT_DEPTH:
+    case OPT_STAGES:
+      if (parse_pipeline_depth(c, optarg, opt_stages) != 0)
+        return -1;
+      break;
+    case OPT_STORE_BUFFER:
+      opt_sb_entries = atoi(optarg);
+      if (opt_sb_entries < 1 || opt_sb_entries > SB_MAX_ENTRIES) {
+        fprintf(stderr, "--store-buffer expects 1 to %d entries\n", SB_MAX_ENTRIES);
+        return -1;
+      }
+      break;
+    case OPT_FETCH_QUEUE:
+      opt_fq_entries = atoi(optarg);
+      if (opt_fq_entries < 1 || opt_fq_entries > FQ_MAX_ENTRIES) {
+        fprintf(stderr, "--fetch-queue expects 1 to %d entries\n", FQ_MAX_ENTRIES);
+        return -1;
+      }
+      break;
+    case OPT_TRACE_BIN:
+      opt_trace_bin = optarg; break;
+    case OPT_KONATA:
+      opt_konata = optarg; break;
+    case OPT_CHROME_TRACE:
+      opt_chrome_trace = optarg; break;
+    case OPT_TRACE:
+      if (parse_output_list("trace", optarg, trace_items) != 0)
+        return -1;
+      break;
+    case OPT_STATS:
+      if (parse_output_list("stats", optarg, stats_items) != 0)
+        return -1;
+      break;
+    case OPT_MEM_LATENCY: {
+      char *end;
+      long latency = strtol(optarg, &end, 10);
+      if (*optarg == '\0' || *end != '\0' || latency < 0 || latency > 100000) {
+        fprintf(stderr, "--mem-latency expects 0 to 100000 cycles\n");
+        return -1;
+      }
+      mem_latency = (int)latency;
+      break;
+    }
+    case OPT_MEM_SIZE:
+      if (parse_mem_size(optarg, &opt_mem_size) != 0)
+        return -1;
+      break;
+    case OPT_MISALIGNED:
+      if (parse_misaligned(optarg, &opt_misaligned, &opt_misaligned_penalty) != 0)
+        return -1;
+      opt_misaligned_stats = 1;
+      break;
+    case OPT_PROFILE:
+      opt_profile_top = (optarg) ? atoi(optarg) : 20;
+      if (opt_profile_top < 0) {
+        fprintf(stderr, "--profile expects the number of rows, 0 for all\n");
+        return -1;
+      }
+      break;
+    case OPT_CPI_STACK:
+      opt_cpi_csv = optarg; break;
+    case OPT_STATS_OUT:
+      opt_stats_out = optarg; break;
+    case OPT_HOST_STATS:
+      host_stats_en = true;
+      opt_host_period = (optarg) ? atoi(optarg) : HS_DEFAULT_PERIOD;
+      if (opt_host_period < 1) {
+        fprintf(stderr, "--host-stats expects 1 timed cycle in N, N >= 1\n");
+        return -1;
+      }
+      break;
+    case OPT_STATS_INTERVAL:
+      opt_stats_interval = strtoull(optarg, NULL, 0);
+      if (opt_stats_interval == 0) {
+        fprintf(stderr, "--stats-interval expects a number of cycles\n");
+        return -1;
+      }
+      break;
+    case OPT_HARTS:
+      opt_harts = atoi(optarg);
+      if (opt_harts < 1 || opt_harts > MAX_HARTS) {
+        fprintf(stderr, "--harts expects 1 to %d harts\n", MAX_HARTS);
+        return -1;
+      }
+      break;
+    case OPT_QUANTUM:
+      opt_quantum = strtoull(optarg, NULL, 0);
+      if (opt_quantum == 0) {
+        fprintf(stderr, "--quantum expects a number of cycles\n");
+        return -1;
+      }
+      break;
+    case OPT_AMO_LATENCY:
+      opt_amo_latency = atoi(optarg);
+      if (opt_amo_latency < 0 || opt_amo_latency > UINT16_MAX) {
+        fprintf(stderr, "--amo-latency expects a number of cycles\n");
+        return -1;
+      }
+      break;
+    case OPT_LOOP_BUFFER:
+      opt_lb_words = atoi(optarg);
+      if (opt_lb_words < 1 || opt_lb_words > LB_MAX_WORDS) {
+        fprintf(stderr, "--loop-buffer expects 1 to %d instructions\n", LB_MAX_WORDS);
+        return -1;
+      }
+      break;
     case 'p':
       opt_printmem = 1;
       if (optind < argc - 1) { // Ensure there are two more arguments
@@ -141,23 +463,56 @@ int main(int argc, char **argv) {
     }
   }
 
+  if (opt_lb_words && !opt_fq_entries) {
+    fprintf(stderr, "--loop-buffer needs a fetch queue (--fetch-queue)\n");
+    return -1;
+  }
+  if (opt_stats_interval && !opt_stats_out) {
+    fprintf(stderr, "--stats-interval needs a stats file (--stats-out)\n");
+    return -1;
+  }
+  // the traces, the lockstep emulator and the per-instruction outputs
+  // follow a single pipeline
+  if (opt_harts > 1 && (!opt_sim || opt_cosim || opt_trace_bin || opt_konata ||
+                        opt_chrome_trace || opt_profile_top >= 0 || opt_stats_out)) {
+    fprintf(stderr, "--harts needs -s and does not go with --cosim, --trace-bin, "
+                    "--konata, --chrome-trace, --profile or --stats-out\n");
+    return -1;
+  }
+  if (opt_harts > 1) {
+    sim_config.trace_cycle = false;
+    sim_config.trace_regs  = false;
+    sim_config.trace_cache = false;
+  }
+
   /* make sure we got an executable filename on the command line */
   if (argc <= optind) {
     fprintf(stderr, "Give me an executable file to run!\n");
     return -1;
   }
   
-  Cache cache;
+  const Cache l1 = {.setBits = CACHE_SET_BITS, .linesPerSet = CACHE_LINES_PER_SET,
+                    .blockBits = CACHE_BLOCK_BITS, .lfu = CACHE_LFU,
+                    .displayTrace = CACHE_DISPLAY_TRACE};
+  Cache cache = l1;
   cacheSetUp(&cache, "L1");
   /* load the executable into memory */
   assert(memory == NULL);
-  memory = calloc(MEMORY_SPACE, sizeof(uint8_t)); // allocate zeroed memory
-  assert(memory != NULL);
+  memory = mem_create(opt_mem_size);  // pages are allocated on first write
+  memory->misaligned = opt_misaligned;
   int prog_numins = 0;
-  /* set the PC to 0x1000 */
+  /* set the PC to 0x1000, an ELF executable starts at its entry point */
   regfile.PC = 0x1000;
-  prog_numins = load_program(memory, MEMORY_SPACE, regfile.PC, argv[optind],
-                             opt_disasm);
+  bool prog_elf = is_elf_file(argv[optind]);
+  if (prog_elf) {
+    prog_numins = load_elf(memory, argv[optind], &regfile.PC, opt_disasm);
+    if (prog_numins < 0)
+      return -1;
+  } else {
+    prog_numins = load_program(memory, regfile.PC, argv[optind], opt_disasm);
+    if (prog_numins < 0)
+      return -1;
+  }
   /* if we're just disassembling, exit here */
   if (opt_disasm) {
     return 0;
@@ -177,6 +532,9 @@ int main(int argc, char **argv) {
   /* Set the global pointer to 0x3000. We arbitrarily call this the middle of
    * the static data segment */
   regfile.R[3] = 0x3000;
+  Address gp;
+  if (prog_elf && elf_symbol_addr("__global_pointer$", &gp))
+    regfile.R[3] = gp;
 
   /* Set the stack pointer near the top of the memory array */
   regfile.R[2] = 0xEFFFF;
@@ -188,23 +546,64 @@ int main(int argc, char **argv) {
   total_cycle_counter = 0;
   mem_access_counter = 0;
 
+  sim_config.if_stages  = opt_stages[0];
+  sim_config.ex_stages  = opt_stages[1];
+  sim_config.mem_stages = opt_stages[2];
+  sim_config.sb_entries = opt_sb_entries;
+  sim_config.fq_entries = opt_fq_entries;
+  sim_config.lb_words   = opt_lb_words;
+  sim_config.misaligned_penalty = opt_misaligned_penalty;
+  sim_config.amo_latency = opt_amo_latency;
+  sim_config.profile_en = (opt_profile_top >= 0);
+  sim_config.pipeview_en = (opt_konata || opt_chrome_trace);
+
   bootstrap(&pipeline_wires, &pipeline_regs, &regfile);
 
+  // harts 1.. start where hart 0 does, each with a stack of its own
+  hart_t* harts = calloc(opt_harts, sizeof(hart_t));
+  for (i = 1; i < opt_harts; i++) {
+    harts[i].id = i;
+    harts[i].regfile = regfile;
+    harts[i].regfile.R[2] -= i * HART_STACK_SIZE;
+    harts[i].memory = mem_view(memory);
+    harts[i].cache = l1;   // set up on the hart's thread
+  }
+
+  trace_init(sim_config.if_stages, sim_config.ex_stages, sim_config.mem_stages);
+  if (opt_trace_bin && trace_open_bin(opt_trace_bin) != 0) {
+    fprintf(stderr, "Cannot write trace file %s\n", opt_trace_bin);
+    return -1;
+  }
+  if (opt_konata && pv_open_konata(opt_konata) != 0) {
+    fprintf(stderr, "Cannot write Konata file %s\n", opt_konata);
+    return -1;
+  }
+  if (opt_chrome_trace && pv_open_chrome(opt_chrome_trace) != 0) {
+    fprintf(stderr, "Cannot write Chrome trace file %s\n", opt_chrome_trace);
+    return -1;
+  }
+
   // EMULATOR
   if(opt_mulator)
   {
+    if (host_stats_en)
+      hs_start(opt_host_period);
     if (opt_exit) {
-      /* simulate forever! */
-      while (1) {
+      /* simulate until the program exits */
+      while (!emu_exited) {
         execute_emu(&regfile, opt_interactive, opt_regdump);
       }
     } else {
       /* Either simulate for program instructions */
-      while (simins < prog_numins) {
+      while (simins < prog_numins && !emu_exited) {
         execute_emu(&regfile, opt_interactive, opt_regdump);
         simins++;
       }
     }
+    if (host_stats_en) {
+      hs_stop();
+      hs_print(0, emu_instret, false);
+    }
   }
 
   // CYCLE ACCURATE SIMULATOR
@@ -212,46 +611,83 @@ int main(int argc, char **argv) {
   {
     if(opt_cache) sim_config.cache_en = true;
     if(opt_forwarding) sim_config.fwd_en = true;
-    bool ecall_exit = false;
-    if (opt_exit) {
-      /* simulate forever! */
-      while (1) {
-        cycle_pipeline(&regfile, memory, &cache, &pipeline_regs, &pipeline_wires, &ecall_exit);
-        if(ecall_exit) break;
-      }
-    } else {
-      /* Either simulate for program instructions */
-      while (simins < prog_numins) {
-        cycle_pipeline(&regfile, memory, &cache, &pipeline_regs, &pipeline_wires, &ecall_exit);
-        simins++;
-      }
+    if(opt_store_fwd) sim_config.store_fwd_en = true;
+    if(opt_split_mem) sim_config.split_mem_en = true;
+    if(opt_cosim) {
+      sim_config.cosim_en = true;
+      cosim_init(&regfile, memory);
     }
-    printf("\n========\n[MAIN]: Flushing pipeline\n========\n");
-    simins = 0;
-    prog_numins = load_program(memory, MEMORY_SPACE, pipeline_wires.pc_src0, "./code/input/FLUSH.input",
-                            opt_disasm);
-    while (simins < prog_numins) {
-      cycle_pipeline(&regfile, memory, &cache, &pipeline_regs, &pipeline_wires, &ecall_exit);
-      simins++;
+    if (opt_stats_out && stats_open(opt_stats_out, opt_stats_interval) != 0) {
+      fprintf(stderr, "Cannot write stats file %s\n", opt_stats_out);
+      return -1;
     }
-
-    #ifdef PRINT_STATS
+    if (host_stats_en)
+      hs_start(opt_host_period);
+    /* simulate to the ecall with -e, for program instructions otherwise */
+    int run_cycles = (opt_exit) ? -1 : prog_numins;
+    // the L1s of the harts are kept coherent
+    if (opt_harts > 1 && sim_config.cache_en)
+      coh_attach(&cache);
+    harts_start(harts, opt_harts, opt_quantum, run_cycles);
+    hart_run(&regfile, memory, &cache, &pipeline_regs, &pipeline_wires, run_cycles);
+    harts_join(harts, opt_harts);
+    if (host_stats_en)
+      hs_stop();
+    trace_close();
+    if (sim_config.pipeview_en)
+      pv_close();
+    stats_close();
+
+    if (sim_config.print_stats) {
     printf("#Cycles            = %5ld\n", total_cycle_counter);
     printf("#Forwards (EX-EX)  = %5ld\n", fwd_exex_counter);
     printf("#Forwards (EX-MEM) = %5ld\n", fwd_exmem_counter);
     printf("#Branches taken    = %5ld\n", branch_counter);
     printf("#Stalls            = %5ld\n", stall_counter);
-    #endif
-    #ifdef PRINT_CACHE_STATS
-      #if defined(CACHE_ENABLE)
-      printf("#MEM   stalls      = %5ld\n", ((miss_count*MEM_LATENCY) + ((hit_count+miss_count) * (CACHE_HIT_LATENCY-1))));
-      #else
-      printf("#MEM   stalls      = %5ld\n", (mem_access_counter*(MEM_LATENCY-1)));
-      #endif
+    if (pipeline_depth() != 5) {
+    printf("#Pipeline depth    = %5d (IF %d, EX %d, MEM %d)\n", pipeline_depth(),
+           sim_config.if_stages, sim_config.ex_stages, sim_config.mem_stages);
+    }
+    if (sim_config.store_fwd_en || sim_config.split_mem_en) {
+    printf("#Forwards (MEM-EX) = %5ld\n", fwd_memex_counter);
+    printf("#Forwards (MEM-MEM)= %5ld\n", fwd_memmem_counter);
+    printf("#Stalls removed    = %5ld\n", stall_removed_counter);
+    }
+    // only with --misaligned, the milestone reference stats predate it
+    if (opt_misaligned_stats) {
+    printf("#Misaligned        = %5ld\n", misaligned_counter);
+    if (sim_config.misaligned_penalty)
+    printf("#Misaligned stalls = %5ld\n", misaligned_stall_counter);
+    }
+    // only programs using RV32A, the milestone reference stats predate it
+    if (amo_counter) {
+    printf("#Atomics           = %5ld\n", amo_counter);
+    printf("#SC failures       = %5ld\n", sc_fail_counter);
+    printf("#Atomic stalls     = %5ld\n", amo_stall_counter);
+    }
+    if (store_buffer.size)
+      sb_print_stats(&store_buffer);
+    if (fetch_unit.size)
+      fq_print_stats(&fetch_unit);
+    if (sim_config.cosim_en)
+      cosim_print_stats();
+    }
+    if (sim_config.print_cache_stats) {
+      printf("#MEM   stalls      = %5ld\n", mem_stall_cycles());
       printf("#Cache accesses    = %5ld\n", hit_count+miss_count);
       printf("#Cache hits        = %5ld\n", hit_count);
       printf("#Cache misses      = %5ld\n", miss_count);
-    #endif
+    }
+    if (sim_config.print_cpi_stack)
+      cpi_print_stack();
+    if (opt_cpi_csv && cpi_write_csv(opt_cpi_csv) != 0)
+      fprintf(stderr, "Cannot write CPI stack file %s\n", opt_cpi_csv);
+    if (sim_config.profile_en)
+      prof_print(opt_profile_top);
+    if (host_stats_en)
+      hs_print(total_cycle_counter, cpi_cycles[CPI_BASE], true);
+    if (opt_harts > 1)
+      harts_print(harts, opt_harts);
 
   }
 
@@ -268,7 +704,7 @@ int main(int argc, char **argv) {
       for (uint32_t j = 0; j < 16; j+=4)     // of 4 Words each = 16 bytes
       {
         uint32_t index = (print_mem_startaddr) + i + j;
-        printf("M:0x%04x=%08x ", index, memory[index]);
+        printf("M:0x%04x=%08x ", index, load(memory, index, LENGTH_BYTE));
       }
       printf("\n");
     }
@@ -277,5 +713,11 @@ int main(int argc, char **argv) {
 
   // Deallocate the cache after all operations
   deallocate(&cache);
+  for (i = 1; i < opt_harts; i++) {
+    deallocate(&harts[i].cache);
+    mem_destroy(harts[i].memory);
+  }
+  free(harts);
+  mem_destroy(memory);
   return 0;
 }
@@ -3,20 +3,50 @@
 
 #include <stdbool.h>
 #include "types.h"
+#include "guest_mem.h"
 
 /* see disasm.c */
 void decode_instruction(uint32_t instruction_bits);
+void disasm_string(uint32_t instruction_bits, char* buf, size_t size);
 
 /* see emulator.c */
-void execute_instruction(uint32_t instruction_bits, regfile_t* regfile, Byte *memory);
-void store(Byte *memory, Address address, Alignment alignment, Word value);
-Word load(Byte *memory, Address address, Alignment alignment);
+void execute_instruction(uint32_t instruction_bits, regfile_t* regfile, memory_t *memory);
+extern uint64_t emu_instret;
+extern bool     emu_exited;
+
+/* load() and store() are in guest_mem.h */
+
+// state of the hart a host thread simulates; with --harts every hart runs
+// the pipeline on a thread of its own (see hart.h)
+#define HART_LOCAL __thread
+extern HART_LOCAL Word hart_id;
 
 // Settings for cycle accurate simulator
 typedef struct
 {
     bool cache_en;
     bool fwd_en;
+    bool store_fwd_en;  // MEM->MEM forwarding of load data into a store
+    bool split_mem_en;  // split MEM stage, load data reaches EX in MEM
+    // pipeline depth: number of sub-stages IF, EX and MEM are split into
+    uint8_t if_stages;
+    uint8_t ex_stages;
+    uint8_t mem_stages;
+    uint8_t sb_entries;  // store buffer entries between MEM and memory, 0 = none
+    uint8_t fq_entries;  // fetch queue entries in front of IF, 0 = none
+    uint8_t lb_words;    // loop buffer size in instructions, 0 = none
+    bool cosim_en;       // check every retired instruction against the emulator
+    uint16_t misaligned_penalty;  // extra cycles of a misaligned load/store
+    uint16_t amo_latency;         // extra cycles of an amo*.w or sc.w
+    bool profile_en;     // charge cycles and events to each instruction
+    bool pipeview_en;    // export stage occupancy (--konata, --chrome-trace)
+    // output, defaults from config.h, set with --trace and --stats
+    bool trace_cycle;        // stage lines every cycle (DEBUG_CYCLE)
+    bool trace_regs;         // register dump every cycle (DEBUG_REG_TRACE)
+    bool trace_cache;        // cache trace per access (PRINT_CACHE_TRACES)
+    bool print_stats;        // pipeline stats at the end (PRINT_STATS)
+    bool print_cache_stats;  // cache stats at the end (PRINT_CACHE_STATS)
+    bool print_cpi_stack;    // CPI stack at the end (--stats cpi)
 }simulator_config_t;
 
 #endif
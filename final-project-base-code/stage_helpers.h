@@ -5,6 +5,8 @@
 #include <stdio.h>
 #include "utils.h"
 #include "pipeline.h"
+#include "trace.h"
+#include "atomic.h"
 
 /// EXECUTE STAGE HELPERS ///
 
@@ -52,12 +54,32 @@ uint32_t gen_alu_control(idex_reg_t idex_reg)
                 case 0x1:
                 alu_control = 0xB; // BNE comparison
                 break;
+                case 0x4:
+                alu_control = 0xE; // BLT comparison
+                break;
+                case 0x5:
+                alu_control = 0xF; // BGE comparison
+                break;
+                case 0x6:
+                alu_control = 0x10; // BLTU comparison
+                break;
+                case 0x7:
+                alu_control = 0x11; // BGEU comparison
+                break;
             }
             break;
             
         case 0x03: case 0x23: // Load/Store
             alu_control = 0x0; // Address calculation
             break;
+
+        case 0x67: // JALR
+            alu_control = 0x0; // Target address rs1 + imm
+            break;
+
+        case 0x17: // AUIPC
+            alu_control = 0x0; // PC + imm (ALU input A is the PC)
+            break;
             
         case 0x37: // LUI
             alu_control = 0xC; // Pass immediate
@@ -87,6 +109,10 @@ uint32_t execute_alu(uint32_t alu_inp1, uint32_t alu_inp2, uint32_t alu_control)
         case 0xA: result = !!(alu_inp1 - alu_inp2); break;  // BEQ comparison zero technically should be subtraction EQUAL = 0 NOT EQUAL = 1
         case 0xB: result = !(alu_inp1 ^ alu_inp2); break;// BNEQ comparison EQUAL = 1 NOT EQUAL =0
         case 0xC: result = alu_inp2; break;  // LUI (pass immediate)
+        case 0xE: result = !((int32_t)alu_inp1 < (int32_t)alu_inp2); break;  // BLT comparison TAKEN = 0
+        case 0xF: result = !((int32_t)alu_inp1 >= (int32_t)alu_inp2); break; // BGE comparison TAKEN = 0
+        case 0x10: result = !(alu_inp1 < alu_inp2); break;  // BLTU comparison TAKEN = 0
+        case 0x11: result = !(alu_inp1 >= alu_inp2); break; // BGEU comparison TAKEN = 0
         default: result = 0xBADCAFFE; break;
     }
     return result;
@@ -101,7 +127,7 @@ uint32_t gen_imm(Instruction instruction)
         case 0x63: // B-type
             imm_val = get_branch_offset(instruction);
             break;
-        case 0x03: case 0x13: case 0x73: // I-type
+        case 0x03: case 0x13: case 0x67: case 0x73: // I-type
             imm_val = sign_extend_number(instruction.itype.imm, 12);
             if (instruction.itype.funct3 == 0x5 && ((imm_val >> 5) == 0x20)) //check if the shifting is correct
                 imm_val = imm_val & 0x1F; 
@@ -109,7 +135,7 @@ uint32_t gen_imm(Instruction instruction)
         case 0x23: // S-type
             imm_val = get_store_offset(instruction);
             break;
-        case 0x37: // U-type
+        case 0x37: case 0x17: // U-type
             imm_val = instruction.utype.imm << 12;
             break;
         case 0x6f: // UJ-type
@@ -188,6 +214,7 @@ idex_reg_t gen_control(Instruction instruction)
             
         case 0x37: case 0x17: // LUI/AUIPC
             idex_reg.EX_ALUSrc = true;
+            idex_reg.EX_ALUSrcA = (instruction.opcode == 0x17);
             idex_reg.WB_RegWrite = true;
             idex_reg.M_MemRead = false;
             idex_reg.M_MemWrite = false;
@@ -208,6 +235,22 @@ idex_reg_t gen_control(Instruction instruction)
             idex_reg.WB_WBSRC = true;
             break;
 
+        case 0x73:    // csrrw/csrrs/csrrc (ecall has no control signals)
+            if (instruction.itype.funct3 == 0)
+                break;
+            idex_reg.WB_RegWrite = true;
+            idex_reg.WB_MemToReg = true;
+            idex_reg.M_CSR = true;
+            break;
+
+        case 0x2F:    // lr.w/sc.w/amo*.w, unknown ones do nothing
+            if (!amo_valid(instruction))
+                break;
+            idex_reg.WB_RegWrite = true;
+            idex_reg.WB_MemToReg = true;
+            idex_reg.M_Atomic = true;
+            break;
+
         case 0x67:    //jalr
             idex_reg.WB_RegWrite = true;
             idex_reg.EX_ALUSrc = true;
@@ -216,6 +259,7 @@ idex_reg_t gen_control(Instruction instruction)
             idex_reg.M_MemWrite = false;
             idex_reg.M_Branch = false;
             idex_reg.M_JAL = true;
+            idex_reg.M_JALR = true;
             idex_reg.WB_WBSRC = true;
             break;
             
@@ -227,6 +271,65 @@ idex_reg_t gen_control(Instruction instruction)
 
 /// MEMORY STAGE HELPERS ///
 
+/**
+ * memory as seen by a load: with a store buffer, bytes of stores that have
+ * not been written back yet are forwarded from it
+ **/
+Word mem_load(memory_t* memory_p, Address address, Alignment alignment)
+{
+    if (store_buffer.size)
+        return sb_load(&store_buffer, memory_p, address, alignment, NULL);
+    return load(memory_p, address, alignment);
+}
+
+/**
+ * access size of a load or store
+ **/
+Alignment mem_access_len(Instruction instr)
+{
+    switch (instr.itype.funct3 & 0x3) {
+        case 0x0: return LENGTH_BYTE;
+        case 0x1: return LENGTH_HALF_WORD;
+        default:  return LENGTH_WORD;
+    }
+}
+
+/**
+ * true if the load in MEM takes any of its bytes from the store buffer
+ **/
+bool load_hits_store_buffer(exmem_reg_t exmem_reg, memory_t* memory_p)
+{
+    bool hit = false;
+    sb_load(&store_buffer, memory_p, exmem_reg.ALU_result, mem_access_len(exmem_reg.instr), &hit);
+    return hit;
+}
+
+uint32_t mem_read_data(exmem_reg_t exmem_reg, memory_t* memory_p)
+{
+    uint32_t read_data = 0;
+    switch (exmem_reg.instr.itype.funct3) {
+        case 0x0: // Load Byte
+            read_data = sign_extend_number(mem_load(memory_p, exmem_reg.ALU_result, LENGTH_BYTE), 8);
+            break;
+        case 0x1: // Load Halfword
+            read_data = sign_extend_number(mem_load(memory_p, exmem_reg.ALU_result, LENGTH_HALF_WORD), 16);
+            break;
+        case 0x2: // Load Word
+            read_data = mem_load(memory_p, exmem_reg.ALU_result, LENGTH_WORD);
+            break;
+        case 0x4: // Load Byte Unsigned
+            read_data = mem_load(memory_p, exmem_reg.ALU_result, LENGTH_BYTE);
+            break;
+        case 0x5: // Load Halfword Unsigned
+            read_data = mem_load(memory_p, exmem_reg.ALU_result, LENGTH_HALF_WORD);
+            break;
+        default:
+            trace_text("Invalid load instruction\n");
+            break;
+    }
+    return read_data;
+}
+
 bool gen_branch(exmem_reg_t exmem_reg)
 {
     bool branch = exmem_reg.M_Branch;
@@ -234,38 +337,172 @@ bool gen_branch(exmem_reg_t exmem_reg)
     return (branch & zero);
 }
 
+/// WRITEBACK STAGE HELPERS ///
+
+uint32_t gen_wb_data(memwb_reg_t memwb_reg)
+{
+    // Memory to register mux
+    uint32_t muxout = (memwb_reg.WB_MemToReg == 1) ? memwb_reg.Read_Data
+                                                   : memwb_reg.ALU_result;
+    // Write back source mux (for JAL/JALR)
+    return (memwb_reg.WB_WBSRC == 1) ? memwb_reg.instr_addr + 4 : muxout;
+}
+
 /// PIPELINE FEATURES ///
 
-void gen_forward(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p)
+/**
+ * In-flight instructions between ID and WB are addressed by the sub-stage
+ * they are processed in this cycle: 1 = EX1 ... E = EXe, E+1 = MEM1 ...
+ * E+M = MEMm, E+M+1 = WB. Each one is read from the register feeding
+ * that sub-stage.
+ **/
+typedef struct
 {
-    pwires_p->fwdA = FWD_REG;
-    pwires_p->fwdB = FWD_REG;
+    bool     reg_write;
+    bool     is_load;
+    bool     is_csr;    // a CSR read or an atomic, ready when a load is but never early
+    uint8_t  rd;
+    uint32_t value;     // value written back, when it is already known
+}inflight_t;
 
-    uint8_t rs1 = pregs_p->idex_preg.inp.instr.rtype.rs1;
-    uint8_t rs2 = pregs_p->idex_preg.inp.instr.rtype.rs2;
-    uint8_t exmem_rd = pregs_p->exmem_preg.out.instr.rtype.rd;
-    uint8_t memwb_rd = pregs_p->memwb_preg.out.instr.rtype.rd;
+inflight_t inflight_at(pipeline_regs_t* pregs_p, uint8_t pos)
+{
+    inflight_t in = {0};
+    uint8_t E = sim_config.ex_stages;
+    uint8_t M = sim_config.mem_stages;
 
-    // EX/MEM → ID/EX
-    if (pregs_p->exmem_preg.out.WB_RegWrite && exmem_rd != 0 && exmem_rd == rs1) {
-        pwires_p->fwdA = FWD_EXMEM;
-        fwd_exex_counter++;
+    if (pos == 1) {
+        idex_reg_t* r = &pregs_p->idex_preg.out;
+        in = (inflight_t){r->WB_RegWrite, r->M_MemRead || r->M_CSR || r->M_Atomic, r->M_CSR || r->M_Atomic, r->instr.rtype.rd, 0};
+    } else if (pos <= E) {
+        exmem_reg_t* r = &pregs_p->ex_sub_preg[pos-2].out;
+        in = (inflight_t){r->WB_RegWrite, r->M_MemRead || r->M_CSR || r->M_Atomic, r->M_CSR || r->M_Atomic, r->instr.rtype.rd, r->ALU_result};
+    } else if (pos == E+1) {
+        exmem_reg_t* r = &pregs_p->exmem_preg.out;
+        in = (inflight_t){r->WB_RegWrite, r->M_MemRead || r->M_CSR || r->M_Atomic, r->M_CSR || r->M_Atomic, r->instr.rtype.rd, r->ALU_result};
+    } else if (pos <= E+M) {
+        memwb_reg_t* r = &pregs_p->mem_sub_preg[pos-E-2].out;
+        in = (inflight_t){r->WB_RegWrite, r->WB_MemToReg, r->instr.opcode == 0x73 || r->instr.opcode == 0x2F, r->instr.rtype.rd, gen_wb_data(*r)};
+    } else {
+        memwb_reg_t* r = &pregs_p->memwb_preg.out;
+        in = (inflight_t){r->WB_RegWrite, r->WB_MemToReg, r->instr.opcode == 0x73 || r->instr.opcode == 0x2F, r->instr.rtype.rd, gen_wb_data(*r)};
     }
-    if (pregs_p->exmem_preg.out.WB_RegWrite && exmem_rd != 0 && exmem_rd == rs2) {
-        pwires_p->fwdB = FWD_EXMEM;
-        fwd_exex_counter++;
+    return in;
+}
+
+/**
+ * position of the youngest in-flight instruction at or after `from` that
+ * writes `reg`, 0 if there is none
+ **/
+uint8_t find_producer(pipeline_regs_t* pregs_p, uint8_t reg, uint8_t from, inflight_t* in_p)
+{
+    if (reg == 0)
+        return 0;
+    uint8_t last = sim_config.ex_stages + sim_config.mem_stages + 1;
+    for (uint8_t pos = from; pos <= last; pos++) {
+        *in_p = inflight_at(pregs_p, pos);
+        if (in_p->reg_write && in_p->rd == reg)
+            return pos;
     }
+    return 0;
+}
+
+/**
+ * the result of an instruction can be forwarded from the register written
+ * by the sub-stage returned here: the last EX sub-stage for ALU results,
+ * the last MEM sub-stage for loads (one earlier with a split MEM stage)
+ **/
+uint8_t result_ready_pos(bool is_load, bool split_mem)
+{
+    uint8_t E = sim_config.ex_stages;
+    uint8_t M = sim_config.mem_stages;
+    if (!is_load)
+        return E;
+    return (split_mem) ? E + M - 1 : E + M;
+}
+
+/**
+ * forwarding select for one EX operand, the producer is processed at `pos`
+ * this cycle so its value sits in the register after sub-stage pos-1
+ **/
+uint8_t gen_forward_operand(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p,
+                            uint8_t rs, uint32_t* data_p)
+{
+    inflight_t in;
+    uint8_t E = sim_config.ex_stages;
+    uint8_t M = sim_config.mem_stages;
+    uint8_t pos = find_producer(pregs_p, rs, 2, &in);
 
+    if (pos == 0 || pos <= E) {
+        // no producer, or it is still in EX and ID/EX holds a bubble
+        return FWD_REG;
+    }
+    if (pos == E+1) {
+        // EX/MEM → ID/EX; a load here only feeds EX through a split MEM
+        if (in.is_load && !in.is_csr && sim_config.split_mem_en && M == 1) {
+            fwd_memex_counter++;
+            return FWD_MEM;
+        }
+        fwd_exex_counter++;
+        return FWD_EXMEM;
+    }
+    if (pos <= E+M) {
+        // MEM sub-stage → ID/EX
+        if (in.is_load && pos - 1 < result_ready_pos(true, sim_config.split_mem_en && !in.is_csr))
+            return FWD_REG;
+        if (in.is_load && pos - 1 < result_ready_pos(true, false))
+            fwd_memex_counter++;
+        else
+            fwd_exmem_counter++;
+        *data_p = in.value;
+        return FWD_SUBSTAGE;
+    }
     // MEM/WB → ID/EX
-    if (pregs_p->memwb_preg.out.WB_RegWrite && memwb_rd != 0 &&
-        memwb_rd == rs1 && exmem_rd != rs1) {
-        pwires_p->fwdA = FWD_MEMWB;
-        fwd_exmem_counter++;
+    fwd_exmem_counter++;
+    return FWD_MEMWB;
+}
+
+void gen_forward(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p)
+{
+    uint8_t rs1 = pregs_p->idex_preg.inp.instr.rtype.rs1;
+    uint8_t rs2 = pregs_p->idex_preg.inp.instr.rtype.rs2;
+    uint8_t memwb_rd = pregs_p->memwb_preg.out.instr.rtype.rd;
+    uint8_t E = sim_config.ex_stages;
+
+    pwires_p->fwdA = gen_forward_operand(pregs_p, pwires_p, rs1, &pwires_p->fwdA_data);
+    pwires_p->fwdB = gen_forward_operand(pregs_p, pwires_p, rs2, &pwires_p->fwdB_data);
+
+    // WB → ID (register file write port)
+    pwires_p->wb_RegWrite = pregs_p->memwb_preg.out.WB_RegWrite;
+    pwires_p->wb_rd       = memwb_rd;
+    pwires_p->wb_data     = gen_wb_data(pregs_p->memwb_preg.out);
+
+    // MEM → MEM: a store entering MEM takes its data from a load that was
+    // not yet forwardable when the store went through EX
+    pwires_p->fwdS = false;
+    if (sim_config.store_fwd_en && pregs_p->exmem_preg.out.M_MemWrite) {
+        inflight_t in;
+        uint8_t store_rs2 = pregs_p->exmem_preg.out.instr.stype.rs2;
+        uint8_t pos = find_producer(pregs_p, store_rs2, E+2, &in);
+        if (pos != 0 && in.is_load &&
+            pos - E - 1 < result_ready_pos(true, sim_config.split_mem_en && !in.is_csr)) {
+            pwires_p->fwdS = true;
+            pwires_p->store_fwd_data = in.value;
+            fwd_memmem_counter++;
+        }
     }
-    if (pregs_p->memwb_preg.out.WB_RegWrite && memwb_rd != 0 &&
-        memwb_rd == rs2 && exmem_rd != rs2) {
-        pwires_p->fwdB = FWD_MEMWB;
-        fwd_exmem_counter++;
+
+    // a CSR read in MEM counts the older instructions in the later MEM
+    // sub-stages and in WB as retired, as the emulator does; nothing that
+    // reached MEM is squashed any more
+    pwires_p->csr_older = 0;
+    if (pregs_p->exmem_preg.out.M_CSR) {
+        for (int i = 0; i < sim_config.mem_stages - 1; i++) {
+            memwb_reg_t* r = &pregs_p->mem_sub_preg[i].out;
+            pwires_p->csr_older += (r->instr.bits != 0 && r->bubble == CPI_BASE);
+        }
+        memwb_reg_t* wb = &pregs_p->memwb_preg.out;
+        pwires_p->csr_older += (wb->instr.bits != 0 && wb->bubble == CPI_BASE);
     }
 }   
 
@@ -274,27 +511,109 @@ void detect_hazard(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p, regfile
 {
     pwires_p->stall = false;
 
-    uint8_t id_rs1 = pregs_p->ifid_preg.out.instr.rtype.rs1;
-    uint8_t id_rs2 = pregs_p->ifid_preg.out.instr.rtype.rs2;
-    uint8_t ex_rd  = pregs_p->idex_preg.out.instr.rtype.rd;
+    Instruction id_instr = pregs_p->ifid_preg.out.instr;
+    uint8_t id_rs[2] = {id_instr.rtype.rs1, id_instr.rtype.rs2};
+    uint8_t E = sim_config.ex_stages;
+    uint8_t M = sim_config.mem_stages;
+    bool stall = false, base_stall = false;
 
-    if (pregs_p->idex_preg.out.M_MemRead &&
-        ((ex_rd == id_rs1) || (ex_rd == id_rs2)) && ex_rd != 0)
-    {
+    for (int i = 0; i < 2; i++) {
+        inflight_t in;
+        uint8_t pos = find_producer(pregs_p, id_rs[i], 1, &in);
+        if (pos == 0)
+            continue;
+
+        // next cycle the consumer is in EX1 and the producer one sub-stage
+        // further, so it must have finished its ready sub-stage by now
+        uint8_t ready = result_ready_pos(in.is_load, sim_config.split_mem_en && !in.is_csr);
+        // a store needing a loaded value only as its data can take it E
+        // cycles later, MEM->MEM, as long as the load has not left WB by
+        // the time the store enters MEM
+        bool store_data_only = (id_instr.opcode == 0x23) && (i == 1) &&
+                               (id_rs[0] != id_rs[1]) && in.is_load;
+        uint8_t slack = (sim_config.store_fwd_en && store_data_only && pos <= M) ? E : 0;
+
+        if (pos < result_ready_pos(in.is_load, false))
+            base_stall = true;
+        if (pos + slack < ready)
+            stall = true;
+    }
+
+    if (stall) {
         pwires_p->stall = true;
-        stall_counter++;    
+        stall_counter++;
+    } else if (base_stall) {
+        // the store-data or split MEM forwarding made this stall unnecessary
+        stall_removed_counter++;
     }
 }
 
-void print_register_trace(regfile_t* regfile_p)
+void flush_pipeline(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p)
 {
-    for (uint8_t i = 0; i < 8; i++) {
-        for (uint8_t j = 0; j < 4; j++) {
-            printf("r%2d=%08x ", i * 4 + j, regfile_p->R[i * 4 + j]);
-        }
-        printf("\n");
+    // squash every instruction younger than the branch: IF sub-stages,
+    // IF/ID, ID/EX and the EX sub-stages. The NOPs keep the address and
+    // fetch number of the instruction they replace.
+    ifid_reg_t*  if_regs[MAX_SUB_STAGES];
+    exmem_reg_t* ex_regs[MAX_SUB_STAGES];
+    int nif = 0, nex = 0;
+
+    for (int i = 0; i < sim_config.if_stages - 1; i++)
+        if_regs[nif++] = &pregs_p->if_sub_preg[i].inp;
+    if_regs[nif++] = &pregs_p->ifid_preg.inp;
+    for (int i = 0; i < sim_config.ex_stages - 1; i++)
+        ex_regs[nex++] = &pregs_p->ex_sub_preg[i].inp;
+    ex_regs[nex++] = &pregs_p->exmem_preg.inp;
+
+    for (int i = 0; i < nif; i++) {
+        uint32_t addr = if_regs[i]->instr_addr;
+        uint64_t seq = if_regs[i]->seq;
+        *if_regs[i] = (ifid_reg_t){0};
+        if_regs[i]->instr.bits = 0x00000013;  // NOP
+        if_regs[i]->instr_addr = addr;
+        if_regs[i]->bubble = CPI_CONTROL;
+        if_regs[i]->seq = seq;
+    }
+
+    uint32_t id_addr = pregs_p->idex_preg.inp.instr_addr;
+    uint64_t id_seq = pregs_p->idex_preg.inp.seq;
+    pregs_p->idex_preg.inp = (idex_reg_t){0};
+    pregs_p->idex_preg.inp.instr.bits = 0x00000013;  // NOP
+    pregs_p->idex_preg.inp.instr_addr = id_addr;
+    pregs_p->idex_preg.inp.bubble = CPI_CONTROL;
+    pregs_p->idex_preg.inp.seq = id_seq;
+
+    for (int i = 0; i < nex; i++) {
+        uint32_t addr = ex_regs[i]->instr_addr;
+        uint64_t seq = ex_regs[i]->seq;
+        *ex_regs[i] = (exmem_reg_t){0};
+        ex_regs[i]->instr.bits = 0x00000013;  // NOP
+        ex_regs[i]->instr_addr = addr;
+        ex_regs[i]->bubble = CPI_CONTROL;
+        ex_regs[i]->seq = seq;
+    }
+
+    // a load-use stall detected against a squashed instruction is void
+    pwires_p->stall = false;
+}
+
+/**
+ * move the sub-stage registers of the split stages along: each sub-stage
+ * just passes its input on, the IF ones hold while the pipeline stalls
+ **/
+void advance_sub_stages(pipeline_regs_t* pregs_p, pipeline_wires_t* pwires_p)
+{
+    int nif = sim_config.if_stages;
+    int nex = sim_config.ex_stages;
+    int nmem = sim_config.mem_stages;
+
+    if (!pwires_p->stall) {
+        for (int i = 0; i < nif - 1; i++)
+            pregs_p->if_sub_preg[i].out = pregs_p->if_sub_preg[i].inp;
     }
-    printf("\n");
+    for (int i = 0; i < nex - 1; i++)
+        pregs_p->ex_sub_preg[i].out = pregs_p->ex_sub_preg[i].inp;
+    for (int i = 0; i < nmem - 1; i++)
+        pregs_p->mem_sub_preg[i].out = pregs_p->mem_sub_preg[i].inp;
 }
 
 #endif // __STAGE_HELPERS_H__
\ No newline at end of file
@@ -0,0 +1,162 @@
+//stats.c
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "riscv.h"
+#include "stats.h"
+
+typedef enum {
+  STAT_U64,
+  STAT_INT,
+  STAT_FN,
+} stat_kind_t;
+
+typedef struct {
+  char*       name;
+  const char* desc;
+  stat_kind_t kind;
+  union {
+    const uint64_t* u64;
+    const int*      i;
+    uint64_t      (*fn)(void);
+  } src;
+  uint64_t    last;       // value at the previous sample
+} stat_t;
+
+static stat_t* stats;
+static int     num_stats;
+static int     capacity;
+
+static FILE*    out;
+static bool     csv;
+static uint64_t interval;
+static uint64_t num_samples;
+
+uint64_t stats_next_sample = UINT64_MAX;
+
+static stat_t* stats_new(const char* name, const char* desc, stat_kind_t kind)
+{
+  if (num_stats == capacity) {
+    capacity = (capacity) ? 2 * capacity : 64;
+    stats = realloc(stats, capacity * sizeof(stat_t));
+    if (stats == NULL) {
+      fprintf(stderr, "[STATS]: cannot allocate the stats registry\n");
+      exit(-1);
+    }
+  }
+  stat_t* s = &stats[num_stats++];
+  *s = (stat_t){.name = strdup(name), .desc = desc, .kind = kind};
+  return s;
+}
+
+void stats_add_u64(const char* name, const char* desc, const uint64_t* value)
+{
+  if (hart_id != 0)
+    return;
+  stats_new(name, desc, STAT_U64)->src.u64 = value;
+}
+
+void stats_add_int(const char* name, const char* desc, const int* value)
+{
+  if (hart_id != 0)
+    return;
+  stats_new(name, desc, STAT_INT)->src.i = value;
+}
+
+void stats_add_fn(const char* name, const char* desc, uint64_t (*value)(void))
+{
+  if (hart_id != 0)
+    return;
+  stats_new(name, desc, STAT_FN)->src.fn = value;
+}
+
+static uint64_t stat_value(const stat_t* s)
+{
+  switch (s->kind) {
+  case STAT_U64: return *s->src.u64;
+  case STAT_INT: return (uint64_t)*s->src.i;
+  case STAT_FN:  return s->src.fn();
+  }
+  return 0;
+}
+
+static void stats_write_json(bool delta)
+{
+  fputc('{', out);
+  for (int i = 0; i < num_stats; i++) {
+    uint64_t v = stat_value(&stats[i]);
+    fprintf(out, "%s\"%s\": %lu", (i) ? ", " : "", stats[i].name,
+            (delta) ? v - stats[i].last : v);
+  }
+  fputc('}', out);
+}
+
+static void stats_write_csv(bool delta)
+{
+  for (int i = 0; i < num_stats; i++) {
+    uint64_t v = stat_value(&stats[i]);
+    fprintf(out, ",%lu", (delta) ? v - stats[i].last : v);
+  }
+  fputc('\n', out);
+}
+
+int stats_open(const char* path, uint64_t sample_interval)
+{
+  out = fopen(path, "w");
+  if (out == NULL)
+    return -1;
+  size_t len = strlen(path);
+  csv = (len >= 4 && strcmp(path + len - 4, ".csv") == 0);
+  interval = sample_interval;
+  stats_next_sample = (interval) ? interval : UINT64_MAX;
+
+  if (csv) {
+    fprintf(out, "cycle");
+    for (int i = 0; i < num_stats; i++)
+      fprintf(out, ",%s", stats[i].name);
+    fputc('\n', out);
+  } else {
+    fprintf(out, "{\n  \"interval\": %lu,\n  \"samples\": [", interval);
+  }
+  return 0;
+}
+
+/**
+ * one line per interval, with what every counter gained since the last one
+ **/
+void stats_sample(uint64_t cycle)
+{
+  if (csv) {
+    fprintf(out, "%lu", cycle);
+    stats_write_csv(true);
+  } else {
+    fprintf(out, "%s\n    {\"cycle\": %lu, \"stats\": ", (num_samples) ? "," : "", cycle);
+    stats_write_json(true);
+    fputc('}', out);
+  }
+  for (int i = 0; i < num_stats; i++)
+    stats[i].last = stat_value(&stats[i]);
+  num_samples++;
+  stats_next_sample = cycle + interval;
+}
+
+void stats_close(void)
+{
+  if (out == NULL)
+    return;
+  if (csv) {
+    fprintf(out, "total");
+    stats_write_csv(false);
+  } else {
+    fprintf(out, "%s  ],\n  \"total\": ", (num_samples) ? "\n" : "");
+    stats_write_json(false);
+    fprintf(out, ",\n  \"descriptions\": {");
+    for (int i = 0; i < num_stats; i++)
+      fprintf(out, "%s\n    \"%s\": \"%s\"", (i) ? "," : "", stats[i].name, stats[i].desc);
+    fprintf(out, "\n  }\n}\n");
+  }
+  fclose(out);
+  out = NULL;
+  stats_next_sample = UINT64_MAX;
+}
@@ -0,0 +1,30 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+/**
+ * Stats registry. Modules register their counters once, when they are set
+ * up, and the registry reads them whenever it writes the stats file
+ * (--stats-out FILE, CSV when FILE ends in .csv, JSON otherwise):
+ *
+ *   - every `interval` cycles (--stats-interval N) a sample with what each
+ *     counter gained during the interval
+ *   - at the end, the totals
+ *
+ * The text stats (--stats) are printed as before. Everything must be
+ * registered before stats_open(). Only hart 0 registers its counters,
+ * the other harts (--harts) are not in the registry.
+ **/
+void stats_add_u64(const char* name, const char* desc, const uint64_t* value);
+void stats_add_int(const char* name, const char* desc, const int* value);
+void stats_add_fn(const char* name, const char* desc, uint64_t (*value)(void));
+
+int  stats_open(const char* path, uint64_t interval);
+void stats_sample(uint64_t cycle);
+void stats_close(void);
+
+// cycle of the next interval sample, UINT64_MAX when there is none
+extern uint64_t stats_next_sample;
+
+#endif // STATS_H
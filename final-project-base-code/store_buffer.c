@@ -0,0 +1,207 @@
+//store_buffer.c
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "riscv.h"
+#include "pipeline.h"
+#include "store_buffer.h"
+#include "stats.h"
+#include "atomic.h"
+
+void sb_init(store_buffer_t* sb, uint8_t size)
+{
+  memset(sb, 0, sizeof(*sb));
+  sb->size = (size > SB_MAX_ENTRIES) ? SB_MAX_ENTRIES : size;
+  if (sb->size == 0)
+    return;
+
+  stats_add_u64("sb.stores", "stores that went through the store buffer", &sb->stores);
+  stats_add_u64("sb.coalesced", "stores merged into an entry already buffered", &sb->coalesced);
+  stats_add_u64("sb.load_fwds", "loads that took bytes from the store buffer", &sb->load_fwds);
+  stats_add_u64("sb.write_cycles", "memory latency of the entries written back", &sb->write_cycles);
+  stats_add_u64("sb.full_stalls", "cycles a store waited for a free entry", &sb->full_stalls);
+  for (int i = 0; i <= sb->size; i++) {
+    char stat[32];
+    snprintf(stat, sizeof(stat), "sb.occupancy.%d", i);
+    stats_add_u64(stat, "cycles the store buffer held this many entries", &sb->occupancy[i]);
+  }
+}
+
+static sb_entry_t* sb_entry(const store_buffer_t* sb, uint8_t i)
+{
+  return (sb_entry_t*)&sb->entries[(sb->head + i) % SB_MAX_ENTRIES];
+}
+
+/**
+ * cycles the memory port is busy writing one block back, through the data
+ * cache when it is enabled (counted with the pipeline's cache accesses),
+ * and the coherence bus between harts
+ **/
+static int sb_write_latency(Address block_addr, Cache* cache_p)
+{
+  int latency = mem_latency;
+  if (sim_config.cache_en) {
+    int coherence;
+    latency = dcache_access(block_addr, true, cache_p, &coherence) + coherence;
+  }
+  return (latency < 1) ? 1 : latency;
+}
+
+static void sb_start_head(store_buffer_t* sb, Cache* cache_p)
+{
+  sb->busy = sb_write_latency(sb_entry(sb, 0)->block_addr, cache_p);
+  sb->write_cycles += sb->busy;
+  sb->draining = true;
+}
+
+static void sb_retire_head(store_buffer_t* sb, memory_t* memory_p)
+{
+  sb_entry_t* e = sb_entry(sb, 0);
+  for (int i = 0; i < SB_BLOCK_SIZE; i++) {
+    if (e->mask & (1ULL << i))
+      amo_store(memory_p, e->block_addr + i, LENGTH_BYTE, e->data[i]);
+  }
+  sb->head = (sb->head + 1) % SB_MAX_ENTRIES;
+  sb->count--;
+  sb->draining = false;
+  sb->busy = 0;
+}
+
+/**
+ * entry that takes a store to `block_addr`: the buffered entry for that block
+ * unless it is already being written back, otherwise a new one at the tail.
+ * A full buffer holds the store until the head write completes, the cycles
+ * waited are added to `*stall_p`, and the port is busy with it as long.
+ **/
+static sb_entry_t* sb_entry_for(store_buffer_t* sb, Address block_addr, memory_t* memory_p,
+                                Cache* cache_p, int* stall_p, bool* merged_p)
+{
+  for (uint8_t i = (sb->draining) ? 1 : 0; i < sb->count; i++) {
+    sb_entry_t* e = sb_entry(sb, i);
+    if (e->block_addr == block_addr) {
+      *merged_p = true;
+      return e;
+    }
+  }
+
+  if (sb->count == sb->size) {
+    if (!sb->draining)
+      sb_start_head(sb, cache_p);
+    *stall_p += sb->busy;
+    sb->port_busy += sb->busy;
+    sb_retire_head(sb, memory_p);
+  }
+
+  sb_entry_t* e = sb_entry(sb, sb->count);
+  e->block_addr = block_addr;
+  e->mask = 0;
+  sb->count++;
+  return e;
+}
+
+/**
+ * buffer a store, returns the number of cycles MEM is held because the
+ * buffer was full (0 in the common case)
+ **/
+int sb_store(store_buffer_t* sb, Address address, Alignment alignment, Word value,
+             memory_t* memory_p, Cache* cache_p)
+{
+  int stall = 0;
+  bool merged = false;
+  sb_entry_t* e = NULL;
+
+  for (int i = 0; i < (int)alignment; i++) {
+    Address byte_addr = address + i;
+    Address block_addr = byte_addr & ~(Address)(SB_BLOCK_SIZE - 1);
+    // a misaligned store crossing a block boundary takes two entries
+    if (e == NULL || e->block_addr != block_addr)
+      e = sb_entry_for(sb, block_addr, memory_p, cache_p, &stall, &merged);
+    e->data[byte_addr - block_addr] = (Byte)(value >> (8 * i));
+    e->mask |= 1ULL << (byte_addr - block_addr);
+  }
+
+  sb->stores++;
+  if (merged)
+    sb->coalesced++;
+  sb->full_stalls += stall;
+  return stall;
+}
+
+/**
+ * load as seen by the pipeline: memory overlaid with the buffered stores,
+ * oldest first so the youngest store to a byte wins
+ **/
+Word sb_load(const store_buffer_t* sb, memory_t* memory_p, Address address,
+             Alignment alignment, bool* hit_p)
+{
+  Word value = load(memory_p, address, alignment);
+  bool hit = false;
+
+  for (uint8_t i = 0; i < sb->count; i++) {
+    const sb_entry_t* e = sb_entry(sb, i);
+    for (int b = 0; b < (int)alignment; b++) {
+      Address byte_addr = address + b;
+      if ((byte_addr & ~(Address)(SB_BLOCK_SIZE - 1)) != e->block_addr)
+        continue;
+      if (e->mask & (1ULL << (byte_addr - e->block_addr))) {
+        value &= ~(0xFFU << (8 * b));
+        value |= (Word)e->data[byte_addr - e->block_addr] << (8 * b);
+        hit = true;
+      }
+    }
+  }
+
+  if (hit_p)
+    *hit_p = hit;
+  return value;
+}
+
+/**
+ * one clock cycle of background write-back: the head entry goes to memory
+ * and is released once its latency has elapsed
+ **/
+void sb_tick(store_buffer_t* sb, memory_t* memory_p, Cache* cache_p)
+{
+  sb->occupancy[sb->count]++;
+  if (sb->port_busy) {
+    sb->port_busy--;
+    return;
+  }
+  if (sb->count == 0)
+    return;
+
+  if (!sb->draining)
+    sb_start_head(sb, cache_p);
+  if (--sb->busy <= 0)
+    sb_retire_head(sb, memory_p);
+}
+
+/**
+ * write everything still buffered to memory, one entry after the other,
+ * returns the cycles that takes
+ **/
+int sb_drain(store_buffer_t* sb, memory_t* memory_p, Cache* cache_p)
+{
+  int cycles = sb->port_busy;
+  sb->port_busy = 0;
+  while (sb->count) {
+    if (!sb->draining)
+      sb_start_head(sb, cache_p);
+    cycles += sb->busy;
+    sb_retire_head(sb, memory_p);
+  }
+  return cycles;
+}
+
+void sb_print_stats(const store_buffer_t* sb)
+{
+  printf("#SB entries        = %5d\n", sb->size);
+  printf("#SB stores         = %5ld\n", sb->stores);
+  printf("#SB coalesced      = %5ld\n", sb->coalesced);
+  printf("#SB load forwards  = %5ld\n", sb->load_fwds);
+  printf("#SB full stalls    = %5ld\n", sb->full_stalls);
+  printf("#SB hidden latency = %5ld\n",
+         (sb->write_cycles > sb->full_stalls) ? sb->write_cycles - sb->full_stalls : 0);
+  for (int i = 0; i <= sb->size; i++)
+    printf("#SB occupancy %2d   = %5ld\n", i, sb->occupancy[i]);
+}
@@ -0,0 +1,56 @@
+#ifndef STORE_BUFFER_H
+#define STORE_BUFFER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "types.h"
+#include "guest_mem.h"
+#include "cache.h"
+
+#define SB_MAX_ENTRIES 16                      // deepest configurable store buffer
+#define SB_BLOCK_SIZE  (1 << CACHE_BLOCK_BITS) // stores to one block coalesce
+
+/**
+ * one store buffer entry holds the bytes written to a single cache block,
+ * `mask` has a bit set for every byte of the block that was written
+ **/
+typedef struct {
+  Address  block_addr;
+  Byte     data[SB_BLOCK_SIZE];
+  uint64_t mask;
+} sb_entry_t;
+
+/**
+ * FIFO of stores waiting for the memory port. Stores leave MEM as soon as
+ * they are buffered, the head entry is written back in the background. A
+ * store that finds the buffer full holds MEM until the head write has
+ * completed; the head leaves the buffer at once, the port stays busy.
+ **/
+typedef struct {
+  sb_entry_t entries[SB_MAX_ENTRIES];
+  uint8_t  size;        // configured number of entries, 0 = no store buffer
+  uint8_t  head;
+  uint8_t  count;
+  bool     draining;    // the head entry has been sent to memory
+  int      busy;        // cycles until the head entry write completes
+  int      port_busy;   // cycles the write of a head that left early still takes
+
+  // stats
+  uint64_t stores;
+  uint64_t coalesced;       // stores merged into an entry already buffered
+  uint64_t load_fwds;       // loads that took bytes from the buffer
+  uint64_t write_cycles;    // memory latency of all entries written back
+  uint64_t full_stalls;     // cycles a store waited for a free entry
+  uint64_t occupancy[SB_MAX_ENTRIES + 1];  // cycles spent at each occupancy
+} store_buffer_t;
+
+void sb_init(store_buffer_t* sb, uint8_t size);
+int  sb_store(store_buffer_t* sb, Address address, Alignment alignment, Word value,
+              memory_t* memory_p, Cache* cache_p);
+Word sb_load(const store_buffer_t* sb, memory_t* memory_p, Address address,
+             Alignment alignment, bool* hit_p);
+void sb_tick(store_buffer_t* sb, memory_t* memory_p, Cache* cache_p);
+int  sb_drain(store_buffer_t* sb, memory_t* memory_p, Cache* cache_p);
+void sb_print_stats(const store_buffer_t* sb);
+
+#endif // STORE_BUFFER_H
@@ -0,0 +1,10 @@
+# the RV32A output: 4 harts on shared counters. How their threads interleave
+# changes the cycles, so only the flags the program leaves in memory count
+FLAGS="--trace none --stats none --mem-latency 10"
+
+# the harts in lockstep and a quantum apart, on the coherent caches and
+# with a store buffer, then on the memory alone
+for HART_FLAGS in "-c --quantum 1" "-c --quantum 1000" "-c --quantum 1 --store-buffer 4" "--quantum 100"; do
+    echo "riscv-tracecmp ./code/atomic/ref/counters.trace ($HART_FLAGS)"
+    ./riscv -s $FLAGS -e -f --harts 4 $HART_FLAGS -p 4200 4220 ./code/atomic/input/counters.input | grep -v "^#" | ./riscv-tracecmp ./code/atomic/ref/counters.trace -
+done
@@ -0,0 +1,12 @@
+# the Zicsr counters: instret as the emulator reads it is the reference,
+# the pipeline must read the same in every shape. cycle and the hpm
+# counters depend on the timing, the test program does not read them
+FLAGS="--trace none --stats none"
+
+echo "riscv-tracecmp ./code/csr/ref/instret.trace (emulator)"
+./riscv -m -e -p 4100 4120 ./code/csr/input/instret.input | grep "^M:" | ./riscv-tracecmp ./code/csr/ref/instret.trace -
+
+for SIM_FLAGS in "" "-f" "-f --stages 1,1,3" "-f --split-mem --depth 9" "-f -c --store-buffer 2"; do
+    echo "riscv-tracecmp ./code/csr/ref/instret.trace ($SIM_FLAGS)"
+    ./riscv -s $FLAGS -e $SIM_FLAGS -p 4100 4120 ./code/csr/input/instret.input | grep "^M:" | ./riscv-tracecmp ./code/csr/ref/instret.trace -
+done
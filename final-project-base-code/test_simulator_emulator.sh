@@ -0,0 +1,5 @@
+# the emulator (-m): with -e it runs to the exit ecall and returns through
+# main, so what main prints after it comes out. The host stats are the
+# host's timing, only their names are compared
+echo "riscv-tracecmp ./code/emulator/ref/host_stats.trace"
+./riscv -m -e --host-stats ./code/bench/input/memcpy.input | cut -d= -f1 | ./riscv-tracecmp ./code/emulator/ref/host_stats.trace -
@@ -1,26 +1,22 @@
 # tests below are scored
-# remember to edit config.h accordingly before running this file!
+# the MS2 output: the stage and register trace of every cycle and the stats
+FLAGS="--trace cycle,regs --stats pipeline --mem-latency 0"
 
-./riscv -s -f ./code/ms2/input/R/R.input > ./code/ms2/out/R/R.trace
-echo "diff ./code/ms2/ref/R/R.trace ./code/ms2/out/R/R.trace"
-diff ./code/ms2/ref/R/R.trace ./code/ms2/out/R/R.trace
 
-./riscv -s -f ./code/ms2/input/I/I.input > ./code/ms2/out/I/I.trace
-echo "diff ./code/ms2/ref/I/I.trace ./code/ms2/out/I/I.trace"
-diff ./code/ms2/ref/I/I.trace ./code/ms2/out/I/I.trace
+echo "riscv-tracecmp ./code/ms2/ref/R/R.trace"
+./riscv -s $FLAGS -f ./code/ms2/input/R/R.input | ./riscv-tracecmp ./code/ms2/ref/R/R.trace -
 
-./riscv -s -f ./code/ms2/input/LS/LS.input > ./code/ms2/out/LS/LS.trace
-echo "diff ./code/ms2/ref/LS/LS.trace ./code/ms2/out/LS/LS.trace"
-diff ./code/ms2/ref/LS/LS.trace ./code/ms2/out/LS/LS.trace
+echo "riscv-tracecmp ./code/ms2/ref/I/I.trace"
+./riscv -s $FLAGS -f ./code/ms2/input/I/I.input | ./riscv-tracecmp ./code/ms2/ref/I/I.trace -
 
-./riscv -s -e -f ./code/ms2/input/random.input > ./code/ms2/out/random.trace
-echo "diff ./code/ms2/ref/random.trace ./code/ms2/out/random.trace"
-diff ./code/ms2/ref/random.trace ./code/ms2/out/random.trace
+echo "riscv-tracecmp ./code/ms2/ref/LS/LS.trace"
+./riscv -s $FLAGS -f ./code/ms2/input/LS/LS.input | ./riscv-tracecmp ./code/ms2/ref/LS/LS.trace -
 
-./riscv -s -e -f ./code/ms2/input/multiply.input > ./code/ms2/out/multiply.trace
-echo "diff ./code/ms2/ref/multiply.trace ./code/ms2/out/multiply.trace"
-diff ./code/ms2/ref/multiply.trace ./code/ms2/out/multiply.trace
+echo "riscv-tracecmp ./code/ms2/ref/random.trace"
+./riscv -s $FLAGS -e -f ./code/ms2/input/random.input | ./riscv-tracecmp ./code/ms2/ref/random.trace -
 
-./riscv -s -e -f ./code/ms2/input/vec_xprod_tiny.input > ./code/ms2/out/vec_xprod_tiny.trace
-echo "diff ./code/ms2/ref/vec_xprod_tiny.trace ./code/ms2/out/vec_xprod_tiny.trace"
-diff ./code/ms2/ref/vec_xprod_tiny.trace ./code/ms2/out/vec_xprod_tiny.trace
+echo "riscv-tracecmp ./code/ms2/ref/multiply.trace"
+./riscv -s $FLAGS -e -f ./code/ms2/input/multiply.input | ./riscv-tracecmp ./code/ms2/ref/multiply.trace -
+
+echo "riscv-tracecmp ./code/ms2/ref/vec_xprod_tiny.trace"
+./riscv -s $FLAGS -e -f ./code/ms2/input/vec_xprod_tiny.input | ./riscv-tracecmp ./code/ms2/ref/vec_xprod_tiny.trace -
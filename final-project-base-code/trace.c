@@ -0,0 +1,515 @@
+//trace.c
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "riscv.h"
+#include "trace.h"
+#include "trace_format.h"
+
+static struct {
+  uint8_t  nif, nex, nmem;
+  FILE*    bin;                 // binary trace file, NULL = text on stdout
+
+  // raw records waiting to be compressed into the next block
+  uint8_t  raw[TF_BLOCK_SIZE];
+  size_t   raw_len;
+  uint8_t  comp[TF_COMPRESS_BOUND(TF_BLOCK_SIZE)];
+
+  // cycle being recorded
+  uint8_t  flags;
+  uint64_t cycle;
+  uint32_t present;             // slots that printed a stage line
+  uint32_t bits[TF_MAX_SLOTS];
+  uint32_t addr[TF_MAX_SLOTS];
+  uint32_t regs[32];
+
+  // last recorded cycle, the codes are relative to it
+  int64_t  last_cycle;
+  uint32_t prev_bits[TF_MAX_SLOTS];
+  uint32_t prev_addr[TF_MAX_SLOTS];
+  uint32_t prev_regs[32];
+} tr;
+
+#define TRACE_RING_SIZE  (1 << 16)     // events, a power of two
+#define TRACE_STDOUT_BUF (1 << 20)     // stdout buffer of the writer thread
+
+enum {
+  TEV_CYCLE_BEGIN,
+  TEV_STAGE,
+  TEV_FLUSHED,
+  TEV_REGS,
+  TEV_CYCLE_END,
+  TEV_TEXT
+};
+
+/**
+ * one trace call of the simulator, a cache line each
+ **/
+typedef struct {
+  uint8_t type;
+  uint8_t slot;                 // stage line slot, or which 8 registers
+  uint8_t len;                  // text bytes
+  union {
+    uint64_t cycle;
+    struct { uint32_t bits, addr; } stage;
+    uint32_t regs[8];
+    char     text[56];
+  };
+} trace_event_t;
+
+/**
+ * single-producer/single-consumer ring between the simulation thread and the
+ * writer thread that formats (or encodes) and writes the trace. A full ring
+ * makes the simulator wait, events are never dropped.
+ **/
+static struct {
+  trace_event_t ev[TRACE_RING_SIZE];
+  _Alignas(64) _Atomic uint64_t head;   // published by the simulator
+  uint64_t head_local;
+  uint64_t tail_seen;                   // simulator's last look at tail
+  _Alignas(64) _Atomic uint64_t tail;   // released by the writer
+  _Atomic bool done;
+  bool      running;
+  bool      sync;                       // no writer thread, format in place
+  trace_event_t sync_ev;
+  pthread_t thread;
+} ring;
+
+void trace_init(uint8_t if_stages, uint8_t ex_stages, uint8_t mem_stages)
+{
+  tr.nif = if_stages;
+  tr.nex = ex_stages;
+  tr.nmem = mem_stages;
+  tr.last_cycle = -1;
+  // the trace is the first thing the simulator writes, the writer thread
+  // hands stdio large batches when it is going to a file or a pipe
+  if (!isatty(STDOUT_FILENO))
+    setvbuf(stdout, NULL, _IOFBF, TRACE_STDOUT_BUF);
+}
+
+int trace_open_bin(const char* path)
+{
+  tr.bin = fopen(path, "wb");
+  if (tr.bin == NULL)
+    return -1;
+  uint8_t header[TF_MAGIC_LEN + 4] = TF_MAGIC;
+  header[TF_MAGIC_LEN]     = tr.nif;
+  header[TF_MAGIC_LEN + 1] = tr.nex;
+  header[TF_MAGIC_LEN + 2] = tr.nmem;
+  fwrite(header, 1, sizeof(header), tr.bin);
+  return 0;
+}
+
+static void trace_write_block(void)
+{
+  if (tr.raw_len == 0)
+    return;
+  uint8_t lens[8];
+  size_t comp_len = tf_compress(tr.raw, tr.raw_len, tr.comp);
+  tf_put_u32(lens, (uint32_t)tr.raw_len);
+  tf_put_u32(lens + 4, (uint32_t)comp_len);
+  fwrite(lens, 1, sizeof(lens), tr.bin);
+  fwrite(tr.comp, 1, comp_len, tr.bin);
+  tr.raw_len = 0;
+}
+
+static void trace_stop_writer(void);
+
+/**
+ * wait for the writer to finish everything traced so far
+ **/
+void trace_close(void)
+{
+  trace_stop_writer();
+  fflush(stdout);
+  if (tr.bin == NULL)
+    return;
+  trace_write_block();
+  fclose(tr.bin);
+  tr.bin = NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void trace_slot_name(uint8_t slot, uint8_t if_stages, uint8_t ex_stages,
+                     uint8_t mem_stages, char name[TRACE_SLOT_NAME_SIZE])
+{
+  const char* stage;
+  int sub;
+  if (slot < if_stages) {
+    stage = "IF"; sub = slot + 1;
+  } else if (slot == if_stages) {
+    stage = "ID"; sub = 1;
+  } else if (slot <= if_stages + ex_stages) {
+    stage = "EX"; sub = slot - if_stages;
+  } else if (slot <= if_stages + ex_stages + mem_stages) {
+    stage = (slot == if_stages + ex_stages + 1) ? "MEM" : "ME";
+    sub = slot - if_stages - ex_stages;
+  } else {
+    stage = "WB"; sub = 1;
+  }
+  if (sub > 1)
+    snprintf(name, TRACE_SLOT_NAME_SIZE, "%s%c", stage, '0' + sub);   // sub-stages 2..9
+  else
+    snprintf(name, TRACE_SLOT_NAME_SIZE, "%-3s", stage);
+}
+
+void trace_print_cycle_header(uint64_t cycle)
+{
+  printf("v==============");
+  printf("Cycle Counter = %5ld", cycle);
+  printf("==============v\n\n");
+}
+
+void trace_print_stage(const char* name, uint32_t bits, uint32_t addr)
+{
+  printf("[%s]: Instruction [%08x]@[%08x]: ", name, bits, addr);
+  decode_instruction(bits);
+}
+
+void trace_print_flushed(void)
+{
+  printf("[CPL]: Pipeline Flushed\n");
+}
+
+void trace_print_regs(const uint32_t R[32])
+{
+  for (uint8_t i = 0; i < 8; i++) {
+    for (uint8_t j = 0; j < 4; j++) {
+      printf("r%2d=%08x ", i * 4 + j, R[i * 4 + j]);
+    }
+    printf("\n");
+  }
+  printf("\n");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static uint8_t trace_slot(int stage, int sub)
+{
+  switch (stage) {
+    case TRACE_IF:  return sub - 1;
+    case TRACE_ID:  return tr.nif;
+    case TRACE_EX:  return tr.nif + sub;
+    case TRACE_MEM: return tr.nif + tr.nex + sub;
+    default:        return tr.nif + tr.nex + tr.nmem + 1;
+  }
+}
+
+static void tw_cycle_begin(uint64_t cycle)
+{
+  if (tr.bin == NULL) {
+    trace_print_cycle_header(cycle);
+    return;
+  }
+  tr.flags |= TF_CYC_STAGES;
+  tr.cycle = cycle;
+}
+
+static void tw_stage(uint8_t slot, uint32_t bits, uint32_t addr)
+{
+  if (tr.bin == NULL) {
+    char name[TRACE_SLOT_NAME_SIZE];
+    trace_slot_name(slot, tr.nif, tr.nex, tr.nmem, name);
+    trace_print_stage(name, bits, addr);
+    return;
+  }
+  tr.present |= 1U << slot;
+  tr.bits[slot] = bits;
+  tr.addr[slot] = addr;
+}
+
+static void tw_flushed(void)
+{
+  if (tr.bin == NULL) {
+    trace_print_flushed();
+    return;
+  }
+  tr.flags |= TF_CYC_FLUSH;
+}
+
+static void tw_regs(uint8_t part, const uint32_t regs[8])
+{
+  memcpy(&tr.regs[part * 8], regs, 8 * sizeof(uint32_t));
+  if (part < 3)
+    return;
+  if (tr.bin == NULL) {
+    trace_print_regs(tr.regs);
+    return;
+  }
+  tr.flags |= TF_CYC_REGS;
+}
+
+static uint8_t* trace_put_slot(uint8_t* p, uint8_t s)
+{
+  uint32_t bits = tr.bits[s], addr = tr.addr[s];
+
+  if (s > 0 && bits == tr.prev_bits[s-1] && addr == tr.prev_addr[s-1]) {
+    *p++ = TF_SLOT_SHIFTED;
+  } else if (bits == tr.prev_bits[s] && addr == tr.prev_addr[s]) {
+    *p++ = TF_SLOT_HELD;
+  } else if (s > 0 && bits == 0x00000013 && addr == tr.prev_addr[s-1]) {
+    *p++ = TF_SLOT_SQUASHED;
+  } else if (addr == tr.prev_addr[s] + 4) {
+    *p++ = TF_SLOT_NEXT;
+    tf_put_u32(p, bits);
+    p += 4;
+  } else {
+    *p++ = TF_SLOT_LITERAL;
+    p += tf_put_varint(p, tf_zigzag((int64_t)addr - (int64_t)tr.prev_addr[s]));
+    tf_put_u32(p, bits);
+    p += 4;
+  }
+  return p;
+}
+
+/**
+ * encode the recorded cycle, see trace_format.h
+ **/
+static void tw_cycle_end(void)
+{
+  if (tr.bin == NULL || tr.flags == 0)
+    return;
+  if (tr.raw_len + TF_MAX_RECORD > TF_BLOCK_SIZE)
+    trace_write_block();
+
+  uint8_t* p = tr.raw + tr.raw_len;
+  *p++ = TF_REC_CYCLE;
+  *p++ = tr.flags;
+
+  if (tr.flags & TF_CYC_STAGES) {
+    p += tf_put_varint(p, tf_zigzag((int64_t)tr.cycle - (tr.last_cycle + 1)));
+    tr.last_cycle = (int64_t)tr.cycle;
+    p += tf_put_varint(p, tr.present);
+    for (uint8_t s = 0; s < TF_MAX_SLOTS; s++) {
+      if (tr.present & (1U << s))
+        p = trace_put_slot(p, s);
+    }
+    for (uint8_t s = 0; s < TF_MAX_SLOTS; s++) {
+      if (tr.present & (1U << s)) {
+        tr.prev_bits[s] = tr.bits[s];
+        tr.prev_addr[s] = tr.addr[s];
+      }
+    }
+  }
+
+  if (tr.flags & TF_CYC_REGS) {
+    uint32_t changed = 0;
+    for (int i = 0; i < 32; i++) {
+      if (tr.regs[i] != tr.prev_regs[i])
+        changed |= 1U << i;
+    }
+    p += tf_put_varint(p, changed);
+    for (int i = 0; i < 32; i++) {
+      if (changed & (1U << i)) {
+        tf_put_u32(p, tr.regs[i]);
+        p += 4;
+        tr.prev_regs[i] = tr.regs[i];
+      }
+    }
+  }
+
+  tr.raw_len = p - tr.raw;
+  tr.flags = 0;
+  tr.present = 0;
+}
+
+static void tw_text(const char* text, size_t len)
+{
+  if (tr.bin == NULL) {
+    fwrite(text, 1, len, stdout);
+    return;
+  }
+  while (len > 0) {
+    size_t chunk = (len > TF_MAX_RECORD - 16) ? TF_MAX_RECORD - 16 : len;
+    if (tr.raw_len + TF_MAX_RECORD > TF_BLOCK_SIZE)
+      trace_write_block();
+    uint8_t* p = tr.raw + tr.raw_len;
+    *p++ = TF_REC_TEXT;
+    p += tf_put_varint(p, chunk);
+    memcpy(p, text, chunk);
+    tr.raw_len = (p + chunk) - tr.raw;
+    text += chunk;
+    len -= chunk;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Writer thread
+///////////////////////////////////////////////////////////////////////////////
+
+static void tw_dispatch(const trace_event_t* ev)
+{
+  switch (ev->type) {
+    case TEV_CYCLE_BEGIN: tw_cycle_begin(ev->cycle); break;
+    case TEV_STAGE:       tw_stage(ev->slot, ev->stage.bits, ev->stage.addr); break;
+    case TEV_FLUSHED:     tw_flushed(); break;
+    case TEV_REGS:        tw_regs(ev->slot, ev->regs); break;
+    case TEV_CYCLE_END:   tw_cycle_end(); break;
+    case TEV_TEXT:        tw_text(ev->text, ev->len); break;
+  }
+}
+
+static void* trace_writer(void* arg)
+{
+  (void)arg;
+  uint64_t tail = atomic_load_explicit(&ring.tail, memory_order_relaxed);
+  int idle = 0;
+
+  for (;;) {
+    uint64_t head = atomic_load_explicit(&ring.head, memory_order_acquire);
+    if (tail == head) {
+      if (atomic_load_explicit(&ring.done, memory_order_acquire) &&
+          tail == atomic_load_explicit(&ring.head, memory_order_acquire))
+        break;
+      // nothing to do: spin briefly, then sleep until the simulator catches up
+      if (++idle < 64) {
+        sched_yield();
+      } else {
+        struct timespec ts = {0, 50000};
+        nanosleep(&ts, NULL);
+      }
+      continue;
+    }
+    idle = 0;
+    while (tail != head) {
+      tw_dispatch(&ring.ev[tail & (TRACE_RING_SIZE - 1)]);
+      tail++;
+      // hand back space regularly so a full ring does not wait for the batch
+      if ((tail & 1023) == 0)
+        atomic_store_explicit(&ring.tail, tail, memory_order_release);
+    }
+    atomic_store_explicit(&ring.tail, tail, memory_order_release);
+  }
+  return NULL;
+}
+
+static void trace_start_writer(void)
+{
+  static bool registered = false;
+
+  atomic_store(&ring.head, 0);
+  atomic_store(&ring.tail, 0);
+  atomic_store(&ring.done, false);
+  ring.head_local = 0;
+  ring.tail_seen = 0;
+  ring.running = (pthread_create(&ring.thread, NULL, trace_writer, NULL) == 0);
+  ring.sync = !ring.running;
+  // simulations that exit() early still get their whole trace
+  if (!registered) {
+    atexit(trace_close);
+    registered = true;
+  }
+}
+
+static void trace_stop_writer(void)
+{
+  if (!ring.running)
+    return;
+  atomic_store_explicit(&ring.done, true, memory_order_release);
+  pthread_join(ring.thread, NULL);
+  ring.running = false;
+}
+
+static trace_event_t* trace_claim(void)
+{
+  if (!ring.running && !ring.sync)
+    trace_start_writer();
+  if (ring.sync)
+    return &ring.sync_ev;
+
+  uint64_t head = ring.head_local;
+  while (head - ring.tail_seen == TRACE_RING_SIZE) {
+    // ring full: wait for the writer rather than drop the event
+    ring.tail_seen = atomic_load_explicit(&ring.tail, memory_order_acquire);
+    if (head - ring.tail_seen == TRACE_RING_SIZE)
+      sched_yield();
+  }
+  return &ring.ev[head & (TRACE_RING_SIZE - 1)];
+}
+
+static void trace_publish(trace_event_t* ev)
+{
+  if (ring.sync) {
+    tw_dispatch(ev);
+    return;
+  }
+  atomic_store_explicit(&ring.head, ++ring.head_local, memory_order_release);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Simulator side
+///////////////////////////////////////////////////////////////////////////////
+
+void trace_cycle_begin(uint64_t cycle)
+{
+  trace_event_t* ev = trace_claim();
+  ev->type = TEV_CYCLE_BEGIN;
+  ev->cycle = cycle;
+  trace_publish(ev);
+}
+
+void trace_stage(int stage, int sub, uint32_t bits, uint32_t addr)
+{
+  trace_event_t* ev = trace_claim();
+  ev->type = TEV_STAGE;
+  ev->slot = trace_slot(stage, sub);
+  ev->stage.bits = bits;
+  ev->stage.addr = addr;
+  trace_publish(ev);
+}
+
+void trace_flushed(void)
+{
+  trace_event_t* ev = trace_claim();
+  ev->type = TEV_FLUSHED;
+  trace_publish(ev);
+}
+
+void trace_regs(const regfile_t* regfile_p)
+{
+  for (uint8_t part = 0; part < 4; part++) {
+    trace_event_t* ev = trace_claim();
+    ev->type = TEV_REGS;
+    ev->slot = part;
+    memcpy(ev->regs, &regfile_p->R[part * 8], sizeof(ev->regs));
+    trace_publish(ev);
+  }
+}
+
+void trace_cycle_end(void)
+{
+  // only the binary trace has anything to do at the end of a cycle
+  if (tr.bin == NULL)
+    return;
+  trace_event_t* ev = trace_claim();
+  ev->type = TEV_CYCLE_END;
+  trace_publish(ev);
+}
+
+/**
+ * any other text that is part of the trace output, kept in order with it
+ **/
+void trace_text(const char* text)
+{
+  if (!ring.running && !ring.sync && tr.bin == NULL) {
+    // nothing traced so far, no need to start the writer for this
+    fputs(text, stdout);
+    return;
+  }
+  for (size_t len = strlen(text); len > 0; ) {
+    trace_event_t* ev = trace_claim();
+    size_t chunk = (len > sizeof(ev->text)) ? sizeof(ev->text) : len;
+    ev->type = TEV_TEXT;
+    ev->len = (uint8_t)chunk;
+    memcpy(ev->text, text, chunk);
+    trace_publish(ev);
+    text += chunk;
+    len -= chunk;
+  }
+}
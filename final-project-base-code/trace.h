@@ -0,0 +1,43 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "types.h"
+
+// pipeline stages as they appear in the cycle trace
+enum {
+  TRACE_IF = 0,
+  TRACE_ID,
+  TRACE_EX,
+  TRACE_MEM,
+  TRACE_WB
+};
+
+/**
+ * Cycle trace of the pipeline simulator. Every stage line, flush notice and
+ * register dump goes through here: by default it is printed as text on
+ * stdout, with trace_open_bin() it is written to a compact binary file
+ * that riscv-trace2txt turns back into the same text.
+ **/
+void trace_init(uint8_t if_stages, uint8_t ex_stages, uint8_t mem_stages);
+int  trace_open_bin(const char* path);
+void trace_close(void);
+
+void trace_cycle_begin(uint64_t cycle);
+void trace_stage(int stage, int sub, uint32_t bits, uint32_t addr);
+void trace_flushed(void);
+void trace_regs(const regfile_t* regfile_p);
+void trace_cycle_end(void);
+void trace_text(const char* text);
+
+// text formatting, shared with riscv-trace2txt
+#define TRACE_SLOT_NAME_SIZE 5   // a slot name ("IF2", "MEM"...) and its NUL
+void trace_slot_name(uint8_t slot, uint8_t if_stages, uint8_t ex_stages,
+                     uint8_t mem_stages, char name[TRACE_SLOT_NAME_SIZE]);
+void trace_print_cycle_header(uint64_t cycle);
+void trace_print_stage(const char* name, uint32_t bits, uint32_t addr);
+void trace_print_flushed(void);
+void trace_print_regs(const uint32_t R[32]);
+
+#endif // TRACE_H
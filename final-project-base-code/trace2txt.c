@@ -0,0 +1,170 @@
+//trace2txt.c
+// riscv-trace2txt: prints a binary trace written with `riscv -s --trace-bin`
+// as the text the simulator prints without --trace-bin
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+#include "trace_format.h"
+
+static uint8_t nif, nex, nmem;
+static int64_t  last_cycle = -1;
+static uint32_t prev_bits[TF_MAX_SLOTS];
+static uint32_t prev_addr[TF_MAX_SLOTS];
+static uint32_t regs[32];
+
+static int bad_trace(const char* path)
+{
+  fprintf(stderr, "%s: corrupt trace\n", path);
+  return -1;
+}
+
+/**
+ * print the records of one decompressed block, returns -1 if it is corrupt
+ **/
+static int print_block(const uint8_t* p, const uint8_t* end)
+{
+  uint64_t v;
+  size_t n;
+
+  while (p < end) {
+    uint8_t type = *p++;
+
+    if (type == TF_REC_TEXT) {
+      if ((n = tf_get_varint(p, end, &v)) == 0 || v > (uint64_t)(end - p - n))
+        return -1;
+      fwrite(p + n, 1, v, stdout);
+      p += n + v;
+      continue;
+    }
+    if (type != TF_REC_CYCLE || p >= end)
+      return -1;
+
+    uint8_t flags = *p++;
+    if (flags & TF_CYC_STAGES) {
+      if ((n = tf_get_varint(p, end, &v)) == 0)
+        return -1;
+      p += n;
+      last_cycle += 1 + tf_unzigzag(v);
+      trace_print_cycle_header(last_cycle);
+
+      uint64_t present;
+      if ((n = tf_get_varint(p, end, &present)) == 0)
+        return -1;
+      p += n;
+
+      uint32_t bits[TF_MAX_SLOTS], addr[TF_MAX_SLOTS];
+      for (uint8_t s = 0; s < TF_MAX_SLOTS; s++) {
+        if (!(present & (1U << s)))
+          continue;
+        if (p >= end)
+          return -1;
+        uint8_t code = *p++;
+        switch (code) {
+          case TF_SLOT_SHIFTED:
+            if (s == 0)
+              return -1;
+            bits[s] = prev_bits[s-1];
+            addr[s] = prev_addr[s-1];
+            break;
+          case TF_SLOT_HELD:
+            bits[s] = prev_bits[s];
+            addr[s] = prev_addr[s];
+            break;
+          case TF_SLOT_SQUASHED:
+            if (s == 0)
+              return -1;
+            bits[s] = 0x00000013;
+            addr[s] = prev_addr[s-1];
+            break;
+          case TF_SLOT_NEXT:
+          case TF_SLOT_LITERAL:
+            if (code == TF_SLOT_LITERAL) {
+              if ((n = tf_get_varint(p, end, &v)) == 0)
+                return -1;
+              p += n;
+              addr[s] = prev_addr[s] + (uint32_t)tf_unzigzag(v);
+            } else {
+              addr[s] = prev_addr[s] + 4;
+            }
+            if (end - p < 4)
+              return -1;
+            bits[s] = tf_get_u32(p);
+            p += 4;
+            break;
+          default:
+            return -1;
+        }
+        char name[TRACE_SLOT_NAME_SIZE];
+        trace_slot_name(s, nif, nex, nmem, name);
+        trace_print_stage(name, bits[s], addr[s]);
+      }
+      for (uint8_t s = 0; s < TF_MAX_SLOTS; s++) {
+        if (present & (1U << s)) {
+          prev_bits[s] = bits[s];
+          prev_addr[s] = addr[s];
+        }
+      }
+    }
+
+    if (flags & TF_CYC_FLUSH)
+      trace_print_flushed();
+
+    if (flags & TF_CYC_REGS) {
+      uint64_t changed;
+      if ((n = tf_get_varint(p, end, &changed)) == 0)
+        return -1;
+      p += n;
+      for (int i = 0; i < 32; i++) {
+        if (changed & (1U << i)) {
+          if (end - p < 4)
+            return -1;
+          regs[i] = tf_get_u32(p);
+          p += 4;
+        }
+      }
+      trace_print_regs(regs);
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <trace.bin>\n", argv[0]);
+    return -1;
+  }
+  FILE* file = fopen(argv[1], "rb");
+  if (file == NULL) {
+    perror(argv[1]);
+    return -1;
+  }
+
+  uint8_t header[TF_MAGIC_LEN + 4];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+      memcmp(header, TF_MAGIC, TF_MAGIC_LEN) != 0) {
+    fprintf(stderr, "%s: not a riscv binary trace\n", argv[1]);
+    return -1;
+  }
+  nif  = header[TF_MAGIC_LEN];
+  nex  = header[TF_MAGIC_LEN + 1];
+  nmem = header[TF_MAGIC_LEN + 2];
+
+  static uint8_t raw[TF_BLOCK_SIZE];
+  static uint8_t comp[TF_COMPRESS_BOUND(TF_BLOCK_SIZE)];
+  uint8_t lens[8];
+  size_t got;
+
+  while ((got = fread(lens, 1, sizeof(lens), file)) == sizeof(lens)) {
+    uint32_t raw_len = tf_get_u32(lens);
+    uint32_t comp_len = tf_get_u32(lens + 4);
+    if (raw_len > TF_BLOCK_SIZE || comp_len > sizeof(comp) ||
+        fread(comp, 1, comp_len, file) != comp_len ||
+        tf_decompress(comp, comp_len, raw, sizeof(raw)) != raw_len ||
+        print_block(raw, raw + raw_len) != 0)
+      return bad_trace(argv[1]);
+  }
+  fclose(file);
+  return (got == 0) ? 0 : bad_trace(argv[1]);
+}
@@ -0,0 +1,176 @@
+//trace_format.c
+#include <string.h>
+#include "trace_format.h"
+
+#define TF_MIN_MATCH  4
+#define TF_MAX_OFFSET 0xFFFF
+#define TF_HASH_BITS  12
+
+size_t tf_put_varint(uint8_t* p, uint64_t v)
+{
+  size_t n = 0;
+  while (v >= 0x80) {
+    p[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  p[n++] = (uint8_t)v;
+  return n;
+}
+
+/**
+ * returns the number of bytes read, 0 when the varint runs past `end`
+ **/
+size_t tf_get_varint(const uint8_t* p, const uint8_t* end, uint64_t* v_p)
+{
+  uint64_t v = 0;
+  for (size_t n = 0; p + n < end && n < 10; n++) {
+    v |= (uint64_t)(p[n] & 0x7F) << (7 * n);
+    if (!(p[n] & 0x80)) {
+      *v_p = v;
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+uint64_t tf_zigzag(int64_t v)
+{
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+int64_t tf_unzigzag(uint64_t v)
+{
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+void tf_put_u32(uint8_t* p, uint32_t v)
+{
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  p[2] = (v >> 16) & 0xFF;
+  p[3] = (v >> 24) & 0xFF;
+}
+
+uint32_t tf_get_u32(const uint8_t* p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Block codec: byte-oriented LZ77. Each sequence is a token (literal length
+/// in the high nibble, match length - 4 in the low one, 15 = more length
+/// bytes follow), the literals, and a 16-bit match offset. The last sequence
+/// of a block only has literals.
+///////////////////////////////////////////////////////////////////////////////
+
+static uint8_t* tf_put_length(uint8_t* op, size_t len)
+{
+  for (len -= 15; len >= 255; len -= 255)
+    *op++ = 255;
+  *op++ = (uint8_t)len;
+  return op;
+}
+
+static uint8_t* tf_put_sequence(uint8_t* op, const uint8_t* lit, size_t lit_len,
+                                size_t offset, size_t match_len)
+{
+  size_t ml = (offset) ? match_len - TF_MIN_MATCH : 0;
+  *op++ = (uint8_t)(((lit_len < 15) ? lit_len : 15) << 4 | ((ml < 15) ? ml : 15));
+  if (lit_len >= 15)
+    op = tf_put_length(op, lit_len);
+  memcpy(op, lit, lit_len);
+  op += lit_len;
+  if (offset) {
+    *op++ = offset & 0xFF;
+    *op++ = (offset >> 8) & 0xFF;
+    if (ml >= 15)
+      op = tf_put_length(op, ml);
+  }
+  return op;
+}
+
+/**
+ * compress `n` bytes into `dst`, which holds at least TF_COMPRESS_BOUND(n),
+ * and return the compressed size
+ **/
+size_t tf_compress(const uint8_t* src, size_t n, uint8_t* dst)
+{
+  int32_t table[1 << TF_HASH_BITS];
+  uint8_t* op = dst;
+  size_t ip = 0, anchor = 0;
+
+  memset(table, 0xFF, sizeof(table));
+  while (ip + TF_MIN_MATCH <= n) {
+    uint32_t seq;
+    memcpy(&seq, src + ip, 4);
+    uint32_t h = (seq * 2654435761U) >> (32 - TF_HASH_BITS);
+    int32_t ref = table[h];
+    table[h] = (int32_t)ip;
+
+    if (ref < 0 || ip - ref > TF_MAX_OFFSET || memcmp(src + ref, src + ip, 4) != 0) {
+      ip++;
+      continue;
+    }
+    size_t len = TF_MIN_MATCH;
+    while (ip + len < n && src[ref + len] == src[ip + len])
+      len++;
+    op = tf_put_sequence(op, src + anchor, ip - anchor, ip - ref, len);
+    ip += len;
+    anchor = ip;
+  }
+  op = tf_put_sequence(op, src + anchor, n - anchor, 0, 0);
+  return op - dst;
+}
+
+static int tf_get_length(const uint8_t** ip_p, const uint8_t* end, size_t* len_p)
+{
+  uint8_t b;
+  do {
+    if (*ip_p >= end)
+      return -1;
+    b = *(*ip_p)++;
+    *len_p += b;
+  } while (b == 255);
+  return 0;
+}
+
+/**
+ * decompress a block into `dst` (room for `cap` bytes), returns the raw size
+ * or (size_t)-1 if the block is corrupt
+ **/
+size_t tf_decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap)
+{
+  const uint8_t* ip = src;
+  const uint8_t* end = src + n;
+  size_t op = 0;
+
+  while (ip < end) {
+    uint8_t token = *ip++;
+    size_t lit_len = token >> 4;
+    if (lit_len == 15 && tf_get_length(&ip, end, &lit_len) != 0)
+      return (size_t)-1;
+    if (lit_len > (size_t)(end - ip) || op + lit_len > cap)
+      return (size_t)-1;
+    memcpy(dst + op, ip, lit_len);
+    ip += lit_len;
+    op += lit_len;
+    if (ip == end)
+      break;
+
+    if (end - ip < 2)
+      return (size_t)-1;
+    size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    size_t match_len = token & 0xF;
+    if (match_len == 15 && tf_get_length(&ip, end, &match_len) != 0)
+      return (size_t)-1;
+    match_len += TF_MIN_MATCH;
+    if (offset == 0 || offset > op || op + match_len > cap)
+      return (size_t)-1;
+    // byte by byte, the match may overlap what it is copying
+    for (size_t i = 0; i < match_len; i++, op++)
+      dst[op] = dst[op - offset];
+  }
+  return op;
+}
@@ -0,0 +1,50 @@
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Binary trace file (--trace-bin), read back by riscv-trace2txt:
+ *
+ *   "RVTRACE1", IF/EX/MEM sub-stage counts, 1 reserved byte
+ *   blocks of { u32 raw length, u32 compressed length, compressed bytes }
+ *
+ * A block decompresses to whole records. A cycle record holds the stage
+ * lines as codes relative to the previous cycle (most instructions just
+ * moved down one slot) and only the registers that changed.
+ **/
+#define TF_MAGIC        "RVTRACE1"
+#define TF_MAGIC_LEN    8
+#define TF_BLOCK_SIZE   (64 * 1024)          // raw bytes per compressed block
+#define TF_MAX_RECORD   1024                 // upper bound of one encoded record
+#define TF_MAX_SLOTS    16                   // printed stage lines per cycle
+#define TF_COMPRESS_BOUND(n) ((n) + (n) / 255 + 16)
+
+// record types
+#define TF_REC_CYCLE    0x01
+#define TF_REC_TEXT     0x02
+
+// cycle record flags
+#define TF_CYC_STAGES   0x01    // cycle header and stage lines (DEBUG_CYCLE)
+#define TF_CYC_REGS     0x02    // register dump (DEBUG_REG_TRACE)
+#define TF_CYC_FLUSH    0x04    // "[CPL]: Pipeline Flushed"
+
+// stage line codes
+#define TF_SLOT_SHIFTED  0      // what the slot before held last cycle
+#define TF_SLOT_HELD     1      // what this slot held last cycle
+#define TF_SLOT_SQUASHED 2      // NOP at the address the slot before held
+#define TF_SLOT_NEXT     3      // new bits, address 4 past this slot's last one
+#define TF_SLOT_LITERAL  4      // new bits and address
+
+size_t   tf_put_varint(uint8_t* p, uint64_t v);
+size_t   tf_get_varint(const uint8_t* p, const uint8_t* end, uint64_t* v_p);
+uint64_t tf_zigzag(int64_t v);
+int64_t  tf_unzigzag(uint64_t v);
+void     tf_put_u32(uint8_t* p, uint32_t v);
+uint32_t tf_get_u32(const uint8_t* p);
+
+size_t   tf_compress(const uint8_t* src, size_t n, uint8_t* dst);
+size_t   tf_decompress(const uint8_t* src, size_t n, uint8_t* dst, size_t cap);
+
+#endif // TRACE_FORMAT_H
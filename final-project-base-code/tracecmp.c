@@ -0,0 +1,370 @@
+//tracecmp.c
+// riscv-tracecmp: compares the output of the simulator against a reference
+// trace and reports where they first diverge
+//
+//   riscv-tracecmp [-j threads] <ref.trace> <out.trace>
+//   ./riscv -s ... | riscv-tracecmp <ref.trace> -
+//
+// Both traces are mapped into memory and compared in parallel chunks. The
+// output can also come straight from the simulator on a pipe, then it is
+// compared as it is read and never stored. Exits with 0 when the traces
+// match, 1 when they differ and 2 on errors.
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CMP_BLOCK       (1 << 20)     // bytes compared between progress checks
+#define CMP_MIN_PARALLEL (4 * CMP_BLOCK)
+#define CMP_MAX_THREADS 16
+#define CMP_CONTEXT     4096          // output kept after the divergence
+#define CYCLE_HEADER    "v==============Cycle Counter ="
+
+typedef struct
+{
+  const uint8_t* data;
+  size_t size;
+}trace_map_t;
+
+typedef struct
+{
+  const uint8_t* ref;
+  const uint8_t* out;
+  size_t begin;
+  size_t end;
+}cmp_job_t;
+
+// lowest offset where a worker found the traces to differ
+static _Atomic size_t first_diff;
+
+static int map_trace(const char* path, int fd, trace_map_t* map)
+{
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    perror(path);
+    return -1;
+  }
+  map->size = st.st_size;
+  map->data = NULL;
+  if (map->size == 0)
+    return 0;
+  void* p = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED) {
+    perror(path);
+    return -1;
+  }
+  madvise(p, map->size, MADV_SEQUENTIAL);
+  map->data = p;
+  return 0;
+}
+
+static size_t mismatch(const uint8_t* a, const uint8_t* b, size_t n)
+{
+  size_t i = 0;
+  while (i < n && a[i] == b[i])
+    i++;
+  return i;
+}
+
+/**
+ * compare one chunk, giving up once another worker found an earlier mismatch
+ **/
+static void* cmp_worker(void* arg)
+{
+  cmp_job_t* job = arg;
+
+  for (size_t off = job->begin; off < job->end; off += CMP_BLOCK) {
+    size_t found = atomic_load_explicit(&first_diff, memory_order_relaxed);
+    if (off >= found)
+      break;
+    size_t n = (job->end - off < CMP_BLOCK) ? job->end - off : CMP_BLOCK;
+    if (memcmp(job->ref + off, job->out + off, n) != 0) {
+      size_t d = off + mismatch(job->ref + off, job->out + off, n);
+      while (d < found &&
+             !atomic_compare_exchange_weak(&first_diff, &found, d))
+        ;
+      break;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * returns the offset of the first differing byte of two mapped traces, or
+ * the length of the shorter one when it is a prefix of the other
+ **/
+static size_t compare_maps(const trace_map_t* ref, const trace_map_t* out, int threads)
+{
+  size_t n = (ref->size < out->size) ? ref->size : out->size;
+  atomic_store(&first_diff, n);
+
+  if (n < CMP_MIN_PARALLEL || threads < 2) {
+    cmp_job_t job = {ref->data, out->data, 0, n};
+    cmp_worker(&job);
+    return atomic_load(&first_diff);
+  }
+
+  pthread_t tid[CMP_MAX_THREADS];
+  cmp_job_t jobs[CMP_MAX_THREADS];
+  size_t chunk = (n / threads + CMP_BLOCK - 1) / CMP_BLOCK * CMP_BLOCK;
+  int started = 0;
+
+  for (int t = 0; t < threads; t++) {
+    size_t begin = t * chunk;
+    if (begin >= n)
+      break;
+    jobs[t] = (cmp_job_t){ref->data, out->data, begin,
+                          (begin + chunk < n) ? begin + chunk : n};
+    if (pthread_create(&tid[t], NULL, cmp_worker, &jobs[t]) != 0)
+      cmp_worker(&jobs[t]);   // no thread, compare it here
+    else
+      started |= 1 << t;
+  }
+  for (int t = 0; t < threads; t++) {
+    if (started & (1 << t))
+      pthread_join(tid[t], NULL);
+  }
+  return atomic_load(&first_diff);
+}
+
+/**
+ * compare the output read from `fd` against the reference as it arrives.
+ * Returns the offset of the first difference (ref->size and *tail_len 0
+ * when they match) and copies up to CMP_CONTEXT bytes of the output from
+ * there into `tail`.
+ **/
+static size_t compare_stream(const trace_map_t* ref, int fd, uint8_t* tail, size_t* tail_len)
+{
+  static uint8_t buf[CMP_BLOCK];
+  size_t off = 0;
+  ssize_t got;
+
+  *tail_len = 0;
+  while ((got = read(fd, buf, sizeof(buf))) > 0) {
+    size_t n = (size_t)got;
+    size_t left = ref->size - off;
+    size_t same = mismatch(ref->data + off, buf, (n < left) ? n : left);
+    if (same == n) {
+      off += n;
+      continue;
+    }
+    // diverged: keep what follows for the report
+    *tail_len = (n - same < CMP_CONTEXT) ? n - same : CMP_CONTEXT;
+    memcpy(tail, buf + same, *tail_len);
+    while (*tail_len < CMP_CONTEXT &&
+           (got = read(fd, tail + *tail_len, CMP_CONTEXT - *tail_len)) > 0)
+      *tail_len += got;
+    return off + same;
+  }
+  return off;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+/// Divergence report
+///////////////////////////////////////////////////////////////////////////////
+
+static size_t line_start(const uint8_t* p, size_t off)
+{
+  while (off > 0 && p[off - 1] != '\n')
+    off--;
+  return off;
+}
+
+/**
+ * copy the line at `p` (up to its newline) into `line`
+ **/
+static void copy_line(const uint8_t* p, size_t n, char* line, size_t cap)
+{
+  size_t i = 0;
+  while (i < n && i < cap - 1 && p[i] != '\n') {
+    line[i] = p[i];
+    i++;
+  }
+  line[i] = '\0';
+}
+
+/**
+ * read a register dump ("r 0=00000000 r 1=..." on 8 lines), returns the
+ * number of registers found
+ **/
+static int parse_regs(const char* text, uint32_t R[32])
+{
+  int found = 0;
+  const char* p = text;
+  while ((p = strchr(p, 'r')) != NULL) {
+    unsigned reg, val;
+    int len;
+    if (sscanf(p, "r%2u=%8x%n", &reg, &val, &len) == 2 && reg < 32) {
+      R[reg] = val;
+      found++;
+      p += len;
+    } else {
+      p++;
+    }
+  }
+  return found;
+}
+
+static int is_reg_line(const char* line)
+{
+  return line[0] == 'r' && (line[1] == ' ' || (line[1] >= '0' && line[1] <= '9')) &&
+         line[3] == '=';
+}
+
+/**
+ * print where the traces diverge: the cycle, the stage line or the
+ * registers that differ. The output is the reference up to `d` followed
+ * by `tail`.
+ **/
+static void report(const trace_map_t* ref, size_t d, const uint8_t* tail, size_t tail_len)
+{
+  const uint8_t* r = ref->data;
+  size_t ls = line_start(r, d);
+
+  // line number and the cycle the line belongs to
+  size_t lineno = 1;
+  for (const uint8_t* p = r; p && (p = memchr(p, '\n', r + ls - p)) != NULL; p++)
+    lineno++;
+  long cycle = -1;
+  for (size_t p = ls; ; p = line_start(r, p - 1)) {
+    if (ref->size - p >= sizeof(CYCLE_HEADER) - 1 &&
+        memcmp(r + p, CYCLE_HEADER, sizeof(CYCLE_HEADER) - 1) == 0) {
+      cycle = strtol((const char*)r + p + sizeof(CYCLE_HEADER) - 1, NULL, 10);
+      break;
+    }
+    if (p == 0)
+      break;
+  }
+
+  // the two versions of the diverging line
+  char ref_line[256], out_line[256];
+  size_t pre = d - ls;
+  copy_line(r + ls, ref->size - ls, ref_line, sizeof(ref_line));
+  memcpy(out_line, r + ls, (pre < sizeof(out_line) - 1) ? pre : sizeof(out_line) - 1);
+  if (pre < sizeof(out_line) - 1)
+    copy_line(tail, tail_len, out_line + pre, sizeof(out_line) - pre);
+  else
+    out_line[sizeof(out_line) - 1] = '\0';
+
+  if (cycle >= 0)
+    printf("traces differ at cycle %ld (line %zu)\n", cycle, lineno);
+  else
+    printf("traces differ at line %zu\n", lineno);
+
+  if (d == ref->size) {
+    printf("  ref: <end of trace>\n  out: %s\n", out_line);
+    return;
+  }
+  if (tail_len == 0) {
+    printf("  ref: %s\n  out: <end of trace>\n", ref_line);
+    return;
+  }
+
+  if (ref_line[0] == '[' && strchr(ref_line, ']')) {
+    int len = strchr(ref_line, ']') - ref_line - 1;
+    while (len > 0 && ref_line[len] == ' ')
+      len--;
+    printf("  stage %.*s\n", len, ref_line + 1);
+  } else if (is_reg_line(ref_line) && is_reg_line(out_line)) {
+    // back up to the start of the register dump and compare all of it
+    size_t dump = ls;
+    for (int i = 0; i < 8 && dump > 0 && memcmp(r + dump, "r 0=", 4) != 0; i++)
+      dump = line_start(r, dump - 1);
+    size_t head = d - dump;
+    size_t len = (ref->size - dump < 1024) ? ref->size - dump : 1024;
+    char ref_dump[1024 + 1], out_dump[1024 + CMP_CONTEXT + 1];
+    memcpy(ref_dump, r + dump, len);
+    ref_dump[len] = '\0';
+    memcpy(out_dump, r + dump, head);
+    memcpy(out_dump + head, tail, tail_len);
+    out_dump[head + tail_len] = '\0';
+    // only the 8 lines of this dump
+    char* end = ref_dump;
+    for (int i = 0; i < 8 && end; i++)
+      end = strchr(end + 1, '\n');
+    if (end) *end = '\0';
+    end = out_dump;
+    for (int i = 0; i < 8 && end; i++)
+      end = strchr(end + 1, '\n');
+    if (end) *end = '\0';
+
+    uint32_t ref_R[32] = {0}, out_R[32] = {0};
+    if (parse_regs(ref_dump, ref_R) == 32 && parse_regs(out_dump, out_R) == 32) {
+      for (int i = 0; i < 32; i++) {
+        if (ref_R[i] != out_R[i])
+          printf("  x%-2d ref %08x  out %08x  (delta %+d)\n", i, ref_R[i],
+                 out_R[i], (int32_t)(out_R[i] - ref_R[i]));
+      }
+      return;
+    }
+  }
+  printf("  ref: %s\n  out: %s\n", ref_line, out_line);
+}
+
+int main(int argc, char **argv)
+{
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int c;
+
+  while ((c = getopt(argc, argv, "j:")) != -1) {
+    switch (c) {
+    case 'j':
+      threads = atoi(optarg);
+      break;
+    default:
+      return 2;
+    }
+  }
+  if (argc - optind != 2) {
+    fprintf(stderr, "usage: %s [-j threads] <ref.trace> <out.trace|->\n", argv[0]);
+    return 2;
+  }
+  if (threads < 1) threads = 1;
+  if (threads > CMP_MAX_THREADS) threads = CMP_MAX_THREADS;
+
+  const char* ref_path = argv[optind];
+  const char* out_path = argv[optind + 1];
+  trace_map_t ref, out;
+
+  int ref_fd = open(ref_path, O_RDONLY);
+  if (ref_fd < 0) {
+    perror(ref_path);
+    return 2;
+  }
+  if (map_trace(ref_path, ref_fd, &ref) != 0)
+    return 2;
+
+  int out_fd = (strcmp(out_path, "-") == 0) ? STDIN_FILENO : open(out_path, O_RDONLY);
+  if (out_fd < 0) {
+    perror(out_path);
+    return 2;
+  }
+
+  struct stat st;
+  size_t d;
+  static uint8_t tail[CMP_CONTEXT];
+  size_t tail_len;
+
+  if (fstat(out_fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    if (map_trace(out_path, out_fd, &out) != 0)
+      return 2;
+    d = compare_maps(&ref, &out, threads);
+    if (d == ref.size && d == out.size)
+      return 0;
+    tail_len = out.size - d;
+    report(&ref, d, out.data + d, (tail_len < CMP_CONTEXT) ? tail_len : CMP_CONTEXT);
+  } else {
+    // a pipe: compare the simulator output as it comes
+    d = compare_stream(&ref, out_fd, tail, &tail_len);
+    if (d == ref.size && tail_len == 0)
+      return 0;
+    report(&ref, d, tail, tail_len);
+  }
+  return 1;
+}
@@ -42,8 +42,9 @@ typedef enum {
     LENGTH_WORD = 4,
 } Alignment;
 
-/* This is the length of the memory space */
-#define MEMORY_SPACE (1024*1024) /* 1 MByte of Memory */
+/* This is the length of the memory space: the whole 32-bit address space,
+   allocated page by page as it is used (see guest_mem.h) */
+#define MEMORY_SPACE (1ULL << 32) /* 4 GByte of Memory */
 
 /* If you haven't seen a union before, go look it up.
    Seriously. They're fun. */
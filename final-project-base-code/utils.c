@@ -15,8 +15,8 @@ Instruction parse_instruction(uint32_t instruction_bits) {
   instruction_bits >>= 7;
 
   switch (instruction.opcode) {
-  // R-Type
-  case 0x33:
+  // R-Type, and the RV32A atomics use its fields
+  case 0x33: case 0x2F:
     // instruction: 0000 0001 0101 1010 0000 0100 1, destination : 01001
     instruction.rtype.rd = instruction_bits & ((1U << 5) - 1);
     instruction_bits >>= 5;
@@ -49,8 +49,8 @@ Instruction parse_instruction(uint32_t instruction_bits) {
     instruction.itype.rs1 = instruction_bits & ((1U << 5)-1);
     instruction_bits >>= 5;
 
-    instruction.itype.imm = instruction_bits & ((1U << 11)-1);
-    instruction_bits >>=11;
+    instruction.itype.imm = instruction_bits & ((1U << 12)-1);
+    instruction_bits >>=12;
     break;
 
     case 0x13: //i-type (0010011)
@@ -63,8 +63,22 @@ Instruction parse_instruction(uint32_t instruction_bits) {
     instruction.itype.rs1 = instruction_bits & ((1U << 5)-1);
     instruction_bits >>= 5;
 
-    instruction.itype.imm = instruction_bits & ((1U << 11)-1);
-    instruction_bits >>=11;
+    instruction.itype.imm = instruction_bits & ((1U << 12)-1);
+    instruction_bits >>=12;
+    break;
+
+    case 0x67: //jalr (1100111), i-type layout
+    instruction.itype.rd = instruction_bits & ((1U<<5)-1);
+    instruction_bits >>= 5;
+
+    instruction.itype.funct3 = instruction_bits & ((1U << 3)-1);
+    instruction_bits >>= 3;
+
+    instruction.itype.rs1 = instruction_bits & ((1U << 5)-1);
+    instruction_bits >>= 5;
+
+    instruction.itype.imm = instruction_bits & ((1U << 12)-1);
+    instruction_bits >>=12;
     break;
 
     case 0x73://(1110011)
@@ -77,8 +91,8 @@ Instruction parse_instruction(uint32_t instruction_bits) {
     instruction.itype.rs1 = instruction_bits & ((1U << 5)-1);
     instruction_bits >>= 5;
 
-    instruction.itype.imm = instruction_bits & ((1U << 11)-1);
-    instruction_bits >>=11;
+    instruction.itype.imm = instruction_bits & ((1U << 12)-1);
+    instruction_bits >>=12;
     break;
 
     case 0x23: //stype
@@ -115,7 +129,7 @@ Instruction parse_instruction(uint32_t instruction_bits) {
     instruction_bits >>= 7;
     break;
 
-    case 0x37:
+    case 0x37: case 0x17: //lui, auipc
     instruction.utype.rd = instruction_bits & ((1U << 5)-1);
     instruction_bits >>= 5;
 
@@ -128,8 +142,8 @@ Instruction parse_instruction(uint32_t instruction_bits) {
     instruction.ujtype.rd = instruction_bits & ((1U <<5)-1);
     instruction_bits >>= 5;
     
-    instruction.ujtype.imm = instruction_bits & ((1U << 11)-1);
-    instruction_bits >>= 11;
+    instruction.ujtype.imm = instruction_bits & ((1U << 20)-1);
+    instruction_bits >>= 20;
     break;
     
 
@@ -237,4 +251,14 @@ void handle_invalid_read(Address address) {
 void handle_invalid_write(Address address) {
   printf("Bad Write. Address: 0x%08x\n", address);
   exit(-1);
-}
\ No newline at end of file
+}
+
+void handle_misaligned_read(Address address) {
+  printf("Misaligned Read. Address: 0x%08x\n", address);
+  exit(-1);
+}
+
+void handle_misaligned_write(Address address) {
+  printf("Misaligned Write. Address: 0x%08x\n", address);
+  exit(-1);
+}
@@ -8,11 +8,18 @@
 #define MEM_FORMAT "%s\tx%d, %d(x%d)\n"
 #define LUI_FORMAT "lui\tx%d, %d\n"
 #define JAL_FORMAT "jal\tx%d, %d\n"
+#define JALR_FORMAT "jalr\tx%d, x%d, %d\n"
+#define AUIPC_FORMAT "auipc\tx%d, %d\n"
 #define BRANCH_FORMAT "%s\tx%d, x%d, %d\n"
 #define ECALL_FORMAT "ecall\n"
+#define CSR_FORMAT "%s\tx%d, 0x%03x, x%d\n"
+#define CSRI_FORMAT "%s\tx%d, 0x%03x, %d\n"
+#define LR_FORMAT "%s\tx%d, (x%d)\n"
+#define AMO_FORMAT "%s\tx%d, x%d, (x%d)\n"
 #define CACHE_EVICTION_FORMAT "[MEM]: Cache eviction for address: 0x%.8llx\n"
 #define CACHE_HIT_FORMAT "[MEM]: Cache hit for address: 0x%.8llx\n"
 #define CACHE_MISS_FORMAT "[MEM]: Cache miss for address: 0x%.8llx\n"
+#define MEM_HELD_TEXT "[MEM]: Pipeline held\n"
 
 Instruction parse_instruction(uint32_t);
 int sign_extend_number(unsigned, unsigned);
@@ -23,5 +30,7 @@ int get_store_offset(Instruction);
 void handle_invalid_instruction(Instruction);
 void handle_invalid_read(Address);
 void handle_invalid_write(Address);
+void handle_misaligned_read(Address);
+void handle_misaligned_write(Address);
 
 #endif // __UTILS_H__